@@ -0,0 +1,707 @@
+/*********************************************************************
+*
+* File      : hash.c
+*
+* Purpose   : Compute XXH3 64 bit and SHA-256 digests , for '--hash'.
+*
+* Notes     : Both are written from their specifications and give the
+*             same digests as the reference implementations.
+*
+*********************************************************************/
+
+#include	<string.h>
+#include	"hash.h"
+
+#define	XXH_PRIME32_1	0x9E3779B1ULL
+#define	XXH_PRIME32_2	0x85EBCA77ULL
+#define	XXH_PRIME32_3	0xC2B2AE3DULL
+#define	XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define	XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define	XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define	XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define	XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+#define	XXH3_STRIPE		64
+#define	XXH3_SECRET_SIZE	192
+#define	XXH3_SECRET_SIZE_MIN	136
+#define	XXH3_BLOCK_STRIPES	((XXH3_SECRET_SIZE - XXH3_STRIPE) / 8)
+#define	XXH3_MID_MAX	240			/* longest input hashed without the accumulators */
+#define	ROTR32(value,bits)	(((value) >> (bits)) | ((value) << (32 - (bits))))
+
+static const unsigned char	xxh3_secret[XXH3_SECRET_SIZE] = {
+	0xb8 , 0xfe , 0x6c , 0x39 , 0x23 , 0xa4 , 0x4b , 0xbe , 0x7c , 0x01 , 0x81 , 0x2c , 0xf7 , 0x21 , 0xad , 0x1c ,
+	0xde , 0xd4 , 0x6d , 0xe9 , 0x83 , 0x90 , 0x97 , 0xdb , 0x72 , 0x40 , 0xa4 , 0xa4 , 0xb7 , 0xb3 , 0x67 , 0x1f ,
+	0xcb , 0x79 , 0xe6 , 0x4e , 0xcc , 0xc0 , 0xe5 , 0x78 , 0x82 , 0x5a , 0xd0 , 0x7d , 0xcc , 0xff , 0x72 , 0x21 ,
+	0xb8 , 0x08 , 0x46 , 0x74 , 0xf7 , 0x43 , 0x24 , 0x8e , 0xe0 , 0x35 , 0x90 , 0xe6 , 0x81 , 0x3a , 0x26 , 0x4c ,
+	0x3c , 0x28 , 0x52 , 0xbb , 0x91 , 0xc3 , 0x00 , 0xcb , 0x88 , 0xd0 , 0x65 , 0x8b , 0x1b , 0x53 , 0x2e , 0xa3 ,
+	0x71 , 0x64 , 0x48 , 0x97 , 0xa2 , 0x0d , 0xf9 , 0x4e , 0x38 , 0x19 , 0xef , 0x46 , 0xa9 , 0xde , 0xac , 0xd8 ,
+	0xa8 , 0xfa , 0x76 , 0x3f , 0xe3 , 0x9c , 0x34 , 0x3f , 0xf9 , 0xdc , 0xbb , 0xc7 , 0xc7 , 0x0b , 0x4f , 0x1d ,
+	0x8a , 0x51 , 0xe0 , 0x4b , 0xcd , 0xb4 , 0x59 , 0x31 , 0xc8 , 0x9f , 0x7e , 0xc9 , 0xd9 , 0x78 , 0x73 , 0x64 ,
+	0xea , 0xc5 , 0xac , 0x83 , 0x34 , 0xd3 , 0xeb , 0xc3 , 0xc5 , 0x81 , 0xa0 , 0xff , 0xfa , 0x13 , 0x63 , 0xeb ,
+	0x17 , 0x0d , 0xdd , 0x51 , 0xb7 , 0xf0 , 0xda , 0x49 , 0xd3 , 0x16 , 0x55 , 0x26 , 0x29 , 0xd4 , 0x68 , 0x9e ,
+	0x2b , 0x16 , 0xbe , 0x58 , 0x7d , 0x47 , 0xa1 , 0xfc , 0x8f , 0xf8 , 0xb8 , 0xd1 , 0x7a , 0xd0 , 0x31 , 0xce ,
+	0x45 , 0xcb , 0x3a , 0x8f , 0x95 , 0x16 , 0x04 , 0x28 , 0xaf , 0xd7 , 0xfb , 0xca , 0xbb , 0x4b , 0x40 , 0x7e
+};
+
+static const unsigned int	sha256_k[64] = {
+	0x428a2f98 , 0x71374491 , 0xb5c0fbcf , 0xe9b5dba5 , 0x3956c25b , 0x59f111f1 , 0x923f82a4 , 0xab1c5ed5 ,
+	0xd807aa98 , 0x12835b01 , 0x243185be , 0x550c7dc3 , 0x72be5d74 , 0x80deb1fe , 0x9bdc06a7 , 0xc19bf174 ,
+	0xe49b69c1 , 0xefbe4786 , 0x0fc19dc6 , 0x240ca1cc , 0x2de92c6f , 0x4a7484aa , 0x5cb0a9dc , 0x76f988da ,
+	0x983e5152 , 0xa831c66d , 0xb00327c8 , 0xbf597fc7 , 0xc6e00bf3 , 0xd5a79147 , 0x06ca6351 , 0x14292967 ,
+	0x27b70a85 , 0x2e1b2138 , 0x4d2c6dfc , 0x53380d13 , 0x650a7354 , 0x766a0abb , 0x81c2c92e , 0x92722c85 ,
+	0xa2bfe8a1 , 0xa81a664b , 0xc24b8b70 , 0xc76c51a3 , 0xd192e819 , 0xd6990624 , 0xf40e3585 , 0x106aa070 ,
+	0x19a4c116 , 0x1e376c08 , 0x2748774c , 0x34b0bcb5 , 0x391c0cb3 , 0x4ed8aa4a , 0x5b9cca4f , 0x682e6ff3 ,
+	0x748f82ee , 0x78a5636f , 0x84c87814 , 0x8cc70208 , 0x90befffa , 0xa4506ceb , 0xbef9a3f7 , 0xc67178f2
+};
+
+
+/*********************************************************************
+*
+* Function  : read_le64
+*
+* Purpose   : Get a little endian 64 bit number from a buffer.
+*
+* Inputs    : const unsigned char *bytes - the 8 bytes
+*
+* Output    : (none)
+*
+* Returns   : the number
+*
+* Example   : value = read_le64(&input[8]);
+*
+* Notes     : XXH3 reads its input and its secret little endian.
+*
+*********************************************************************/
+
+unsigned long long read_le64(const unsigned char *bytes)
+{
+	unsigned long long	value;
+
+	memcpy(&value,bytes,sizeof(value));
+#if	__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+
+	return(value);
+} /* end of read_le64 */
+
+/*********************************************************************
+*
+* Function  : read_le32
+*
+* Purpose   : Get a little endian 32 bit number from a buffer.
+*
+* Inputs    : const unsigned char *bytes - the 4 bytes
+*
+* Output    : (none)
+*
+* Returns   : the number
+*
+* Example   : value = read_le32(input);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+unsigned int read_le32(const unsigned char *bytes)
+{
+	return( bytes[0] | (unsigned int)bytes[1] << 8 | (unsigned int)bytes[2] << 16 | (unsigned int)bytes[3] << 24 );
+} /* end of read_le32 */
+
+/*********************************************************************
+*
+* Function  : xxh3_fold
+*
+* Purpose   : Multiply two 64 bit numbers and fold the 128 bit product.
+*
+* Inputs    : unsigned long long left - first number
+*             unsigned long long right - second number
+*
+* Output    : (none)
+*
+* Returns   : the low 64 bits of the product xor the high 64 bits
+*
+* Example   : acc += xxh3_fold(low,high);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+unsigned long long xxh3_fold(unsigned long long left, unsigned long long right)
+{
+	unsigned __int128	product;
+
+	product = (unsigned __int128)left * right;
+
+	return( (unsigned long long)product ^ (unsigned long long)(product >> 64) );
+} /* end of xxh3_fold */
+
+/*********************************************************************
+*
+* Function  : xxh3_avalanche
+*
+* Purpose   : Mix the bits of an XXH3 result.
+*
+* Inputs    : unsigned long long hash - the result
+*
+* Output    : (none)
+*
+* Returns   : the mixed result
+*
+* Example   : return( xxh3_avalanche(acc) );
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+unsigned long long xxh3_avalanche(unsigned long long hash)
+{
+	hash ^= hash >> 37;
+	hash *= 0x165667919E3779F9ULL;
+	hash ^= hash >> 32;
+
+	return(hash);
+} /* end of xxh3_avalanche */
+
+/*********************************************************************
+*
+* Function  : xxh64_avalanche
+*
+* Purpose   : Mix the bits of a result the XXH64 way.
+*
+* Inputs    : unsigned long long hash - the result
+*
+* Output    : (none)
+*
+* Returns   : the mixed result
+*
+* Example   : return( xxh64_avalanche(combo ^ flip) );
+*
+* Notes     : Used by XXH3 for inputs of up to 3 bytes.
+*
+*********************************************************************/
+
+unsigned long long xxh64_avalanche(unsigned long long hash)
+{
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME64_3;
+	hash ^= hash >> 32;
+
+	return(hash);
+} /* end of xxh64_avalanche */
+
+/*********************************************************************
+*
+* Function  : xxh3_mix16
+*
+* Purpose   : Mix 16 bytes of input with 16 bytes of the secret.
+*
+* Inputs    : const unsigned char *input - the input bytes
+*             const unsigned char *secret - the secret bytes
+*
+* Output    : (none)
+*
+* Returns   : the mixed value
+*
+* Example   : acc += xxh3_mix16(input,xxh3_secret);
+*
+* Notes     : The seed is always 0.
+*
+*********************************************************************/
+
+unsigned long long xxh3_mix16(const unsigned char *input, const unsigned char *secret)
+{
+	return( xxh3_fold(read_le64(input) ^ read_le64(secret),read_le64(&input[8]) ^ read_le64(&secret[8])) );
+} /* end of xxh3_mix16 */
+
+/*********************************************************************
+*
+* Function  : xxh3_short
+*
+* Purpose   : Compute the XXH3 64 bit hash of a short input.
+*
+* Inputs    : const unsigned char *input - the input
+*             size_t length - its length , at most XXH3_MID_MAX
+*
+* Output    : (none)
+*
+* Returns   : the hash
+*
+* Example   : hash = xxh3_short(state->buffer,state->total);
+*
+* Notes     : Inputs of up to 240 bytes each have their own path and
+*             never reach the accumulators.
+*
+*********************************************************************/
+
+unsigned long long xxh3_short(const unsigned char *input, size_t length)
+{
+	unsigned long long	acc , low , high , keyed;
+	unsigned int	combo;
+	size_t	index , rounds;
+
+	if ( length == 0 ) {
+		return( xxh64_avalanche(read_le64(&xxh3_secret[56]) ^ read_le64(&xxh3_secret[64])) );
+	} /* IF */
+	if ( length <= 3 ) {
+		combo = (unsigned int)input[0] << 16 | (unsigned int)input[length >> 1] << 24 |
+					input[length - 1] | (unsigned int)length << 8;
+		return( xxh64_avalanche(combo ^ (unsigned long long)(read_le32(xxh3_secret) ^ read_le32(&xxh3_secret[4]))) );
+	} /* IF */
+	if ( length <= 8 ) {
+		keyed = ((unsigned long long)read_le32(&input[length - 4]) + ((unsigned long long)read_le32(input) << 32)) ^
+					(read_le64(&xxh3_secret[8]) ^ read_le64(&xxh3_secret[16]));
+		keyed ^= ((keyed << 49) | (keyed >> 15)) ^ ((keyed << 24) | (keyed >> 40));
+		keyed *= 0x9FB21C651E98DF25ULL;
+		keyed ^= (keyed >> 35) + length;
+		keyed *= 0x9FB21C651E98DF25ULL;
+		return( keyed ^ (keyed >> 28) );
+	} /* IF */
+	if ( length <= 16 ) {
+		low = read_le64(input) ^ (read_le64(&xxh3_secret[24]) ^ read_le64(&xxh3_secret[32]));
+		high = read_le64(&input[length - 8]) ^ (read_le64(&xxh3_secret[40]) ^ read_le64(&xxh3_secret[48]));
+		acc = length + __builtin_bswap64(low) + high + xxh3_fold(low,high);
+		return( xxh3_avalanche(acc) );
+	} /* IF */
+
+	acc = length * XXH_PRIME64_1;
+	if ( length <= 128 ) {
+		if ( length > 32 ) {
+			if ( length > 64 ) {
+				if ( length > 96 ) {
+					acc += xxh3_mix16(&input[48],&xxh3_secret[96]);
+					acc += xxh3_mix16(&input[length - 64],&xxh3_secret[112]);
+				} /* IF */
+				acc += xxh3_mix16(&input[32],&xxh3_secret[64]);
+				acc += xxh3_mix16(&input[length - 48],&xxh3_secret[80]);
+			} /* IF */
+			acc += xxh3_mix16(&input[16],&xxh3_secret[32]);
+			acc += xxh3_mix16(&input[length - 32],&xxh3_secret[48]);
+		} /* IF */
+		acc += xxh3_mix16(input,xxh3_secret);
+		acc += xxh3_mix16(&input[length - 16],&xxh3_secret[16]);
+		return( xxh3_avalanche(acc) );
+	} /* IF */
+
+	rounds = length / 16;
+	for ( index = 0 ; index < 8 ; ++index ) {
+		acc += xxh3_mix16(&input[16 * index],&xxh3_secret[16 * index]);
+	} /* FOR */
+	acc = xxh3_avalanche(acc);
+	for ( index = 8 ; index < rounds ; ++index ) {
+		acc += xxh3_mix16(&input[16 * index],&xxh3_secret[16 * (index - 8) + 3]);
+	} /* FOR */
+	acc += xxh3_mix16(&input[length - 16],&xxh3_secret[XXH3_SECRET_SIZE_MIN - 17]);
+
+	return( xxh3_avalanche(acc) );
+} /* end of xxh3_short */
+
+/*********************************************************************
+*
+* Function  : xxh3_accumulate
+*
+* Purpose   : Add a stripe of input to the XXH3 accumulators.
+*
+* Inputs    : unsigned long long *acc - the 8 accumulators
+*             const unsigned char *input - the 64 bytes of the stripe
+*             const unsigned char *secret - where the secret for the
+*                                           stripe starts
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : xxh3_accumulate(state->acc,input,&xxh3_secret[8 * state->stripes]);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void xxh3_accumulate(unsigned long long *acc, const unsigned char *input, const unsigned char *secret)
+{
+	unsigned long long	value , key;
+	int		index;
+
+	for ( index = 0 ; index < 8 ; ++index ) {
+		value = read_le64(&input[8 * index]);
+		key = value ^ read_le64(&secret[8 * index]);
+		acc[index ^ 1] += value;
+		acc[index] += (key & 0xffffffffULL) * (key >> 32);
+	} /* FOR */
+
+	return;
+} /* end of xxh3_accumulate */
+
+/*********************************************************************
+*
+* Function  : xxh3_consume
+*
+* Purpose   : Add whole stripes of input to an XXH3 state.
+*
+* Inputs    : XXH3STATE *state - the state
+*             const unsigned char *input - the stripes
+*             size_t num_stripes - number of stripes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : xxh3_consume(state,data,num_stripes);
+*
+* Notes     : The accumulators are scrambled after every block of
+*             XXH3_BLOCK_STRIPES stripes.
+*
+*********************************************************************/
+
+void xxh3_consume(XXH3STATE *state, const unsigned char *input, size_t num_stripes)
+{
+	unsigned long long	*acc;
+	size_t	stripe;
+	int		index;
+
+	acc = state->acc;
+	for ( stripe = 0 ; stripe < num_stripes ; ++stripe , input += XXH3_STRIPE ) {
+		xxh3_accumulate(acc,input,&xxh3_secret[8 * state->stripes]);
+		if ( ++state->stripes == XXH3_BLOCK_STRIPES ) {
+			for ( index = 0 ; index < 8 ; ++index ) {
+				acc[index] ^= acc[index] >> 47;
+				acc[index] ^= read_le64(&xxh3_secret[XXH3_SECRET_SIZE - XXH3_STRIPE + 8 * index]);
+				acc[index] *= XXH_PRIME32_1;
+			} /* FOR */
+			state->stripes = 0;
+		} /* IF end of a block */
+	} /* FOR */
+
+	return;
+} /* end of xxh3_consume */
+
+/*********************************************************************
+*
+* Function  : xxh3_start
+*
+* Purpose   : Start an XXH3 64 bit hash.
+*
+* Inputs    : XXH3STATE *state - the state
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : xxh3_start(&state);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void xxh3_start(XXH3STATE *state)
+{
+	state->acc[0] = XXH_PRIME32_3;
+	state->acc[1] = XXH_PRIME64_1;
+	state->acc[2] = XXH_PRIME64_2;
+	state->acc[3] = XXH_PRIME64_3;
+	state->acc[4] = XXH_PRIME64_4;
+	state->acc[5] = XXH_PRIME32_2;
+	state->acc[6] = XXH_PRIME64_5;
+	state->acc[7] = XXH_PRIME32_1;
+	state->stripes = 0;
+	state->buffered = 0;
+	state->total = 0;
+
+	return;
+} /* end of xxh3_start */
+
+/*********************************************************************
+*
+* Function  : xxh3_update
+*
+* Purpose   : Add bytes to an XXH3 hash.
+*
+* Inputs    : XXH3STATE *state - the state
+*             const unsigned char *data - the bytes
+*             size_t length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : xxh3_update(&state,buffer,count);
+*
+* Notes     : A stripe is only consumed once a byte after it has been
+*             seen , as the last stripe of the input is treated apart.
+*             Stripes are taken straight from data , the state buffer
+*             only holds the bytes left over. The 64 bytes before them
+*             are kept at its end for a last stripe which straddles two
+*             updates.
+*
+*********************************************************************/
+
+void xxh3_update(XXH3STATE *state, const unsigned char *data, size_t length)
+{
+	size_t	count , num_stripes;
+
+	state->total += length;
+	if ( state->buffered + length <= XXH3_BUFFER_SIZE ) {
+		memcpy(&state->buffer[state->buffered],data,length);
+		state->buffered += length;
+		return;
+	} /* IF it all fits */
+
+	if ( state->buffered > 0 ) {
+		count = XXH3_BUFFER_SIZE - state->buffered;
+		memcpy(&state->buffer[state->buffered],data,count);
+		data += count;
+		length -= count;
+		xxh3_consume(state,state->buffer,XXH3_BUFFER_SIZE / XXH3_STRIPE);
+		state->buffered = 0;
+	} /* IF */
+	if ( length > XXH3_BUFFER_SIZE ) {
+		num_stripes = (length - 1) / XXH3_STRIPE;
+		xxh3_consume(state,data,num_stripes);
+		data += num_stripes * XXH3_STRIPE;
+		length -= num_stripes * XXH3_STRIPE;
+		memcpy(&state->buffer[XXH3_BUFFER_SIZE - XXH3_STRIPE],data - XXH3_STRIPE,XXH3_STRIPE);
+	} /* IF */
+	memcpy(state->buffer,data,length);
+	state->buffered = length;
+
+	return;
+} /* end of xxh3_update */
+
+/*********************************************************************
+*
+* Function  : xxh3_digest
+*
+* Purpose   : Finish an XXH3 64 bit hash.
+*
+* Inputs    : XXH3STATE *state - the state
+*             unsigned char *digest - to receive the 8 bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : xxh3_digest(&state,digest);
+*
+* Notes     : The digest is stored big endian , as xxhsum shows it.
+*
+*********************************************************************/
+
+void xxh3_digest(XXH3STATE *state, unsigned char *digest)
+{
+	unsigned char	last[XXH3_STRIPE];
+	unsigned long long	hash , *acc;
+	size_t	left;
+	int		index;
+
+	if ( state->total <= XXH3_MID_MAX ) {
+		hash = xxh3_short(state->buffer,state->total);
+	} /* IF */
+	else {
+		acc = state->acc;
+		if ( state->buffered >= XXH3_STRIPE ) {
+			xxh3_consume(state,state->buffer,(state->buffered - 1) / XXH3_STRIPE);
+			memcpy(last,&state->buffer[state->buffered - XXH3_STRIPE],XXH3_STRIPE);
+		} /* IF */
+		else {
+			left = XXH3_STRIPE - state->buffered;
+			memcpy(last,&state->buffer[XXH3_BUFFER_SIZE - left],left);
+			memcpy(&last[left],state->buffer,state->buffered);
+		} /* ELSE */
+		xxh3_accumulate(acc,last,&xxh3_secret[XXH3_SECRET_SIZE - XXH3_STRIPE - 7]);
+		hash = state->total * XXH_PRIME64_1;
+		for ( index = 0 ; index < 4 ; ++index ) {
+			hash += xxh3_fold(acc[2 * index] ^ read_le64(&xxh3_secret[11 + 16 * index]),
+							acc[2 * index + 1] ^ read_le64(&xxh3_secret[11 + 16 * index + 8]));
+		} /* FOR */
+		hash = xxh3_avalanche(hash);
+	} /* ELSE */
+	for ( index = 0 ; index < 8 ; ++index ) {
+		digest[index] = hash >> (56 - 8 * index);
+	} /* FOR */
+
+	return;
+} /* end of xxh3_digest */
+
+/*********************************************************************
+*
+* Function  : sha256_block
+*
+* Purpose   : Add a 64 byte block to a SHA-256 hash.
+*
+* Inputs    : SHA256STATE *state - the state
+*             const unsigned char *block - the block
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sha256_block(state,data);
+*
+* Notes     : FIPS 180-4.
+*
+*********************************************************************/
+
+void sha256_block(SHA256STATE *state, const unsigned char *block)
+{
+	unsigned int	w[64] , a , b , c , d , e , f , g , h , t1 , t2;
+	int		index;
+
+	for ( index = 0 ; index < 16 ; ++index ) {
+		w[index] = (unsigned int)block[4 * index] << 24 | (unsigned int)block[4 * index + 1] << 16 |
+					(unsigned int)block[4 * index + 2] << 8 | block[4 * index + 3];
+	} /* FOR */
+	for ( index = 16 ; index < 64 ; ++index ) {
+		w[index] = (ROTR32(w[index - 2],17) ^ ROTR32(w[index - 2],19) ^ (w[index - 2] >> 10)) + w[index - 7] +
+					(ROTR32(w[index - 15],7) ^ ROTR32(w[index - 15],18) ^ (w[index - 15] >> 3)) + w[index - 16];
+	} /* FOR */
+
+	a = state->h[0];
+	b = state->h[1];
+	c = state->h[2];
+	d = state->h[3];
+	e = state->h[4];
+	f = state->h[5];
+	g = state->h[6];
+	h = state->h[7];
+	for ( index = 0 ; index < 64 ; ++index ) {
+		t1 = h + (ROTR32(e,6) ^ ROTR32(e,11) ^ ROTR32(e,25)) + ((e & f) ^ (~e & g)) + sha256_k[index] + w[index];
+		t2 = (ROTR32(a,2) ^ ROTR32(a,13) ^ ROTR32(a,22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	} /* FOR */
+	state->h[0] += a;
+	state->h[1] += b;
+	state->h[2] += c;
+	state->h[3] += d;
+	state->h[4] += e;
+	state->h[5] += f;
+	state->h[6] += g;
+	state->h[7] += h;
+
+	return;
+} /* end of sha256_block */
+
+/*********************************************************************
+*
+* Function  : sha256_start
+*
+* Purpose   : Start a SHA-256 hash.
+*
+* Inputs    : SHA256STATE *state - the state
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sha256_start(&state);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void sha256_start(SHA256STATE *state)
+{
+	static unsigned int	initial[8] = {
+		0x6a09e667 , 0xbb67ae85 , 0x3c6ef372 , 0xa54ff53a ,
+		0x510e527f , 0x9b05688c , 0x1f83d9ab , 0x5be0cd19 } ;
+
+	memcpy(state->h,initial,sizeof(initial));
+	state->buffered = 0;
+	state->total = 0;
+
+	return;
+} /* end of sha256_start */
+
+/*********************************************************************
+*
+* Function  : sha256_update
+*
+* Purpose   : Add bytes to a SHA-256 hash.
+*
+* Inputs    : SHA256STATE *state - the state
+*             const unsigned char *data - the bytes
+*             size_t length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sha256_update(&state,buffer,count);
+*
+* Notes     : Whole blocks are hashed straight from data.
+*
+*********************************************************************/
+
+void sha256_update(SHA256STATE *state, const unsigned char *data, size_t length)
+{
+	size_t	count;
+
+	state->total += length;
+	if ( state->buffered > 0 ) {
+		count = (length < 64 - state->buffered) ? length : 64 - state->buffered;
+		memcpy(&state->buffer[state->buffered],data,count);
+		state->buffered += count;
+		data += count;
+		length -= count;
+		if ( state->buffered < 64 ) {
+			return;
+		} /* IF */
+		sha256_block(state,state->buffer);
+		state->buffered = 0;
+	} /* IF */
+	for ( ; length >= 64 ; data += 64 , length -= 64 ) {
+		sha256_block(state,data);
+	} /* FOR */
+	memcpy(state->buffer,data,length);
+	state->buffered = length;
+
+	return;
+} /* end of sha256_update */
+
+/*********************************************************************
+*
+* Function  : sha256_digest
+*
+* Purpose   : Finish a SHA-256 hash.
+*
+* Inputs    : SHA256STATE *state - the state
+*             unsigned char *digest - to receive the 32 bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sha256_digest(&state,digest);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void sha256_digest(SHA256STATE *state, unsigned char *digest)
+{
+	unsigned char	padding[72];
+	unsigned long long	bits;
+	size_t	length;
+	int		index;
+
+	bits = state->total * 8;
+	length = (state->buffered < 56) ? 56 - state->buffered : 120 - state->buffered;
+	memset(padding,0,sizeof(padding));
+	padding[0] = 0x80;
+	for ( index = 0 ; index < 8 ; ++index ) {
+		padding[length + index] = bits >> (56 - 8 * index);
+	} /* FOR */
+	sha256_update(state,padding,length + 8);
+	for ( index = 0 ; index < 32 ; ++index ) {
+		digest[index] = state->h[index / 4] >> (24 - 8 * (index % 4));
+	} /* FOR */
+
+	return;
+} /* end of sha256_digest */
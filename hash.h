@@ -0,0 +1,38 @@
+/*********************************************************************
+*
+* File      : hash.h
+*
+* Purpose   : The XXH3 64 bit and SHA-256 digests of hash.c .
+*
+*********************************************************************/
+
+#ifndef	HASH_H
+#define	HASH_H
+
+#include	<stddef.h>
+
+#define	XXH3_BUFFER_SIZE	256
+
+typedef	struct xxh3state_tag {
+	unsigned long long	acc[8];
+	unsigned char	buffer[XXH3_BUFFER_SIZE];
+	size_t	buffered;
+	int		stripes;				/* consumed in the current block */
+	unsigned long long	total;
+} XXH3STATE;
+
+typedef	struct sha256state_tag {
+	unsigned int	h[8];
+	unsigned char	buffer[64];
+	size_t	buffered;
+	unsigned long long	total;
+} SHA256STATE;
+
+void	xxh3_start(XXH3STATE *state);
+void	xxh3_update(XXH3STATE *state, const unsigned char *data, size_t length);
+void	xxh3_digest(XXH3STATE *state, unsigned char *digest);
+void	sha256_start(SHA256STATE *state);
+void	sha256_update(SHA256STATE *state, const unsigned char *data, size_t length);
+void	sha256_digest(SHA256STATE *state, unsigned char *digest);
+
+#endif
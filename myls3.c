@@ -8,10 +8,17 @@
 *
 * Purpose   : List files in a directcory (similar to ls).
 *
+* Build     : cc -o myls3 myls3.c die.c quit.c system_error.c hash.c -lpthread
+*
 *********************************************************************/
 
+#ifndef	_GNU_SOURCE
+#define	_GNU_SOURCE
+#endif
+
 #include	<stdio.h>
 #include	<stdlib.h>
+#include	<stddef.h>
 #include	<sys/types.h>
 #include	<sys/stat.h>
 #include	<dirent.h>
@@ -20,6 +27,32 @@
 #include	<string.h>
 #include	<stdarg.h>
 #include	<getopt.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<sys/resource.h>
+#include	<pthread.h>
+#include	<stdatomic.h>
+#include	<fnmatch.h>
+#include	<regex.h>
+#include	<limits.h>
+#include	<locale.h>
+#include	<pwd.h>
+#include	<grp.h>
+#include	<sys/mman.h>
+#include	"hash.h"
+#ifdef	__linux__
+#include	<sys/syscall.h>
+#include	<sys/inotify.h>
+#include	<sys/fanotify.h>
+#include	<sys/vfs.h>
+#include	<poll.h>
+#if	defined(__NR_io_uring_setup) && defined(STATX_TYPE)
+#define	USE_IO_URING
+#include	<sys/sysmacros.h>
+#include	<linux/io_uring.h>
+#endif
+#endif
 
 #define	EQ(s1,s2)	(strcmp(s1,s2)==0)
 #define	NE(s1,s2)	(strcmp(s1,s2)!=0)
@@ -27,18 +60,629 @@
 #define	LT(s1,s2)	(strcmp(s1,s2)<0)
 #define	LE(s1,s2)	(strcmp(s1,s2)<=0)
 
-typedef	struct filedata_tag {
-	struct filedata_tag	*next;
-	char	*filename;
-	struct _stat	filestats;
-} FILEDATA;
+#define	ARENA_CHUNK_SIZE	(1024 * 1024)
+#define	ARENA_ALIGN			16
+
+typedef	struct arenachunk_tag {
+	struct arenachunk_tag	*next_chunk;
+	size_t	pad;				/* keeps data aligned */
+	char	data[];
+} ARENACHUNK;
+
+typedef	struct arena_tag {
+	struct arena_tag	*next_arena;
+	ARENACHUNK	*chunks;
+	char	*next_byte;
+	size_t	bytes_left;
+	size_t	bytes_used;
+	long	num_chunks;
+} ARENA;
+
+typedef	struct arenamark_tag {
+	ARENACHUNK	*chunk;
+	char	*next_byte;
+	size_t	bytes_left;
+	size_t	bytes_used;
+	long	num_chunks;
+} ARENAMARK;
+
+#define	NAME_LENGTH(name)	(((unsigned int *)(name))[-1])
+
+typedef	struct dutotals_tag {
+	long long	bytes;
+	long long	blocks;			/* 512 byte blocks allocated */
+	long long	files;			/* not counting directories */
+} DUTOTALS;
+
+typedef	struct dirinfo_tag {
+	char	*path;			/* "" when names are shown as is */
+	int		path_length;
+	int		depth;			/* 0 for a top level directory */
+	struct dirinfo_tag	*parent;
+	DUTOTALS	*totals;		/* for '--du' , else NULL */
+	unsigned long long	device;	/* set once opened for 'R' */
+	unsigned long long	inode;
+	int		skipped;		/* not walked , seen before or for 'x' */
+} DIRINFO;
+
+#define	INODE_SET_SIZE	1024
+#define	INODE_HASH(device,inode)	(((inode) ^ ((device) << 32 | (device) >> 32)) * 0x9E3779B97F4A7C15ULL >> 16)
+
+typedef	struct inodeset_tag {
+	unsigned long long	*keys;		/* device and inode pairs */
+	long	capacity;				/* number of pairs , a power of 2 */
+	long	count;
+	pthread_mutex_t	lock;
+} INODESET;
+
+typedef	struct entryinfo_tag {
+	long long	size;
+	long long	mtime;				/* nanoseconds since the epoch */
+	unsigned long long	inode;
+	unsigned long long	device;
+	unsigned int	nlink;
+	unsigned int	uid;				/* only kept for 'o' and 'g' */
+	unsigned int	gid;
+	unsigned short	mode;
+} ENTRYINFO;
 
 typedef	struct list_tag {
-	int			count;
-	FILEDATA	*first;
-	FILEDATA	*last;
+	int		count;
+	int		capacity;
+	long long	*sizes;
+	long long	*mtimes;			/* nanoseconds since the epoch */
+	unsigned long long	*inodes;
+	unsigned int	*nlinks;
+	unsigned int	*uids;				/* only for 'o' and 'g' */
+	unsigned int	*gids;
+	unsigned int	*name_offsets;		/* into names */
+	unsigned int	*dir_indexes;		/* into dirs */
+	unsigned short	*modes;
+	unsigned short	*device_indexes;	/* into devices */
+	char	*names;						/* packed length-prefixed names */
+	size_t	names_used;
+	size_t	names_size;
+	DIRINFO	**dirs;
+	int		num_dirs;
+	int		dirs_size;
+	unsigned long long	*devices;
+	int		num_devices;
+	int		devices_size;
+	int		last_device;
+	int		*order;						/* display order */
 } LIST;
 
+#define	FILE_NAME(list,index)	(&(list)->names[(list)->name_offsets[index]])
+#define	FILE_DIR(list,index)	((list)->dirs[(list)->dir_indexes[index]])
+#define	FILE_PATH(list,index)	join_path(FILE_DIR(list,index),FILE_NAME(list,index),\
+									NAME_LENGTH(FILE_NAME(list,index)))
+#define	FILE_PATH_LENGTH(list,index)	(FILE_DIR(list,index)->path_length + \
+									(FILE_DIR(list,index)->path_length > 0) + \
+									NAME_LENGTH(FILE_NAME(list,index)))
+
+typedef	struct sortkey_tag {
+	unsigned long long	key;
+	int		index;
+} SORTKEY;
+
+#define	NAME_KEY_BYTES	16
+
+typedef	struct namekey_tag {
+	unsigned long long	high;		/* first 8 bytes of the key , big endian */
+	unsigned long long	low;		/* next 8 bytes */
+	int		index;
+} NAMEKEY;
+
+/* bytes per entry in the columns of a list , the display order and the sort keys */
+#define	LIST_ENTRY_BYTES	(3 * 8 + 3 * 4 + 2 * 2 + 4 + 2 * sizeof(NAMEKEY) + 2 * 4 * LIST_OWNERS)
+#define	LIST_OWNERS			(opt_o || opt_g)	/* the uid and gid columns are kept */
+#define	LIST_MEMORY(list)	((long long)(list)->count * LIST_ENTRY_BYTES + (long long)(list)->names_used)
+
+#define	RUN_BUFFER_SIZE		(64 * 1024)
+#define	ZIGZAG(value)		(((unsigned long long)(value) << 1) ^ (unsigned long long)((long long)(value) >> 63))
+#define	UNZIGZAG(value)		((long long)((value) >> 1) ^ -(long long)((value) & 1))
+
+typedef	struct runs_tag {
+	FILE	*file;				/* all the runs , one after the other */
+	long long	*ends;			/* offset of the end of each run */
+	int		count;
+	int		size;
+	char	*last_path;			/* path of the last record written */
+	size_t	last_length;
+	size_t	last_size;
+} RUNS;
+
+typedef	struct runreader_tag {
+	int		fd;					/* of the file holding the run */
+	char	*name;				/* of the file , for messages */
+	long long	next;			/* offset of the next block to read */
+	long long	end;			/* offset of the end of the run */
+	unsigned char	*buffer;
+	int		used;
+	int		filled;
+	int		done;
+	char	*path;				/* the current record */
+	size_t	path_length;
+	size_t	path_size;
+	ENTRYINFO	info;
+} RUNREADER;
+
+/* a manifest is a header , the records in blocks , the block index and a trailer */
+#define	MANIFEST_MAGIC		"MYLSMANI"
+#define	MANIFEST_VERSION	2
+#define	MANIFEST_BY_NAME	0
+#define	MANIFEST_BY_SIZE	1
+#define	MANIFEST_BY_TIME	2
+#define	MANIFEST_AS_FOUND	3
+#define	MANIFEST_REVERSE	4
+#define	MANIFEST_LOCALE		8
+#define	MANIFEST_MIN_BLOCK	16			/* entries before a block may end */
+#define	MANIFEST_MAX_BLOCK	4096
+#define	MANIFEST_CUT_MASK	255			/* 1 path in 256 ends a block */
+#define	MANIFEST_HASH_START	0xcbf29ce484222325ULL
+
+typedef	struct manifestheader_tag {
+	char	magic[8];
+	unsigned int	version;
+	unsigned int	order;			/* MANIFEST_BY_* and the flags */
+} MANIFESTHEADER;
+
+typedef	struct manifesttrailer_tag {
+	long long	index_offset;		/* also the end of the records */
+	long long	num_blocks;
+	long long	num_entries;
+	char	magic[8];
+} MANIFESTTRAILER;
+
+typedef	struct manifest_tag {
+	char	*path;
+	RUNS	records;				/* the manifest file itself */
+	FILE	*index;					/* block index , until it is copied */
+	long long	block_start;		/* offset of the current block */
+	long	block_count;
+	unsigned long long	block_hash;
+	long long	num_blocks;
+	long long	num_entries;
+} MANIFEST;
+
+typedef	struct manifestblock_tag {	/* an entry of the block index , after the first path */
+	long long	offset;
+	long long	length;
+	long long	count;
+	unsigned long long	hash;
+} MANIFESTBLOCK;
+
+typedef	struct manifestreader_tag {
+	unsigned int	order;
+	RUNREADER	records;			/* holds the current entry */
+	RUNREADER	index;				/* holds the first path of the block */
+	MANIFESTBLOCK	block;
+	long long	blocks_left;
+	long long	num_blocks;
+	long long	left;				/* entries of the block not read yet */
+	int		has_entry;				/* the current entry is still to be merged */
+	int		done;
+} MANIFESTREADER;
+
+#define	MTIME_SECONDS(mtime)	((mtime) / 1000000000LL - ((mtime) % 1000000000LL < 0))
+
+/* the snapshot cache is a header , a record per directory and an index of the records */
+#define	CACHE_MAGIC		"MYLSSNAP"
+#define	CACHE_VERSION	2
+#define	CACHE_ENTRY_LENGTH(name_length)	((sizeof(CACHEENTRY) + (name_length) + 8) & ~(size_t)7)
+#define	CACHE_HASH(key)	INODE_HASH((key)->device,(key)->inode)
+
+typedef	struct cachekey_tag {
+	unsigned long long	device;		/* of the directory */
+	unsigned long long	inode;
+	long long	mtime;				/* nanoseconds */
+	long long	ctime;
+} CACHEKEY;
+
+typedef	struct cacheheader_tag {
+	char	magic[8];
+	unsigned int	version;
+	unsigned int	entry_size;		/* sizeof(CACHEENTRY) of the writer */
+	unsigned long long	num_dirs;
+	unsigned long long	index_offset;	/* also the end of the records */
+	unsigned long long	index_slots;	/* a power of 2 */
+} CACHEHEADER;
+
+typedef	struct cachedir_tag {
+	CACHEKEY	key;
+	unsigned int	num_entries;
+	unsigned long long	length;		/* bytes in the record , entries included */
+	unsigned char	checksum[8];	/* XXH3 of the record , but for this field */
+} CACHEDIR;
+
+typedef	struct cacheentry_tag {		/* followed by the name and its NUL , padded to 8 bytes */
+	unsigned int	name_length;
+	unsigned char	type;			/* d_type */
+} CACHEENTRY;
+
+typedef	struct cache_tag {
+	char	*path;
+	unsigned char	*map;			/* the old cache , NULL if none */
+	size_t	map_size;
+	CACHEHEADER	*header;
+	unsigned long long	*index;
+	FILE	*new_file;
+	char	*new_path;
+	unsigned long long	new_size;
+	unsigned long long	*new_offsets;	/* of the records in the new cache */
+	unsigned long long	*new_hashes;
+	long	num_new;
+	long	new_capacity;
+	pthread_mutex_t	lock;
+	atomic_long	num_hits;
+	atomic_long	num_misses;
+	atomic_long	num_entries_reused;
+} CACHE;
+
+typedef	struct cacherecord_tag {
+	unsigned char	*data;			/* CACHEDIR and its entries */
+	size_t	used;
+	size_t	size;
+	int		active;
+} CACHERECORD;
+
+/* '--watch' keeps the listing live from inotify or fanotify events */
+#define	WATCH_DELAY		100			/* default coalescing window in milliseconds */
+
+#ifdef	__linux__
+#define	WATCH_EVENT_BUFFER	(64 * 1024)
+#define	WATCH_KEY_SIZE	(1 + 8 + 4 + 128)	/* kind , fsid , handle type , handle */
+#define	WATCH_MAX_PATHS	16			/* paths of one directory looked at for an event */
+#define	WATCH_INOTIFY_EVENTS	(IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | \
+							IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define	WATCH_FANOTIFY_EVENTS	(FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_ATTRIB | FAN_MOVED_FROM | \
+							FAN_MOVED_TO | FAN_DELETE_SELF | FAN_MOVE_SELF | FAN_ONDIR)
+
+#define	WATCH_ENTRY		0			/* an entry of the directory changed */
+#define	WATCH_REFRESH	1			/* an entry showing the directory may have changed */
+#define	WATCH_SELF		2			/* the directory itself changed */
+
+#define	SAME_ENTRY_INFO(info1,info2)	((info1)->size == (info2)->size && (info1)->mtime == (info2)->mtime && \
+				(info1)->inode == (info2)->inode && (info1)->device == (info2)->device && \
+				(info1)->nlink == (info2)->nlink && (info1)->mode == (info2)->mode && \
+				(info1)->uid == (info2)->uid && (info1)->gid == (info2)->gid)
+
+typedef	struct watchdir_tag {
+	char	*path;
+	int		path_length;
+	int		depth;					/* of the DIRINFO */
+	int		parent;					/* index of the watched parent , -1 if none */
+	int		wd;						/* inotify watch , -1 if fanotify covers it */
+	unsigned long long	device;
+	unsigned long long	inode;
+	int		first_child;			/* watched subdirectories , -1 if none */
+	int		next_sibling;
+	int		removed;
+	long	refreshed;				/* last batch which refreshed its own entries */
+} WATCHDIR;
+
+typedef	struct watchkey_tag {			/* a slot of the lookup table */
+	unsigned long long	hash;
+	int		index;					/* into dirs , -1 for a free slot */
+	int		length;
+	unsigned char	*key;			/* 'i' and a wd , 'f' and a file handle or 'p' and a path */
+} WATCHKEY;
+
+typedef	struct watchitem_tag {		/* an entry of the live listing */
+	char	*path;
+	ENTRYINFO	info;
+	int		removed;
+} WATCHITEM;
+
+typedef	struct watchchange_tag {
+	char	*path;
+	long	seq;					/* later changes of a path win */
+	int		dir;					/* watched directory holding it , -1 once resolved */
+	int		kind;					/* WATCH_ENTRY , WATCH_REFRESH or WATCH_SELF */
+	int		present;				/* listed after the change */
+	ENTRYINFO	info;
+} WATCHCHANGE;
+
+typedef	struct watch_tag {
+	int		inotify_fd;
+	int		fanotify_fd;			/* -1 when not permitted */
+	unsigned long long	*fsids;		/* file systems tried with fanotify */
+	char	*fsid_marked;
+	int		num_fsids;
+	WATCHDIR	*dirs;
+	int		num_dirs;
+	int		dirs_size;
+	WATCHKEY	*table;
+	int		table_size;				/* a power of 2 */
+	int		table_used;
+	WATCHITEM	*items;				/* in path order */
+	long	num_items;
+	WATCHCHANGE	*changes;
+	long	num_changes;
+	long	changes_size;
+	char	**gone;					/* paths whose subtrees were removed */
+	int		num_gone;
+	int		gone_size;
+	long	batch;
+	pthread_mutex_t	lock;
+	long	num_events;
+	long	num_rows;
+} WATCH;
+#endif
+
+typedef	struct topheap_tag {
+	int		*heap;				/* list indexes , worst entry on top */
+	int		count;
+	long long	*seqs;				/* per list index , when it was found */
+	long long	num_seen;
+	size_t	garbage;			/* bytes of replaced names in the list */
+	long	num_compactions;
+} TOPHEAP;
+
+#define	OUTPUT_BUFFER_SIZE	(1024 * 1024)
+#define	LINE_OVERHEAD		128		/* longest line without the path */
+
+typedef	struct outbuf_tag {
+	char	*data;
+	size_t	used;
+	size_t	size;
+} OUTBUF;
+
+/* the records of '--format' */
+#define	FORMAT_LONG		0
+#define	FORMAT_NUL		1
+#define	FORMAT_JSONL	2
+#define	FORMAT_BIN		3
+#define	BIN_MAGIC		"MYLSRECS"
+#define	BIN_VERSION		1
+#define	BIN_RECORD_LENGTH(path_length)	((sizeof(BINRECORD) + (path_length) + 8) & ~(size_t)7)
+
+typedef	struct binheader_tag {
+	char	magic[8];
+	unsigned int	version;
+	unsigned int	record_size;	/* sizeof(BINRECORD) of the writer */
+} BINHEADER;
+
+typedef	struct binrecord_tag {		/* followed by the path and its NUL , padded to 8 bytes */
+	long long	size;
+	long long	mtime;				/* nanoseconds since the epoch */
+	unsigned long long	inode;
+	unsigned long long	device;
+	unsigned int	nlink;
+	unsigned int	mode;
+	unsigned int	path_length;
+	unsigned int	length;			/* of the record , path and padding included */
+} BINRECORD;
+
+/* the digests of '--hash' , one per version of a file , kept in '--hash-cache' */
+#define	HASH_XXH3		1
+#define	HASH_SHA256		2
+#define	HASH_MAX_SIZE	32			/* bytes in the largest digest */
+#define	HASH_BUFFER_SIZE	(1024 * 1024)
+#define	HASH_MAX_THREADS	16
+#define	HASH_WINDOW		(256 * 1024 * 1024)	/* of a file , whose cached pages are noted ahead of the reads */
+#define	HASH_FOLIO_SLACK	(2 * 1024 * 1024)	/* the largest folio of the page cache , as a rule */
+#define	HASH_MAGIC		"MYLSHASH"
+#define	HASH_VERSION	2
+#define	HASH_MAX_SLOTS	(1ULL << 36)	/* of the digest table */
+#define	HASH_EMPTY		0			/* states of a slot of the digest table */
+#define	HASH_CACHED		1			/* from the cache , not listed (yet) */
+#define	HASH_PENDING	2
+#define	HASH_DONE		3
+#define	HASH_CHANGED	4			/* the file changed while it was read */
+#define	HASH_FAILED		5
+
+typedef	struct hashrecord_tag {		/* also a record of the cache file */
+	unsigned long long	device;
+	unsigned long long	inode;
+	long long	size;
+	long long	mtime;				/* nanoseconds */
+	unsigned char	digest[HASH_MAX_SIZE];
+} HASHRECORD;
+
+typedef	struct coldrun_tag {		/* pages read in by '--hash' , to drop */
+	off_t	start;
+	off_t	end;
+} COLDRUN;
+
+typedef	struct hashentry_tag {
+	HASHRECORD	record;
+	int		state;					/* HASH_EMPTY ... */
+	int		index;					/* in the list , of the file to read */
+} HASHENTRY;
+
+typedef	struct hashheader_tag {
+	char	magic[8];
+	unsigned int	version;
+	unsigned int	algorithm;		/* HASH_XXH3 or HASH_SHA256 */
+	unsigned long long	num_records;
+	unsigned char	checksum[8];	/* XXH3 of the records */
+} HASHHEADER;
+
+typedef	struct hashtable_tag {
+	HASHENTRY	*entries;
+	unsigned long long	mask;		/* number of slots - 1 */
+	int		digest_size;
+	LIST	*list;					/* of the files being hashed */
+	unsigned long long	*jobs;		/* slots of the files to read */
+	long	num_jobs;
+	atomic_long	next_job;
+	atomic_long	bytes_read;
+} HASHTABLE;
+
+/* the names of the 'o' and 'g' columns , looked up once per id */
+#define	ID_CACHE_BITS	8			/* of the first table , it doubles when 3/4 full */
+#define	ID_HASH(id,bits)	(((id) * 0x9E3779B1U) >> (32 - (bits)))
+#define	ID_NAME_WIDTH	8
+
+typedef	struct idslot_tag {
+	unsigned int	id;
+	_Atomic(char *)	name;			/* NULL for an empty slot */
+} IDSLOT;
+
+typedef	struct idtable_tag {
+	struct idtable_tag	*older;		/* replaced , still read by late threads */
+	int		bits;
+	IDSLOT	slots[];				/* 1 << bits of them */
+} IDTABLE;
+
+typedef	struct idcache_tag {
+	_Atomic(IDTABLE *)	table;		/* NULL until the first lookup */
+	int		count;
+	int		is_group;
+	pthread_mutex_t	lock;			/* for adding a slot */
+	atomic_long	num_lookups;
+	atomic_long	num_hits;
+} IDCACHE;
+
+#define	PIPE_BATCHES	8		/* batches of entries in the pipeline */
+#define	PIPE_OUTPUTS	4		/* output buffers in the pipeline */
+#define	QUEUE_SPINS		100		/* checks before a queue waits on its lock */
+
+typedef	struct queue_tag {
+	void	**slots;
+	unsigned long	mask;		/* number of slots - 1 */
+	atomic_ulong	head;		/* count of items taken */
+	atomic_ulong	tail;		/* count of items added */
+	atomic_int	sleepers;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	long	num_waits;			/* times a side had to sleep */
+} QUEUE;
+
+#define	STREAM_BATCH_SIZE	4096	/* entries held before they are shown for 'U' */
+#define	STREAM_FLUSH_MSECS	20
+
+#define	SECONDS_PER_DAY		86400
+#define	DATE_CACHE_SLOTS	64
+#define	DATE_CACHE_SLOT(seconds)	((unsigned long long)((seconds) / SECONDS_PER_DAY \
+									- ((seconds) % SECONDS_PER_DAY < 0)) % DATE_CACHE_SLOTS)
+
+typedef	struct datecache_tag {
+	time_t	start;		/* local midnight of the day */
+	int		length;		/* length of prefix , 0 if the slot is empty */
+	char	prefix[32];	/* "Mon DD, YYYY" */
+} DATECACHE;
+
+#define	SORT_BY_SIZE	1
+#define	SORT_BY_TIME	2
+
+#define	DIR_BUFFER_SIZE	(256 * 1024)
+
+#ifdef	__linux__
+typedef	struct dirent64_tag {
+	unsigned long long	d_ino;
+	long long	d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char	d_name[];
+} DIRENT64;
+#endif
+
+typedef	struct dirreader_tag {
+	int		fd;
+#ifdef	__linux__
+	long	position;
+	long	length;
+#else
+	_DIR	*dirptr;
+#endif
+	int		num_reads;		/* number of getdents64 calls */
+	int		num_entries;
+} DIRREADER;
+
+#define	STAT_BATCH_SIZE		2048
+#define	STAT_POOL_THREADS	8
+#define	URING_ENTRIES		256
+
+#define	STAT_ENGINE_NONE	0
+#define	STAT_ENGINE_URING	1
+#define	STAT_ENGINE_POOL	2
+
+#define	STAT_NEEDED			1		/* need_stat of an entry to be stat'ed */
+#define	STAT_DONE			2		/* need_stat of an entry already stat'ed */
+
+typedef	struct batchentry_tag {
+	int		name_offset;
+	unsigned char	type;
+	char	need_stat;
+	char	verdict;		/* FILTER_xxx before the stat */
+	int		status;			/* 0 or errno value */
+	struct _stat	filestats;
+#ifdef	USE_IO_URING
+	struct statx	statxbuf;
+#endif
+} BATCHENTRY;
+
+#ifdef	USE_IO_URING
+typedef	struct uring_tag {
+	int		fd;
+	unsigned	*sq_head;
+	unsigned	*sq_tail;
+	unsigned	*sq_array;
+	unsigned	sq_mask;
+	unsigned	sq_entries;
+	unsigned	*cq_head;
+	unsigned	*cq_tail;
+	unsigned	cq_mask;
+	unsigned	max_in_flight;		/* so the completion queue can not overflow */
+	struct io_uring_sqe	*sqes;
+	struct io_uring_cqe	*cqes;
+} URING;
+#endif
+
+typedef	struct statpool_tag {
+	pthread_mutex_t	lock;
+	pthread_cond_t	work_cond;
+	pthread_cond_t	done_cond;
+	pthread_t	threads[STAT_POOL_THREADS];
+	unsigned	generation;
+	int		active;				/* threads working on the batch */
+	struct statbatch_tag	*batch;
+	int		count;				/* entries in the batch */
+	int		dir_fd;
+	atomic_int	next;			/* next entry to be stat'ed */
+} STATPOOL;
+
+typedef	struct statengine_tag {
+	int		type;				/* STAT_ENGINE_xxx */
+#ifdef	USE_IO_URING
+	URING	ring;
+#endif
+	STATPOOL	*pool;
+	long	num_stats;
+	long	num_calls;			/* io_uring_enter calls */
+} STATENGINE;
+
+typedef	struct statbatch_tag {
+	int		count;
+	BATCHENTRY	entries[STAT_BATCH_SIZE];
+	char	*names;
+	int		names_used;
+	int		names_size;
+	STATENGINE	*engine;			/* issues the stats */
+} STATBATCH;
+
+typedef	struct pipebatch_tag {
+	STATBATCH	*stats;
+	DIRINFO	*dir;
+	int		dir_fd;				/* own descriptor , -1 for none */
+	int		last;				/* last batch of the directory */
+} PIPEBATCH;
+
+typedef	struct pipeline_tag {
+	QUEUE	free_batches;		/* list stage -> traversal */
+	QUEUE	stat_queue;			/* traversal -> stat stage */
+	QUEUE	list_queue;			/* stat stage -> list stage */
+	QUEUE	free_outputs;		/* writer -> formatting */
+	QUEUE	full_outputs;		/* formatting -> writer */
+	PIPEBATCH	batches[PIPE_BATCHES];
+	OUTBUF	outputs[PIPE_OUTPUTS];
+	pthread_t	stat_thread , list_thread , writer_thread;
+	atomic_int	running;			/* stages are running */
+	int		writing;			/* the writer is running */
+} PIPELINE;
+
 typedef struct name_tag {
 	char	*name;
 	struct name_tag	*next_name;
@@ -49,6 +693,71 @@ typedef struct nameslist_tag {
 	int		num_names;
 } NAMESLIST;
 
+typedef	struct dirframe_tag {
+	DIRREADER	reader;
+	DIRINFO	*dir;
+	NAME	*next_subdir;		/* next one to be walked */
+	ARENAMARK	node_mark;			/* arenas before the directory */
+	ARENAMARK	string_mark;
+} DIRFRAME;
+
+typedef	struct dirjob_tag {
+	struct dirjob_tag	*parent;
+	DIRINFO	*dir;
+	char	*name;				/* name within the parent directory */
+	DIRREADER	reader;			/* kept open until the children are opened */
+	atomic_int	pending;		/* children which still need the reader */
+	LIST	*list;				/* worker list which holds the entries */
+	int		first;
+	int		count;
+	int		num_children;
+	struct dirjob_tag	**children;
+} DIRJOB;
+
+typedef	struct deque_tag {
+	pthread_mutex_t	lock;
+	DIRJOB	**jobs;
+	int		top;
+	int		bottom;
+	int		capacity;
+} DEQUE;
+
+typedef	struct worker_tag {
+	int		id;
+	pthread_t	thread;
+	DEQUE	deque;
+	LIST	files;
+	long	num_jobs;
+	long	num_steals;
+} WORKER;
+
+#define	FILTER_AND		0
+#define	FILTER_OR		1
+#define	FILTER_NOT		2
+#define	FILTER_NAME		3
+#define	FILTER_REGEX	4
+#define	FILTER_TYPE		5
+#define	FILTER_SIZE		6
+#define	FILTER_MTIME	7
+
+#define	FILTER_FALSE	0
+#define	FILTER_TRUE		1
+#define	FILTER_UNKNOWN	2		/* can not tell without a stat */
+
+#define	FILTER_TYPES	"fdlpscb"	/* letters for '--type' */
+
+typedef	struct filter_tag {
+	int		op;
+	int		needs_stat;		/* 1 if the result depends on stat data */
+	struct filter_tag	*left;
+	struct filter_tag	*right;
+	char	*pattern;
+	regex_t	regex;
+	int		types;			/* bit mask of FILTER_TYPES */
+	long long	low;		/* size or mtime in nanoseconds */
+	long long	high;
+} FILTER;
+
 static	char	ftypes[] = {
  '.' , 'p' , 'c' , '?' , 'd' , '?' , 'b' , '?' , '-' , '?' , 'l' , '?' , 's' , '?' , '?' , '?'
 };
@@ -57,17 +766,144 @@ static char	*perms[] = {
 	"---" , "--x" , "-w-" , "-wx" , "r--" , "r-x" , "rw-" , "rwx"
 };
 
+static	char	mode_table[4096][9];
+
 static char	*months[12] = { "Jan" , "Feb" , "Mar" , "Apr" , "May" , "Jun" ,
 				"Jul" , "Aug" , "Sep" , "Oct" , "Nov" , "Dec" } ;
 
 static	int		opt_d = 0 , opt_t = 0 , opt_s = 0 , opt_R = 0;
 static	int		opt_n = 0 , opt_D = 0 , opt_r = 0 , opt_h = 0;
+static	int		opt_restat = 0 , opt_1 = 0 , opt_j = 1 , opt_async_stat = 0 , opt_U = 0;
+static	int		opt_top = 0 , opt_pipeline = 0 , opt_o = 0 , opt_g = 0;
+static	int		opt_max_depth = -1 , opt_min_depth = 0;
+static	char	**prune_patterns = NULL;
+static	int		num_prunes = 0;
+static	atomic_long	num_pruned;
+static	FILTER	*Filter = NULL;
+static	FILTER	**filter_tokens = NULL;
+static	int		num_filter_tokens = 0;
+static	atomic_long	num_rejected_early , num_rejected_late , num_stats_saved;
+static	int		opt_du = 0 , opt_du_depth = -1;
+static	DIRINFO	**du_dirs = NULL;			/* in the order they were found */
+static	int		num_du_dirs = 0 , du_dirs_size = 0;
+static	pthread_mutex_t	du_lock = PTHREAD_MUTEX_INITIALIZER;
+static	INODESET	Links = { NULL , 0 , 0 , PTHREAD_MUTEX_INITIALIZER };
+static	atomic_long	num_links_skipped;
+static	int		opt_x = 0 , opt_locale_sort = 0;
+static	long long	opt_max_memory = 0;
+static	char	*opt_cache = NULL;
+static	RUNS	Runs;
+static	char	*opt_manifest = NULL , *opt_diff = NULL;
+static	int		error_status = 1;		/* 2 with '--diff' , as for diff(1) */
+static	MANIFEST	Manifest;
+static	int		opt_format = FORMAT_LONG;
+static	unsigned char	json_escape_lengths[256];	/* 0 if the byte is copied */
+static	char	json_escapes[256][8];
+static	int		opt_hash = 0;
+static	char	*opt_hash_cache = NULL;
+static	HASHTABLE	Hashes;
+static	IDCACHE	Owners , Groups;
+static	CACHE	Cache;
+static	int		opt_watch = 0 , watch_delay = WATCH_DELAY;
+static	int		top_level_depth = 0;		/* of the top directory of a walk */
+#ifdef	__linux__
+static	WATCH	Watch;
+#endif
+static	INODESET	Visited = { NULL , 0 , 0 , PTHREAD_MUTEX_INITIALIZER };	/* directories walked */
+static	atomic_long	num_cycles_skipped , num_revisits_skipped , num_mounts_skipped;
 static	int		num_args;
-static	LIST	Files = { 0 , NULL , NULL };
+static	long	num_streamed = 0;
+static	long	num_merged = 0;
+static	LIST	Files;
+static	OUTBUF	Output;
+static	TOPHEAP	Top;
+static	PIPELINE	Pipe;
+/* the subdirectories of dir are walked , unless pruned */
+#define	SUBDIRS_WALKED(dir)	(opt_R && (opt_max_depth < 0 || (dir)->depth + 2 <= opt_max_depth))
+
+static	DIRINFO	NoDir = { "" , 0 , -1 };	/* command line files are at depth 0 */
+static	_Thread_local	LIST	*current_list = &Files;
+static	_Thread_local	char	*path_buffer = NULL;
+static	_Thread_local	size_t	path_buffer_size = 0;
+#ifdef	__linux__
+static	_Thread_local	char	*dir_buffer = NULL;
+#endif
+static	_Thread_local	STATBATCH	*thread_stat_batch = NULL;
+static	_Thread_local	ARENA	*node_arena = NULL;
+static	_Thread_local	ARENA	*string_arena = NULL;
+static	_Thread_local	DATECACHE	date_cache[DATE_CACHE_SLOTS];
+static	_Thread_local	CACHERECORD	cache_record;
+static	ARENA	*all_arenas = NULL;
+static	pthread_mutex_t	arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static	WORKER	*workers = NULL;
+static	atomic_long	outstanding_jobs;
+static	pthread_mutex_t	idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static	pthread_cond_t	idle_cond = PTHREAD_COND_INITIALIZER;
 
 extern	int		optind , optopt , opterr;
 
+#define	OPT_RESTAT		256
+#define	OPT_ASYNC_STAT	257
+#define	OPT_STREAM		258
+#define	OPT_TOP			259
+#define	OPT_PIPELINE	260
+#define	OPT_MAX_DEPTH	261
+#define	OPT_MIN_DEPTH	262
+#define	OPT_PRUNE		263
+#define	OPT_NAME		264
+#define	OPT_REGEX		265
+#define	OPT_TYPE		266
+#define	OPT_SIZE		267
+#define	OPT_MTIME		268
+#define	OPT_NOT			269
+#define	OPT_OR			270
+#define	OPT_DU			271
+#define	OPT_DEPTH		272
+#define	OPT_ONE_FS		273
+#define	OPT_LOCALE_SORT	274
+#define	OPT_MAX_MEMORY	275
+#define	OPT_CACHE		276
+#define	OPT_WATCH		277
+#define	OPT_MANIFEST	278
+#define	OPT_DIFF		279
+#define	OPT_FORMAT		280
+#define	OPT_HASH		281
+#define	OPT_HASH_CACHE	282
+
+static struct option	long_options[] = {
+	{ "restat" , no_argument , NULL , OPT_RESTAT } ,
+	{ "async-stat" , no_argument , NULL , OPT_ASYNC_STAT } ,
+	{ "stream" , no_argument , NULL , OPT_STREAM } ,
+	{ "top" , required_argument , NULL , OPT_TOP } ,
+	{ "pipeline" , no_argument , NULL , OPT_PIPELINE } ,
+	{ "max-depth" , required_argument , NULL , OPT_MAX_DEPTH } ,
+	{ "min-depth" , required_argument , NULL , OPT_MIN_DEPTH } ,
+	{ "prune" , required_argument , NULL , OPT_PRUNE } ,
+	{ "name" , required_argument , NULL , OPT_NAME } ,
+	{ "regex" , required_argument , NULL , OPT_REGEX } ,
+	{ "type" , required_argument , NULL , OPT_TYPE } ,
+	{ "size" , required_argument , NULL , OPT_SIZE } ,
+	{ "mtime" , required_argument , NULL , OPT_MTIME } ,
+	{ "not" , no_argument , NULL , OPT_NOT } ,
+	{ "or" , no_argument , NULL , OPT_OR } ,
+	{ "du" , no_argument , NULL , OPT_DU } ,
+	{ "depth" , required_argument , NULL , OPT_DEPTH } ,
+	{ "one-file-system" , no_argument , NULL , OPT_ONE_FS } ,
+	{ "locale-sort" , no_argument , NULL , OPT_LOCALE_SORT } ,
+	{ "max-memory" , required_argument , NULL , OPT_MAX_MEMORY } ,
+	{ "cache" , required_argument , NULL , OPT_CACHE } ,
+	{ "watch" , optional_argument , NULL , OPT_WATCH } ,
+	{ "manifest" , required_argument , NULL , OPT_MANIFEST } ,
+	{ "diff" , required_argument , NULL , OPT_DIFF } ,
+	{ "format" , required_argument , NULL , OPT_FORMAT } ,
+	{ "hash" , required_argument , NULL , OPT_HASH } ,
+	{ "hash-cache" , required_argument , NULL , OPT_HASH_CACHE } ,
+	{ NULL , 0 , NULL , 0 }
+};
+
 extern	void	system_error() , quit() , die();
+void	flush_output() , stream_files() , spill_run() , add_cache_entry() , add_watch_dir() , add_manifest_entry() , *output_writer();
 
 /*********************************************************************
 *
@@ -84,7 +920,7 @@ extern	void	system_error() , quit() , die();
 *
 * Example   : debug_print("The answer is %s\n",answer);
 *
-* Notes     : (none)
+* Notes     : Buffered listing output is flushed first to keep the order.
 *
 *********************************************************************/
 
@@ -93,6 +929,9 @@ void debug_print(char *format,...)
 	va_list ap;
 
 	if ( opt_D ) {
+		if ( atomic_load(&Pipe.running) == 0 ) {
+			flush_output();
+		} /* IF the listing is not being built in other threads */
 		va_start(ap,format);
 		vfprintf(stdout, format, ap);
 		fflush(stdout);
@@ -122,15 +961,54 @@ void debug_print(char *format,...)
 
 void usage(char *pgm)
 {
-	fprintf(stderr,"Usage : %s [-hFgiDdtsnr]\n\n",pgm);
+	fprintf(stderr,"Usage : %s [-hFgoiDdtsnrxU1] [-j threads] [--top N] [--pipeline] [--restat] [--async-stat] [--locale-sort]\n"
+			"\t[--max-memory SIZE] [--cache FILE] [--watch[=MS]] [--manifest FILE | --diff OLD NEW] [--format=nul|jsonl|bin]\n"
+			"\t[--hash=xxh3|sha256 [--hash-cache FILE]]\n"
+			"\t[--max-depth N] [--min-depth N] [--prune GLOB] [--du [--depth N]]\n"
+			"\t[[--not] --name GLOB | --regex RE | --type TYPES | --size [+-]N[ckMG] | --mtime [+-]N[smhdw]] [--or] ...\n\n",pgm);
 	fprintf(stderr,"D - invoke debugging mode\n");
 	fprintf(stderr,"d - only list the dirname, not its contents\n");
 	fprintf(stderr,"t - sort filenames by time\n");
 	fprintf(stderr,"s - sort filenames by size\n");
 	fprintf(stderr,"n - sort filenames by name\n");
 	fprintf(stderr,"r - reverse sort order\n");
+	fprintf(stderr,"--locale-sort - sort filenames in the collating order of the locale\n");
+	fprintf(stderr,"--max-memory SIZE[kMG] - sort through temporary files once the list of files reaches SIZE bytes ,\n"
+		"\tSIZE is a number of bytes optionally followed by k , M or G (in either case) for KiB , MiB or GiB\n");
+	fprintf(stderr,"U , --stream - show each file as soon as it is found , unsorted\n");
 	fprintf(stderr,"h - produce this summary\n");
 	fprintf(stderr,"R - recursively process directories\n");
+	fprintf(stderr,"x , --one-file-system - for 'R' do not walk directories on other file systems\n");
+	fprintf(stderr,"1 - only list the filenames\n");
+	fprintf(stderr,"o - show the owner of each file\n");
+	fprintf(stderr,"g - show the group of each file\n");
+	fprintf(stderr,"j - number of threads used to traverse directories for 'R'\n");
+	fprintf(stderr,"--top N - only list the N largest ('s') or newest ('t') files , smallest or oldest for 'r'\n");
+	fprintf(stderr,"--pipeline - read directories , stat files and write output in separate threads\n");
+	fprintf(stderr,"--max-depth N - for 'R' do not list files more than N levels down\n");
+	fprintf(stderr,"--min-depth N - do not list files less than N levels down\n");
+	fprintf(stderr,"--prune GLOB - for 'R' do not walk directories matching GLOB\n");
+	fprintf(stderr,"--name GLOB - only list files whose name matches GLOB\n");
+	fprintf(stderr,"--regex RE - only list files whose name matches the extended regular expression RE\n");
+	fprintf(stderr,"--type TYPES - only list files of the types in TYPES (some of '%s')\n",FILTER_TYPES);
+	fprintf(stderr,"--size [+-]N[ckMG] - only list files of more than (+) , less than (-) or exactly N bytes or units\n");
+	fprintf(stderr,"--mtime [+-]N[smhdw] - only list files modified more than (+) , less than (-) or exactly N days or units ago\n");
+	fprintf(stderr,"--not - negate the next test , tests are ANDed unless separated by --or\n");
+	fprintf(stderr,"--du - show the bytes , KiB allocated and files under each directory instead of the files\n");
+	fprintf(stderr,"--depth N - for '--du' only show directories up to N levels down\n");
+	fprintf(stderr,"--restat - stat each file again when it is displayed\n");
+	fprintf(stderr,"--async-stat - stat the files of a directory in batches through io_uring\n");
+	fprintf(stderr,"--watch[=MS] - after the listing show the entries which are added (+) , removed (-) or changed (~) ,\n"
+			"\tgathering the changes of a burst for MS milliseconds (default %d)\n",WATCH_DELAY);
+	fprintf(stderr,"--cache FILE - reuse the entries of directories unchanged since the snapshot in FILE and update it\n");
+	fprintf(stderr,"--manifest FILE - write the entries , in the order of the listing , to the binary manifest FILE instead\n");
+	fprintf(stderr,"--diff OLD NEW - show the entries added (+) , removed (-) or changed (~) from manifest OLD to manifest NEW ,\n"
+			"\texiting with 0 if they match , 1 if they differ and 2 on errors\n");
+	fprintf(stderr,"--format=nul|jsonl|bin - show NUL separated fields , JSON objects or binary records with full sizes and\n"
+			"\tnanosecond mtimes instead of the long format. A jsonl path which is not UTF-8 has each bad byte\n"
+			"\tshown as U+FFFD , with the exact bytes in base64 in \"path_bytes\"\n");
+	fprintf(stderr,"--hash=xxh3|sha256 - add a column with the digest of the contents of each file\n");
+	fprintf(stderr,"--hash-cache FILE - reuse the digests of files unchanged since they were saved in FILE and update it\n");
 
 	return;
 } /* end of usage */
@@ -169,561 +1047,9364 @@ void trim_trailing_chars(char *in_buffer, char trim_ch)
 
 /*********************************************************************
 *
-* Function  : dump_list
+* Function  : arena_alloc
 *
-* Purpose   : Dump list.
+* Purpose   : Allocate memory from an arena.
 *
-* Inputs    : char *title - optional title
+* Inputs    : ARENA **arena_ptr - ptr to the arena of the thread , it
+*                                 is created on first use
+*             size_t size - number of bytes needed
 *
 * Output    : (none)
 *
-* Returns   : (nothing)
+* Returns   : ptr to the memory , aligned for any of the list structures
 *
-* Example   : dump_list("List...\n");
+* Example   : dir = arena_alloc(&node_arena,sizeof(DIRINFO));
 *
-* Notes     : (none)
+* Notes     : Memory is handed out from large chunks and is never freed
+*             on its own , every arena is released by release_arenas().
+*             An arena is only used by the thread which created it.
 *
 *********************************************************************/
 
-void dump_list(char *title)
+void *arena_alloc(ARENA **arena_ptr, size_t size)
 {
-	FILEDATA	*node;
+	ARENA	*arena;
+	ARENACHUNK	*chunk;
+	size_t	chunk_size;
+	void	*memory;
 
-	if ( title != NULL ) {
-		printf("%s",title);
+	arena = *arena_ptr;
+	if ( arena == NULL ) {
+		arena = (ARENA *)calloc(1,sizeof(ARENA));
+		if ( arena == NULL ) {
+			quit(1,"calloc failed for ARENA");
+		} /* IF */
+		pthread_mutex_lock(&arenas_lock);
+		arena->next_arena = all_arenas;
+		all_arenas = arena;
+		pthread_mutex_unlock(&arenas_lock);
+		*arena_ptr = arena;
 	} /* IF */
-	node = Files.first;
-	for ( ; node != NULL ; node = node->next ) {
-		printf(">> %s\n",node->filename);
-	} /* FOR */
-	printf("\n");
-	fflush(stdout);
 
-	return;
-} /* end of dump_list */
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if ( size > arena->bytes_left ) {
+		chunk_size = (size > ARENA_CHUNK_SIZE / 4) ? size : ARENA_CHUNK_SIZE;
+		chunk = (ARENACHUNK *)malloc(sizeof(ARENACHUNK) + chunk_size);
+		if ( chunk == NULL ) {
+			quit(1,"malloc failed for %lu byte arena chunk",(unsigned long)chunk_size);
+		} /* IF */
+		chunk->next_chunk = arena->chunks;
+		arena->chunks = chunk;
+		arena->num_chunks += 1;
+		arena->next_byte = chunk->data;
+		arena->bytes_left = chunk_size;
+	} /* IF chunk is used up */
+	memory = arena->next_byte;
+	arena->next_byte += size;
+	arena->bytes_left -= size;
+	arena->bytes_used += size;
+
+	return(memory);
+} /* end of arena_alloc */
 
 /*********************************************************************
 *
-* Function  : append_file_to_list
+* Function  : arena_mark
 *
-* Purpose   : Append a new entry to the list of files.
+* Purpose   : Remember the current position of an arena.
 *
-* Inputs    : char *filename - name of file
-*             struct _stat *filestats - ptr to stat structure
+* Inputs    : ARENA *arena - the arena (may be NULL)
+*             ARENAMARK *mark - to receive the position
 *
 * Output    : (none)
 *
-* Returns   : FILEDATA *node - ptr to newly created list entry
+* Returns   : (nothing)
 *
-* Example   : node = append_file_to_list(filename,&filestats);
+* Example   : arena_mark(node_arena,&node_mark);
 *
 * Notes     : (none)
 *
 *********************************************************************/
 
-FILEDATA *append_file_to_list(char *filename, struct _stat *filestats)
+void arena_mark(ARENA *arena, ARENAMARK *mark)
 {
-	FILEDATA	*file_node;
-
-	file_node = (FILEDATA *)calloc(1,sizeof(FILEDATA));
-	if ( file_node == NULL ) {
-		quit(1,"calloc failed");
-	} /* IF */
-	file_node->filename = _strdup(filename);
-	if ( file_node->filename == NULL ) {
-		quit(1,"strdup failed");
-	} /* IF */
-	memcpy(&file_node->filestats,filestats,sizeof(struct _stat));
-
-	if ( Files.count == 0 ) {
-		Files.first = file_node;
+	memset(mark,0,sizeof(ARENAMARK));
+	if ( arena != NULL ) {
+		mark->chunk = arena->chunks;
+		mark->next_byte = arena->next_byte;
+		mark->bytes_left = arena->bytes_left;
+		mark->bytes_used = arena->bytes_used;
+		mark->num_chunks = arena->num_chunks;
 	} /* IF */
-	else {
-		Files.last->next = file_node;
-	} /* ELSE */
-	Files.last = file_node;
-	Files.count += 1;
 
-	return(file_node);
-} /* end of append_file_to_list */
+	return;
+} /* end of arena_mark */
 
 /*********************************************************************
 *
-* Function  : prepend_file_to_list
+* Function  : arena_rewind
 *
-* Purpose   : Prepend a new entry to the list of files.
+* Purpose   : Free everything allocated from an arena since a mark.
 *
-* Inputs    : char *filename - name of file
-*             struct _stat *filestats - ptr to stat structure
+* Inputs    : ARENA *arena - the arena (may be NULL)
+*             ARENAMARK *mark - position from arena_mark()
 *
 * Output    : (none)
 *
-* Returns   : FILEDATA *node - ptr to newly created list entry
+* Returns   : (nothing)
 *
-* Example   : node = prepend_file_to_list(filename,&filestats);
+* Example   : arena_rewind(node_arena,&node_mark);
 *
-* Notes     : (none)
+* Notes     : Used by the streaming mode , which is done with a
+*             subtree once it has been listed.
 *
 *********************************************************************/
 
-FILEDATA *prepend_file_to_list(char *filename, struct _stat *filestats)
+void arena_rewind(ARENA *arena, ARENAMARK *mark)
 {
-	FILEDATA	*file_node;
+	ARENACHUNK	*chunk;
 
-	file_node = (FILEDATA *)calloc(1,sizeof(FILEDATA));
-	if ( file_node == NULL ) {
-		quit(1,"calloc failed");
+	if ( arena == NULL ) {
+		return;
 	} /* IF */
-	file_node->filename = _strdup(filename);
-	if ( file_node->filename == NULL ) {
-		quit(1,"strdup failed");
-	} /* IF */
-	memcpy(&file_node->filestats,filestats,sizeof(struct _stat));
-
-	if ( Files.count == 0 ) {
-		Files.last = file_node;
-	} /* IF */
-	else {
-		file_node->next = Files.first;
-	} /* ELSE */
-	Files.first = file_node;
-	Files.count += 1;
+	while ( arena->chunks != mark->chunk ) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next_chunk;
+		free(chunk);
+	} /* WHILE */
+	arena->next_byte = mark->next_byte;
+	arena->bytes_left = mark->bytes_left;
+	arena->bytes_used = mark->bytes_used;
+	arena->num_chunks = mark->num_chunks;
 
-	return(file_node);
-} /* end of prepend_file_to_list */
+	return;
+} /* end of arena_rewind */
 
 /*********************************************************************
 *
-* Function  : add_to_list_by_name
+* Function  : arena_name
 *
-* Purpose   : Add a new entry to the list of files based on name.
+* Purpose   : Allocate a length-prefixed name from the string arena.
 *
-* Inputs    : char *filename - name of file
-*             struct _stat *filestats - ptr to stat structure
+* Inputs    : char *name - the name to be copied , NULL to only reserve
+*                          the space
+*             int length - length of the name
 *
 * Output    : (none)
 *
-* Returns   : FILEDATA *node - ptr to newly created list entry
+* Returns   : ptr to the (NUL terminated) name
 *
-* Example   : node = add_to_list_by_name(filename,&filestats);
+* Example   : filename = arena_name(name,strlen(name));
 *
-* Notes     : (none)
+* Notes     : The length is stored in front of the name and can be
+*             fetched with NAME_LENGTH().
 *
 *********************************************************************/
 
-FILEDATA *add_to_list_by_name(char *filename, struct _stat *filestats)
+char *arena_name(char *name, int length)
 {
-	FILEDATA	*file_node , *prev , *curr;
+	unsigned int	*prefix;
+	char	*copy;
 
-	if ( Files.count <= 0 || GT(filename,Files.last->filename) ) {
-		file_node = append_file_to_list(filename,filestats);
+	prefix = (unsigned int *)arena_alloc(&string_arena,sizeof(unsigned int) + length + 1);
+	*prefix = length;
+	copy = (char *)&prefix[1];
+	if ( name != NULL ) {
+		memcpy(copy,name,length);
 	} /* IF */
-	else {
-		if ( LE(filename,Files.first->filename) ) {
-			file_node = prepend_file_to_list(filename,filestats);
-		} /* IF */
-		else {
-			prev = NULL;
-			curr = Files.first;
-			for ( ; GT(filename,curr->filename) ; curr = curr->next ) {
-				prev = curr;
-			} /* FOR */
-			file_node = (FILEDATA *)calloc(1,sizeof(FILEDATA));
-			if ( file_node == NULL ) {
-				quit(1,"calloc failed");
-			} /* IF */
-			file_node->filename = _strdup(filename);
-			if ( file_node->filename == NULL ) {
-				quit(1,"strdup failed");
-			} /* IF */
-			memcpy(&file_node->filestats,filestats,sizeof(struct _stat));
-			file_node->next = curr;
-			prev->next = file_node;
-			Files.count += 1;
-		} /* ELSE */
-	} /* ELSE */
+	copy[length] = '\0';
 
-	return(file_node);
-} /* end of add_to_list_by_name */
+	return(copy);
+} /* end of arena_name */
 
 /*********************************************************************
 *
-* Function  : add_to_list_by_size
+* Function  : release_arenas
 *
-* Purpose   : Add a new entry to the list of files based on size.
+* Purpose   : Free all the memory allocated from the arenas.
 *
-* Inputs    : char *filename - name of file
-*             struct _stat *filestats - ptr to stat structure
+* Inputs    : (none)
 *
 * Output    : (none)
 *
-* Returns   : FILEDATA *node - ptr to newly created list entry
+* Returns   : (nothing)
 *
-* Example   : node = add_to_list_by_size(filename,&filestats);
+* Example   : release_arenas();
 *
-* Notes     : (none)
+* Notes     : This releases the whole listing in one shot , the arenas
+*             must not be used afterwards.
 *
 *********************************************************************/
 
-FILEDATA *add_to_list_by_size(char *filename, struct _stat *filestats)
+void release_arenas()
 {
-	FILEDATA	*file_node , *prev , *curr;
+	ARENA	*arena , *next_arena;
+	ARENACHUNK	*chunk , *next_chunk;
+	long	num_chunks;
+	size_t	bytes_used;
 
-	if ( Files.count <= 0 || filestats->st_size > Files.last->filestats.st_size ) {
-		file_node = append_file_to_list(filename,filestats);
-	} /* IF */
-	else {
-		if ( filestats->st_size <= Files.first->filestats.st_size ) {
-			file_node = prepend_file_to_list(filename,filestats);
-		} /* IF */
-		else {
-			prev = NULL;
-			curr = Files.first;
-			for ( ; filestats->st_size > curr->filestats.st_size ; curr = curr->next ) {
-				prev = curr;
-			} /* FOR */
-			file_node = (FILEDATA *)calloc(1,sizeof(FILEDATA));
-			if ( file_node == NULL ) {
-				quit(1,"calloc failed");
-			} /* IF */
-			file_node->filename = _strdup(filename);
-			if ( file_node->filename == NULL ) {
-				quit(1,"strdup failed");
-			} /* IF */
-			memcpy(&file_node->filestats,filestats,sizeof(struct _stat));
-			file_node->next = curr;
-			prev->next = file_node;
-			Files.count += 1;
-		} /* ELSE */
-	} /* ELSE */
+	num_chunks = 0;
+	bytes_used = 0;
+	pthread_mutex_lock(&arenas_lock);
+	for ( arena = all_arenas ; arena != NULL ; arena = next_arena ) {
+		next_arena = arena->next_arena;
+		num_chunks += arena->num_chunks;
+		bytes_used += arena->bytes_used;
+		for ( chunk = arena->chunks ; chunk != NULL ; chunk = next_chunk ) {
+			next_chunk = chunk->next_chunk;
+			free(chunk);
+		} /* FOR */
+		free(arena);
+	} /* FOR */
+	all_arenas = NULL;
+	pthread_mutex_unlock(&arenas_lock);
+	debug_print("release_arenas() : %ld chunks (allocator calls) held %lu bytes\n",
+			num_chunks,(unsigned long)bytes_used);
 
-	return(file_node);
-} /* end of add_to_list_by_size */
+	return;
+} /* end of release_arenas */
 
 /*********************************************************************
 *
-* Function  : add_to_list_by_time
+* Function  : add_to_inode_set
 *
-* Purpose   : Add a new entry to the list of files based on time.
+* Purpose   : Add a file to a set of (device , inode) pairs.
 *
-* Inputs    : char *filename - name of file
-*             struct _stat *filestats - ptr to stat structure
+* Inputs    : INODESET *set - the set
+*             unsigned long long device - device of the file
+*             unsigned long long inode - inode of the file
 *
 * Output    : (none)
 *
-* Returns   : FILEDATA *node - ptr to newly created list entry
+* Returns   : 1 if the file was added , 0 if it was already in the set
 *
-* Example   : node = add_to_list_by_time(filename,&filestats);
+* Example   : if ( add_to_inode_set(&Links,dev,ino) ) {
 *
-* Notes     : (none)
+* Notes     : The set is an open addressed hash table of pairs with
+*             linear probing , kept at most half full. Inode 0 on
+*             device 0 marks a free slot. Several threads may share it.
 *
 *********************************************************************/
 
-FILEDATA *add_to_list_by_time(char *filename, struct _stat *filestats)
+int add_to_inode_set(INODESET *set, unsigned long long device, unsigned long long inode)
 {
-	FILEDATA	*file_node , *prev , *curr;
+	unsigned long long	*keys , *slot;
+	long	capacity , index , mask;
 
-	if ( Files.count <= 0 || filestats->st_mtime > Files.last->filestats.st_mtime ) {
-		file_node = append_file_to_list(filename,filestats);
-	} /* IF */
-	else {
-		if ( filestats->st_mtime <= Files.first->filestats.st_mtime ) {
-			file_node = prepend_file_to_list(filename,filestats);
+	pthread_mutex_lock(&set->lock);
+	if ( 2 * (set->count + 1) > set->capacity ) {
+		keys = set->keys;
+		capacity = set->capacity;
+		set->capacity = capacity > 0 ? 2 * capacity : INODE_SET_SIZE;
+		set->keys = (unsigned long long *)calloc(2 * set->capacity,sizeof(unsigned long long));
+		if ( set->keys == NULL ) {
+			quit(1,"calloc failed for %ld inode set slots",set->capacity);
 		} /* IF */
-		else {
-			prev = NULL;
-			curr = Files.first;
-			for ( ; filestats->st_mtime > curr->filestats.st_mtime ; curr = curr->next ) {
-				prev = curr;
-			} /* FOR */
-			file_node = (FILEDATA *)calloc(1,sizeof(FILEDATA));
-			if ( file_node == NULL ) {
-				quit(1,"calloc failed");
-			} /* IF */
-			file_node->filename = _strdup(filename);
-			if ( file_node->filename == NULL ) {
-				quit(1,"strdup failed");
-			} /* IF */
-			memcpy(&file_node->filestats,filestats,sizeof(struct _stat));
-			file_node->next = curr;
-			prev->next = file_node;
-			Files.count += 1;
-		} /* ELSE */
-	} /* ELSE */
+		mask = set->capacity - 1;
+		for ( index = 0 ; index < capacity ; ++index ) {
+			if ( keys[2*index] == 0 && keys[2*index+1] == 0 ) {
+				continue;
+			} /* IF free slot */
+			slot = &set->keys[2 * (INODE_HASH(keys[2*index],keys[2*index+1]) & mask)];
+			while ( slot[0] != 0 || slot[1] != 0 ) {
+				slot = (slot + 2 == &set->keys[2*set->capacity]) ? set->keys : slot + 2;
+			} /* WHILE */
+			slot[0] = keys[2*index];
+			slot[1] = keys[2*index+1];
+		} /* FOR */
+		free(keys);
+	} /* IF the set is half full */
+
+	mask = set->capacity - 1;
+	for ( index = INODE_HASH(device,inode) & mask ; ; index = (index + 1) & mask ) {
+		slot = &set->keys[2*index];
+		if ( slot[0] == device && slot[1] == inode ) {
+			pthread_mutex_unlock(&set->lock);
+			return(0);
+		} /* IF already there */
+		if ( slot[0] == 0 && slot[1] == 0 ) {
+			break;
+		} /* IF free slot */
+	} /* FOR */
+	slot[0] = device;
+	slot[1] = inode;
+	set->count += 1;
+	pthread_mutex_unlock(&set->lock);
 
-	return(file_node);
-} /* end of add_to_list_by_time */
+	return(1);
+} /* end of add_to_inode_set */
 
 /*********************************************************************
 *
-* Function  : add_file_to_list
+* Function  : add_du_dir
 *
-* Purpose   : Add a new entry to the list of files.
+* Purpose   : Give a new directory its totals for '--du'.
 *
-* Inputs    : char *filename - name of file
-*             struct _stat *filestats - ptr to stat structure
+* Inputs    : DIRINFO *dir - the directory
 *
 * Output    : (none)
 *
-* Returns   : FILEDATA *node - ptr to newly created list entry
+* Returns   : (nothing)
 *
-* Example   : node = add_file_to_list(filename,&filestats);
+* Example   : add_du_dir(dir);
 *
-* Notes     : (none)
+* Notes     : The directories are kept in the order they are found , so
+*             a directory always comes before its subdirectories.
 *
 *********************************************************************/
 
-FILEDATA *add_file_to_list(char *filename, struct _stat *filestats)
+void add_du_dir(DIRINFO *dir)
 {
-	FILEDATA	*file_node;
-
-	debug_print("add_file_to_list(%s)\n",filename);
-	if ( opt_n ) {
-		file_node = append_file_to_list(filename,filestats);
-	} else if ( opt_t ) {
-		file_node = add_to_list_by_time(filename,filestats);
-	} else if (opt_s ) {
-		file_node = add_to_list_by_size(filename,filestats);
-	} else {
-		file_node = add_to_list_by_name(filename,filestats);
-	} /* ELSE */
+	dir->totals = (DUTOTALS *)arena_alloc(&node_arena,sizeof(DUTOTALS));
+	memset(dir->totals,0,sizeof(DUTOTALS));
+	pthread_mutex_lock(&du_lock);
+	if ( num_du_dirs >= du_dirs_size ) {
+		du_dirs_size = (du_dirs_size > 0) ? 2 * du_dirs_size : 1024;
+		du_dirs = (DIRINFO **)realloc(du_dirs,du_dirs_size * sizeof(DIRINFO *));
+		if ( du_dirs == NULL ) {
+			quit(1,"realloc failed for %d directories",du_dirs_size);
+		} /* IF */
+	} /* IF */
+	du_dirs[num_du_dirs++] = dir;
+	pthread_mutex_unlock(&du_lock);
 
-	return(file_node);
-} /* end of add_file_to_list */
+	return;
+} /* end of add_du_dir */
 
 /*********************************************************************
 *
-* Function  : list_directory
+* Function  : new_dirinfo
 *
-* Purpose   : List the files under a directory.
+* Purpose   : Create the information for a directory being listed.
 *
-* Inputs    : char *dirname - name of directory
+* Inputs    : DIRINFO *parent - parent directory (NULL for a top level
+*                               directory)
+*             char *name - name of the directory within its parent
 *
 * Output    : (none)
 *
-* Returns   : (nothing)
+* Returns   : DIRINFO *dir - ptr to the new directory information
 *
-* Example   : list_directory(dirname);
+* Example   : dir = new_dirinfo(parent,name);
 *
-* Notes     : (none)
+* Notes     : The path is built once per directory, the names of the
+*             files under it are only joined to it when displayed. The
+*             information lives in the arenas of the current thread.
 *
 *********************************************************************/
 
-int list_directory(char *dirpath)
+DIRINFO *new_dirinfo(DIRINFO *parent, char *name)
 {
-	_DIR	*dirptr;
-	struct _dirent	*entry;
-	struct _stat	filestats;
-	char	*name , filename[1024] , dirname[1024];
-	int		current_directory;
-	NAMESLIST	subdirs;
-	unsigned short	filemode;
-	NAME	*dir;
-
-	debug_print("list_directory(%s)\n",dirpath);
-
-	subdirs.num_names = 0;
-	subdirs.first_name = NULL;
-	subdirs.last_name = NULL;
-
-	strcpy(dirname,dirpath);
-	trim_trailing_chars(dirname,'/');
-	dirptr = _opendir(dirname);
-	if ( dirptr == NULL ) {
-		quit(1,"_opendir failed for \"%s\"",dirname);
-	}
-
-	current_directory = EQ(dirname,".");
-	entry = _readdir(dirptr);
-	for ( ; entry != NULL ; entry = _readdir(dirptr) ) {
-		name = entry->d_name;
-		if ( current_directory )
-			strcpy(filename,name);
-		else
-			sprintf(filename,"%s/%s",dirname,name);
-		if ( _stat(filename,&filestats) < 0 ) {
-			system_error("stat() failed for \"%s\"",filename);
-		} /* IF */
-		else {
-			add_file_to_list(filename,&filestats);
-			filemode = filestats.st_mode & _S_IFMT;
-			if ( _S_ISDIR(filemode) && opt_R && NE(name,".") && NE(name,"..") ) {
-				subdirs.num_names += 1;
-				dir = (NAME *)calloc(1,sizeof(NAME));
-				if ( dir == NULL ) {
-					quit(1,"calloc failed for NAME");
-				}
-				dir->name = _strdup(filename);
-				if ( dir->name == NULL ) {
-					quit(1,"strdup failed for dir.name");
-				}
-				if ( subdirs.num_names == 1 ) {
-					subdirs.first_name = dir;
-				}
-				else {
-					subdirs.last_name->next_name = dir;
-				}
-				subdirs.last_name = dir;
-			} /* IF recursive processing requested */
-		} /* ELSE */
-	} /* FOR */
-	debug_print("list_directory(%s) ; all entries processed\n",dirname);
-	_closedir(dirptr);
+	DIRINFO	*dir;
+	int		name_length;
 
-	if ( opt_R ) {
-		dir = subdirs.first_name;
-		for ( ; dir != NULL ; dir = dir->next_name ) {
-			debug_print("list_directory() : recursively process '%s' under '%s'\n",dir->name,dirpath);
-			list_directory(dir->name);
-		}
-	}
+	dir = (DIRINFO *)arena_alloc(&node_arena,sizeof(DIRINFO));
+	dir->depth = (parent == NULL) ? top_level_depth : parent->depth + 1;
+	dir->parent = parent;
+	dir->totals = NULL;
+	dir->device = 0;
+	dir->inode = 0;
+	dir->skipped = 0;
+	if ( opt_du ) {
+		add_du_dir(dir);
+	} /* IF */
+	name_length = strlen(name);
+	if ( parent == NULL || parent->path_length == 0 ) {
+		if ( parent == NULL && EQ(name,".") ) {
+			name_length = 0;
+		} /* IF current directory */
+		dir->path = arena_name(name,name_length);
+		dir->path_length = name_length;
+	} /* IF */
+	else {
+		dir->path_length = parent->path_length + 1 + name_length;
+		dir->path = arena_name(NULL,dir->path_length);
+		memcpy(dir->path,parent->path,parent->path_length);
+		dir->path[parent->path_length] = '/';
+		memcpy(&dir->path[parent->path_length+1],name,name_length);
+	} /* ELSE */
 
-	return(0);
-} /* end of list_directory */
+	return(dir);
+} /* end of new_dirinfo */
 
 /*********************************************************************
 *
-* Function  : Reverse
+* Function  : join_path
 *
-* Purpose   : Reverse the order of the elements in a list
+* Purpose   : Join a directory path and a name into the path buffer.
 *
-* Inputs    : FILEDATA *curr - pointer to the top of the list
+* Inputs    : DIRINFO *dir - directory containing the file
+*             char *name - name of the file within the directory
+*             size_t name_length - length of the name
 *
 * Output    : (none)
 *
-* Returns   : pointer to the new top of the list
+* Returns   : ptr to the path , which is only valid until the next call
 *
-* Example   : new_first = Reverse(first);
+* Example   : path = join_path(dir,name,NAME_LENGTH(name));
 *
-* Notes     : (none)
+* Notes     : The path is built in a buffer which is reused and grown
+*             as needed , there is no limit on the length of a path.
 *
 *********************************************************************/
 
-FILEDATA *Reverse (FILEDATA *curr)
+char *join_path(DIRINFO *dir, char *name, size_t name_length)
 {
-	FILEDATA *prev = NULL;
+	size_t	needed;
 
-	while (curr != NULL)
-	{
-		FILEDATA *tmp = curr->next;
+	needed = dir->path_length + 1 + name_length + 1;
+	if ( needed > path_buffer_size ) {
+		path_buffer_size = (needed < 1024) ? 1024 : needed * 2;
+		path_buffer = (char *)realloc(path_buffer,path_buffer_size);
+		if ( path_buffer == NULL ) {
+			quit(1,"realloc failed for path buffer");
+		} /* IF */
+	} /* IF */
+	if ( dir->path_length == 0 ) {
+		memcpy(path_buffer,name,name_length + 1);
+	} /* IF */
+	else {
+		memcpy(path_buffer,dir->path,dir->path_length);
+		path_buffer[dir->path_length] = '/';
+		memcpy(&path_buffer[dir->path_length+1],name,name_length + 1);
+	} /* ELSE */
 
-		curr->next = prev;
-		prev = curr;
-		curr = tmp;
-	}
-	return prev;
-}
+	return(path_buffer);
+} /* end of join_path */
 
 /*********************************************************************
 *
-* Function  : format_mode
+* Function  : build_path
 *
-* Purpose   : Format binary permission bits into a printable ASCII string
+* Purpose   : Build the full path of a file for display.
 *
-* Inputs    : unsigned short file_mode - mode bits from stat()
-*             char *mode_bits - buffer to receive formatted info
+* Inputs    : DIRINFO *dir - directory containing the file
+*             char *name - name of the file within the directory
 *
 * Output    : (none)
 *
-* Returns   : formatted mode info
+* Returns   : ptr to the path , which is only valid until the next call
 *
-* Example   : format_mode(filestat->st_mode,mode_info);
+* Example   : path = build_path(dir,name);
 *
-* Notes     : (none)
+* Notes     : For list entries FILE_PATH() avoids the strlen().
 *
 *********************************************************************/
 
-void format_mode(unsigned short file_mode, char *mode_info)
+char *build_path(DIRINFO *dir, char *name)
 {
-	unsigned short setids;
-	char *permstrs[3] , ftype , *ptr;
-
-	setids = (file_mode & 07000) >> 9;
-	permstrs[0] = perms[ (file_mode & 0700) >> 6 ];
-	permstrs[1] = perms[ (file_mode & 0070) >> 3 ];
-	permstrs[2] = perms[ file_mode & 0007 ];
-	ftype = ftypes[ (file_mode & 0170000) >> 12 ];
-	if ( setids ) {
-		if ( setids & 01 ) { // sticky bit
-			ptr = permstrs[2];
-			if ( ptr[2] == 'x' ) {
-				ptr[2] = 't';
-			}
-			else {
-				ptr[2] = 'T';
-			}
-		}
-		if ( setids & 04 ) { // setuid bit
-			ptr = permstrs[0];
-			if ( ptr[2] == 'x' ) {
-				ptr[2] = 's';
-			}
-			else {
-				ptr[2] = 'S';
-			}
-		}
-		if ( setids & 02 ) { // setgid bit
-			ptr = permstrs[1];
-			if ( ptr[2] == 'x' ) {
-				ptr[2] = 's';
-			}
-			else {
-				ptr[2] = 'S';
-			}
-		}
-	} // IF setids
-	sprintf(mode_info,"%c%3.3s%3.3s%3.3s",ftype,permstrs[0],permstrs[1],permstrs[2]);
-
-	return;
-} /* end of format_mode */
+	return( join_path(dir,name,strlen(name)) );
+} /* end of build_path */
 
 /*********************************************************************
 *
-* Function  : display_file_info
+* Function  : get_path_parts
 *
-* Purpose   : Display information for one file
+* Purpose   : Get the pieces which make up the path of a list entry.
 *
-* Inputs    : char *filename - name of file
+* Inputs    : LIST *list - the list
+*             int index - index of the entry
+*             const unsigned char **parts - to receive the pieces
+*             int *lengths - to receive the length of each piece
 *
-* Output    : file information
+* Output    : (none)
 *
-* Returns   : nothing
+* Returns   : number of pieces , 1 or 3
 *
-* Example   : display_file_info("foo.txt");
+* Example   : num_parts = get_path_parts(&Files,index,parts,lengths);
 *
-* Notes     : (none)
+* Notes     : The path is "dir" , "/" and "name" unless the directory
+*             is shown as "".
 *
 *********************************************************************/
 
-void display_file_info(char *filepath)
+int get_path_parts(LIST *list, int index, const unsigned char **parts, int *lengths)
 {
-	struct _stat	filestats;
-	unsigned short	filemode;
-	char	mode_info[1024] , file_date[256];
-	struct tm	*filetime;
-
-	if ( _stat(filepath,&filestats) == 0 ) {
-		filemode = filestats.st_mode & _S_IFMT;
-		format_mode(filestats.st_mode,mode_info);
-		filetime = localtime(&filestats.st_mtime);
-		sprintf(file_date,"%3.3s %2d, %d %02d:%02d:%02d",
-			months[filetime->tm_mon],
-			filetime->tm_mday,1900+filetime->tm_year,filetime->tm_hour,filetime->tm_min,
-			filetime->tm_sec);
-		printf("%s %4d %10d %s %s\n",mode_info,filestats.st_nlink,filestats.st_size,file_date,filepath);
-	}
+	DIRINFO	*dir;
+	int		num_parts;
 
-	return;
-} /* end of display_file_info */
+	dir = FILE_DIR(list,index);
+	num_parts = 0;
+	if ( dir->path_length > 0 ) {
+		parts[0] = (const unsigned char *)dir->path;
+		lengths[0] = dir->path_length;
+		parts[1] = (const unsigned char *)"/";
+		lengths[1] = 1;
+		num_parts = 2;
+	} /* IF */
+	parts[num_parts] = (const unsigned char *)FILE_NAME(list,index);
+	lengths[num_parts] = NAME_LENGTH(FILE_NAME(list,index));
+
+	return(num_parts + 1);
+} /* end of get_path_parts */
 
 /*********************************************************************
 *
-* Function  : main
+* Function  : compare_filenames
 *
-* Purpose   : program entry point
+* Purpose   : Compare the full paths of two list entries.
 *
-* Inputs    : argc - number of parameters
-*             argv - list of parameters
+* Inputs    : LIST *list - the list
+*             int index1 - index of the first entry
+*             int index2 - index of the second entry
+*
+* Output    : (none)
+*
+* Returns   : <0 , 0 , >0 as for strcmp()
+*
+* Example   : if ( compare_filenames(&Files,index1,index2) > 0 ) ...
+*
+* Notes     : The comparison walks "dir/name" for each entry without
+*             building the path strings. The pieces are compared in
+*             the longest spans both paths have left with memcmp() ,
+*             which the C library runs with the widest vector
+*             instructions the processor has.
+*
+*********************************************************************/
+
+int compare_filenames(LIST *list, int index1, int index2)
+{
+	const unsigned char	*parts1[3] , *parts2[3] , *p1 , *p2;
+	int		lengths1[3] , lengths2[3] , num1 , num2 , part1 , part2 , left1 , left2 , span , result;
+
+	if ( FILE_DIR(list,index1) == FILE_DIR(list,index2) ) {
+		return( strcmp(FILE_NAME(list,index1),FILE_NAME(list,index2)) );
+	} /* IF */
+
+	num1 = get_path_parts(list,index1,parts1,lengths1);
+	num2 = get_path_parts(list,index2,parts2,lengths2);
+	part1 = part2 = 0;
+	p1 = parts1[0];
+	p2 = parts2[0];
+	left1 = lengths1[0];
+	left2 = lengths2[0];
+	for ( ; ; ) {
+		while ( left1 == 0 && part1 < num1 - 1 ) {
+			p1 = parts1[++part1];
+			left1 = lengths1[part1];
+		} /* WHILE */
+		while ( left2 == 0 && part2 < num2 - 1 ) {
+			p2 = parts2[++part2];
+			left2 = lengths2[part2];
+		} /* WHILE */
+		if ( left1 == 0 || left2 == 0 ) {
+			return( left1 - left2 );
+		} /* IF one path has ended */
+		span = (left1 < left2) ? left1 : left2;
+		result = memcmp(p1,p2,span);
+		if ( result != 0 ) {
+			return(result);
+		} /* IF */
+		p1 += span;
+		p2 += span;
+		left1 -= span;
+		left2 -= span;
+	} /* FOR */
+} /* end of compare_filenames */
+
+/*********************************************************************
+*
+* Function  : common_path_length
+*
+* Purpose   : Find the length of the start shared by all the paths in
+*             the list.
+*
+* Inputs    : LIST *list - the list
+*
+* Output    : (none)
+*
+* Returns   : number of leading bytes every path has in common
+*
+* Example   : offset = common_path_length(&Files);
+*
+* Notes     : The entries of one directory all share its path , so it
+*             only has to be checked once per directory.
+*
+*********************************************************************/
+
+int common_path_length(LIST *list)
+{
+	const unsigned char	*parts[3] , *first;
+	int		lengths[3] , num_parts , common , index , part , length , i;
+	DIRINFO	*last_dir;
+
+	if ( list->count == 0 ) {
+		return(0);
+	} /* IF */
+	first = (const unsigned char *)FILE_PATH(list,0);
+	common = strlen((const char *)first);
+	last_dir = NULL;
+	for ( index = 0 ; index < list->count && common > 0 ; ++index ) {
+		num_parts = get_path_parts(list,index,parts,lengths);
+		if ( FILE_DIR(list,index) == last_dir && num_parts > 1 &&
+					lengths[0] + 1 >= common ) {
+			continue;
+		} /* IF the directory already covers the common part */
+		last_dir = FILE_DIR(list,index);
+		length = 0;
+		for ( part = 0 ; part < num_parts && length < common ; ++part ) {
+			for ( i = 0 ; i < lengths[part] && length < common ; ++i , ++length ) {
+				if ( parts[part][i] != first[length] ) {
+					common = length;
+				} /* IF */
+			} /* FOR */
+		} /* FOR */
+		if ( length < common ) {
+			common = length;
+		} /* IF the path is shorter */
+	} /* FOR */
+
+	return(common);
+} /* end of common_path_length */
+
+/*********************************************************************
+*
+* Function  : pack_name_key
+*
+* Purpose   : Build the sort key from the start of a string.
+*
+* Inputs    : NAMEKEY *key - to receive the key
+*             const unsigned char **parts - the pieces of the string
+*             int *lengths - the length of each piece
+*             int num_parts - the number of pieces
+*             int offset - number of leading bytes to skip
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : pack_name_key(&keys[i],parts,lengths,num_parts,offset);
+*
+* Notes     : NAME_KEY_BYTES bytes are packed big endian so that
+*             comparing the two words compares the bytes in order. A
+*             string which ends early is padded with zeros , putting it
+*             before any longer string with the same start.
+*
+*********************************************************************/
+
+void pack_name_key(NAMEKEY *key, const unsigned char **parts, int *lengths, int num_parts, int offset)
+{
+	unsigned char	bytes[NAME_KEY_BYTES];
+	int		part , count , length , i;
+
+	memset(bytes,0,sizeof(bytes));
+	count = 0;
+	for ( part = 0 ; part < num_parts && count < NAME_KEY_BYTES ; ++part ) {
+		length = lengths[part];
+		if ( offset >= length ) {
+			offset -= length;
+			continue;
+		} /* IF all skipped */
+		length -= offset;
+		if ( length > NAME_KEY_BYTES - count ) {
+			length = NAME_KEY_BYTES - count;
+		} /* IF */
+		memcpy(&bytes[count],&parts[part][offset],length);
+		count += length;
+		offset = 0;
+	} /* FOR */
+
+	key->high = 0;
+	key->low = 0;
+	for ( i = 0 ; i < 8 ; ++i ) {
+		key->high = (key->high << 8) | bytes[i];
+		key->low = (key->low << 8) | bytes[i+8];
+	} /* FOR */
+
+	return;
+} /* end of pack_name_key */
+
+/*********************************************************************
+*
+* Function  : build_collation_keys
+*
+* Purpose   : Transform the path of every list entry for '--locale-sort'.
+*
+* Inputs    : LIST *list - the list
+*
+* Output    : (none)
+*
+* Returns   : char **keys - the strxfrm() form of each path , by index
+*
+* Example   : collation_keys = build_collation_keys(&Files);
+*
+* Notes     : strcmp() on the transformed strings gives the order of
+*             strcoll() on the paths , so the work of collation is done
+*             once per entry instead of once per comparison. The
+*             strings are kept with the names , with their lengths.
+*
+*********************************************************************/
+
+char **build_collation_keys(LIST *list)
+{
+	char	**keys , *path , *buffer;
+	size_t	size , length;
+	int		index;
+
+	keys = (char **)malloc((list->count > 0 ? list->count : 1) * sizeof(char *));
+	size = 256;
+	buffer = (char *)malloc(size);
+	if ( keys == NULL || buffer == NULL ) {
+		quit(1,"malloc failed for %d collation keys",list->count);
+	} /* IF */
+	for ( index = 0 ; index < list->count ; ++index ) {
+		path = FILE_PATH(list,index);
+		length = strxfrm(buffer,path,size);
+		if ( length >= size ) {
+			size = 2 * length;
+			buffer = (char *)realloc(buffer,size);
+			if ( buffer == NULL ) {
+				quit(1,"realloc failed for collation key");
+			} /* IF */
+			strxfrm(buffer,path,size);
+		} /* IF the key did not fit */
+		keys[index] = arena_name(buffer,length);
+	} /* FOR */
+	free(buffer);
+
+	return(keys);
+} /* end of build_collation_keys */
+
+/*********************************************************************
+*
+* Function  : dump_list
+*
+* Purpose   : Dump list.
+*
+* Inputs    : char *title - optional title
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : dump_list("List...\n");
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void dump_list(char *title)
+{
+	int		index;
+
+	if ( title != NULL ) {
+		printf("%s",title);
+	} /* IF */
+	for ( index = 0 ; index < Files.count ; ++index ) {
+		printf(">> %s\n",FILE_PATH(&Files,index));
+	} /* FOR */
+	printf("\n");
+	fflush(stdout);
+
+	return;
+} /* end of dump_list */
+
+/*********************************************************************
+*
+* Function  : grow_column
+*
+* Purpose   : Grow one column of a list.
+*
+* Inputs    : void *column - the column
+*             int capacity - new number of entries
+*             size_t width - size of one entry
+*
+* Output    : (none)
+*
+* Returns   : ptr to the column
+*
+* Example   : list->sizes = grow_column(list->sizes,capacity,sizeof(long long));
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void *grow_column(void *column, int capacity, size_t width)
+{
+	column = realloc(column,capacity * width);
+	if ( column == NULL ) {
+		quit(1,"realloc failed for %d list entries",capacity);
+	} /* IF */
+
+	return(column);
+} /* end of grow_column */
+
+/*********************************************************************
+*
+* Function  : list_dir_index
+*
+* Purpose   : Get the index of a directory in the table of a list.
+*
+* Inputs    : LIST *list - the list
+*             DIRINFO *dir - the directory
+*
+* Output    : (none)
+*
+* Returns   : index of the directory
+*
+* Example   : list->dir_indexes[index] = list_dir_index(list,dir);
+*
+* Notes     : The entries of a directory are added one after another so
+*             only the last directory in the table has to be checked.
+*
+*********************************************************************/
+
+unsigned int list_dir_index(LIST *list, DIRINFO *dir)
+{
+	if ( list->num_dirs > 0 && list->dirs[list->num_dirs-1] == dir ) {
+		return(list->num_dirs - 1);
+	} /* IF */
+	if ( list->num_dirs >= list->dirs_size ) {
+		list->dirs_size = (list->dirs_size == 0) ? 64 : list->dirs_size * 2;
+		list->dirs = (DIRINFO **)grow_column(list->dirs,list->dirs_size,sizeof(DIRINFO *));
+	} /* IF */
+	list->dirs[list->num_dirs] = dir;
+
+	return(list->num_dirs++);
+} /* end of list_dir_index */
+
+/*********************************************************************
+*
+* Function  : list_device_index
+*
+* Purpose   : Get the index of a device number in the table of a list.
+*
+* Inputs    : LIST *list - the list
+*             unsigned long long device - the device number
+*
+* Output    : (none)
+*
+* Returns   : index of the device
+*
+* Example   : list->device_indexes[index] = list_device_index(list,device);
+*
+* Notes     : A listing only spans a handful of filesystems so a short
+*             table is kept instead of a device number per entry.
+*
+*********************************************************************/
+
+unsigned short list_device_index(LIST *list, unsigned long long device)
+{
+	int		index;
+
+	if ( list->num_devices > 0 && list->devices[list->last_device] == device ) {
+		return(list->last_device);
+	} /* IF */
+	for ( index = 0 ; index < list->num_devices ; ++index ) {
+		if ( list->devices[index] == device ) {
+			list->last_device = index;
+			return(index);
+		} /* IF */
+	} /* FOR */
+	if ( list->num_devices >= 65535 ) {
+		die(1,"Too many filesystems in the listing\n");
+	} /* IF */
+	if ( list->num_devices >= list->devices_size ) {
+		list->devices_size = (list->devices_size == 0) ? 8 : list->devices_size * 2;
+		list->devices = (unsigned long long *)grow_column(list->devices,list->devices_size,
+								sizeof(unsigned long long));
+	} /* IF */
+	list->devices[list->num_devices] = device;
+	list->last_device = list->num_devices;
+
+	return(list->num_devices++);
+} /* end of list_device_index */
+
+/*********************************************************************
+*
+* Function  : store_list_entry
+*
+* Purpose   : Store an entry into a slot of a list.
+*
+* Inputs    : LIST *list - the list
+*             int index - the slot , less than the list capacity
+*             DIRINFO *dir - directory containing the file
+*             char *filename - name of file within the directory
+*             int name_length - length of the name
+*             ENTRYINFO *info - the metadata for the file
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : store_list_entry(list,index,dir,name,name_length,&info);
+*
+* Notes     : The name is always added to the end of the names pool , so
+*             overwriting a slot leaves the old name behind.
+*
+*********************************************************************/
+
+void store_list_entry(LIST *list, int index, DIRINFO *dir, char *filename, int name_length, ENTRYINFO *info)
+{
+	size_t	needed;
+	unsigned int	*prefix;
+
+	needed = (sizeof(unsigned int) + name_length + 1 + 3) & ~(size_t)3;
+	if ( list->names_used + needed > list->names_size ) {
+		/* name offsets are 32 bits , so the pool can not pass 4 GiB */
+		if ( list->names_used + needed > 0xffffffffUL ) {
+			die(1,"The names in the listing need more than the 4 GiB limit\n");
+		} /* IF */
+		list->names_size = (list->names_size == 0) ? 64 * 1024 : list->names_size * 2;
+		if ( list->names_size > 0xffffffffUL ) {
+			list->names_size = 0xffffffffUL;
+		} /* IF */
+		list->names = (char *)grow_column(list->names,list->names_size,1);
+	} /* IF */
+	prefix = (unsigned int *)&list->names[list->names_used];
+	*prefix = name_length;
+	memcpy(&prefix[1],filename,name_length);
+	((char *)&prefix[1])[name_length] = '\0';
+
+	list->name_offsets[index] = list->names_used + sizeof(unsigned int);
+	list->names_used += needed;
+	list->sizes[index] = info->size;
+	list->mtimes[index] = info->mtime;
+	list->inodes[index] = info->inode;
+	list->nlinks[index] = info->nlink;
+	if ( LIST_OWNERS ) {
+		list->uids[index] = info->uid;
+		list->gids[index] = info->gid;
+	} /* IF */
+	list->modes[index] = info->mode;
+	list->dir_indexes[index] = list_dir_index(list,dir);
+	list->device_indexes[index] = list_device_index(list,info->device);
+
+	return;
+} /* end of store_list_entry */
+
+/*********************************************************************
+*
+* Function  : add_entry_to_list
+*
+* Purpose   : Add a new entry to the end of a list.
+*
+* Inputs    : LIST *list - the list
+*             DIRINFO *dir - directory containing the file
+*             char *filename - name of file within the directory
+*             int name_length - length of the name
+*             ENTRYINFO *info - the metadata for the file
+*
+* Output    : (none)
+*
+* Returns   : index of the entry
+*
+* Example   : index = add_entry_to_list(&Files,dir,name,name_length,&info);
+*
+* Notes     : The list is a set of parallel arrays (one per field) plus
+*             a pool of length-prefixed names , it is sorted once after
+*             all the entries have been collected.
+*
+*********************************************************************/
+
+int add_entry_to_list(LIST *list, DIRINFO *dir, char *filename, int name_length, ENTRYINFO *info)
+{
+	int		capacity , index;
+
+	if ( list->count >= list->capacity ) {
+		capacity = (list->capacity == 0) ? 1024 : list->capacity * 2;
+		list->sizes = (long long *)grow_column(list->sizes,capacity,sizeof(long long));
+		list->mtimes = (long long *)grow_column(list->mtimes,capacity,sizeof(long long));
+		list->inodes = (unsigned long long *)grow_column(list->inodes,capacity,sizeof(unsigned long long));
+		list->nlinks = (unsigned int *)grow_column(list->nlinks,capacity,sizeof(unsigned int));
+		if ( LIST_OWNERS ) {
+			list->uids = (unsigned int *)grow_column(list->uids,capacity,sizeof(unsigned int));
+			list->gids = (unsigned int *)grow_column(list->gids,capacity,sizeof(unsigned int));
+		} /* IF */
+		list->name_offsets = (unsigned int *)grow_column(list->name_offsets,capacity,sizeof(unsigned int));
+		list->dir_indexes = (unsigned int *)grow_column(list->dir_indexes,capacity,sizeof(unsigned int));
+		list->modes = (unsigned short *)grow_column(list->modes,capacity,sizeof(unsigned short));
+		list->device_indexes = (unsigned short *)grow_column(list->device_indexes,capacity,sizeof(unsigned short));
+		list->capacity = capacity;
+	} /* IF */
+
+	index = list->count++;
+	store_list_entry(list,index,dir,filename,name_length,info);
+
+	return(index);
+} /* end of add_entry_to_list */
+
+/*********************************************************************
+*
+* Function  : get_entry_info
+*
+* Purpose   : Fetch the metadata of a list entry.
+*
+* Inputs    : LIST *list - the list
+*             int index - index of the entry
+*             ENTRYINFO *info - to receive the metadata
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : get_entry_info(&Files,index,&info);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void get_entry_info(LIST *list, int index, ENTRYINFO *info)
+{
+	info->size = list->sizes[index];
+	info->mtime = list->mtimes[index];
+	info->inode = list->inodes[index];
+	info->nlink = list->nlinks[index];
+	info->mode = list->modes[index];
+	info->device = list->devices[list->device_indexes[index]];
+	info->uid = LIST_OWNERS ? list->uids[index] : 0;
+	info->gid = LIST_OWNERS ? list->gids[index] : 0;
+
+	return;
+} /* end of get_entry_info */
+
+/*********************************************************************
+*
+* Function  : stat_to_info
+*
+* Purpose   : Extract the fields kept in a list from a stat structure.
+*
+* Inputs    : struct _stat *filestats - the stat data
+*             ENTRYINFO *info - to receive the metadata
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : stat_to_info(&filestats,&info);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void stat_to_info(struct _stat *filestats, ENTRYINFO *info)
+{
+	info->size = filestats->st_size;
+	info->mtime = (long long)filestats->st_mtim.tv_sec * 1000000000LL + filestats->st_mtim.tv_nsec;
+	info->inode = filestats->st_ino;
+	info->nlink = filestats->st_nlink;
+	info->mode = filestats->st_mode;
+	info->device = filestats->st_dev;
+	info->uid = filestats->st_uid;
+	info->gid = filestats->st_gid;
+
+	return;
+} /* end of stat_to_info */
+
+/*********************************************************************
+*
+* Function  : append_file_to_list
+*
+* Purpose   : Append a new entry to the list of files.
+*
+* Inputs    : DIRINFO *dir - directory containing the file
+*             char *filename - name of file within the directory
+*             struct _stat *filestats - ptr to stat structure
+*
+* Output    : (none)
+*
+* Returns   : index of the new entry
+*
+* Example   : index = append_file_to_list(dir,filename,&filestats);
+*
+* Notes     : The entry goes to the list of the current thread, which is
+*             the global list except in the traversal worker threads.
+*
+*********************************************************************/
+
+int append_file_to_list(DIRINFO *dir, char *filename, struct _stat *filestats)
+{
+	ENTRYINFO	info;
+
+	stat_to_info(filestats,&info);
+
+	return( add_entry_to_list(current_list,dir,filename,strlen(filename),&info) );
+} /* end of append_file_to_list */
+
+/*********************************************************************
+*
+* Function  : copy_list_entry
+*
+* Purpose   : Copy an entry of one list to the end of another.
+*
+* Inputs    : LIST *dest - the list receiving the entry
+*             LIST *src - the list holding the entry
+*             int index - index of the entry in src
+*
+* Output    : (none)
+*
+* Returns   : index of the entry in dest
+*
+* Example   : copy_list_entry(&Files,job->list,index);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int copy_list_entry(LIST *dest, LIST *src, int index)
+{
+	ENTRYINFO	info;
+	char	*name;
+
+	get_entry_info(src,index,&info);
+	name = FILE_NAME(src,index);
+
+	return( add_entry_to_list(dest,FILE_DIR(src,index),name,NAME_LENGTH(name),&info) );
+} /* end of copy_list_entry */
+
+/*********************************************************************
+*
+* Function  : clear_list
+*
+* Purpose   : Empty a list but keep its memory for reuse.
+*
+* Inputs    : LIST *list - the list
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : clear_list(&worker->files);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void clear_list(LIST *list)
+{
+	list->count = 0;
+	list->names_used = 0;
+	list->num_dirs = 0;
+	list->num_devices = 0;
+	list->last_device = 0;
+
+	return;
+} /* end of clear_list */
+
+/*********************************************************************
+*
+* Function  : free_list
+*
+* Purpose   : Free the memory of a list.
+*
+* Inputs    : LIST *list - the list
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : free_list(&Files);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void free_list(LIST *list)
+{
+	free(list->sizes);
+	free(list->mtimes);
+	free(list->inodes);
+	free(list->nlinks);
+	free(list->uids);
+	free(list->gids);
+	free(list->name_offsets);
+	free(list->dir_indexes);
+	free(list->modes);
+	free(list->device_indexes);
+	free(list->names);
+	free(list->dirs);
+	free(list->devices);
+	free(list->order);
+	memset(list,0,sizeof(LIST));
+
+	return;
+} /* end of free_list */
+
+/*********************************************************************
+*
+* Function  : reverse_list
+*
+* Purpose   : Reverse the order of the elements in the list of files
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : reverse_list();
+*
+* Notes     : Only the display order is changed.
+*
+*********************************************************************/
+
+void reverse_list()
+{
+	int		tmp , low , high;
+
+	low = 0;
+	high = Files.count - 1;
+	for ( ; low < high ; ++low , --high ) {
+		tmp = Files.order[low];
+		Files.order[low] = Files.order[high];
+		Files.order[high] = tmp;
+	} /* FOR */
+
+	return;
+} /* end of reverse_list */
+
+/*********************************************************************
+*
+* Function  : compare_name_keys
+*
+* Purpose   : Compare two entries for the sort by name.
+*
+* Inputs    : NAMEKEY *key1 - key of the first entry
+*             NAMEKEY *key2 - key of the second entry
+*             char **collation_keys - the collation keys for
+*                                     '--locale-sort' , else NULL
+*
+* Output    : (none)
+*
+* Returns   : <0 , 0 , >0 as for strcmp()
+*
+* Example   : result = compare_name_keys(&src[i],&src[j],collation_keys);
+*
+* Notes     : The full strings are only compared when the packed keys
+*             are equal.
+*
+*********************************************************************/
+
+int compare_name_keys(NAMEKEY *key1, NAMEKEY *key2, char **collation_keys)
+{
+	if ( key1->high != key2->high ) {
+		return( key1->high < key2->high ? -1 : 1 );
+	} /* IF */
+	if ( key1->low != key2->low ) {
+		return( key1->low < key2->low ? -1 : 1 );
+	} /* IF */
+	if ( collation_keys != NULL ) {
+		return( strcmp(collation_keys[key1->index],collation_keys[key2->index]) );
+	} /* IF */
+
+	return( compare_filenames(&Files,key1->index,key2->index) );
+} /* end of compare_name_keys */
+
+/*********************************************************************
+*
+* Function  : sort_list_by_name
+*
+* Purpose   : Sort the list of files based on name.
+*
+* Inputs    : int direction - 1 for ascending , -1 for descending
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sort_list_by_name(opt_r ? -1 : 1);
+*
+* Notes     : Bottom-up merge sort of the display order , entries with
+*             equal names keep the order in which they were found. Each
+*             entry carries the NAME_KEY_BYTES bytes of its path which
+*             follow the start shared by every path , so most
+*             comparisons are two integer compares on keys held next to
+*             each other. For '--locale-sort' the keys come from the
+*             strxfrm() form of the path instead.
+*
+*********************************************************************/
+
+void sort_list_by_name(int direction)
+{
+	NAMEKEY	*src , *dest , *tmp;
+	const unsigned char	*parts[3];
+	char	**collation_keys;
+	int		lengths[3] , num_parts , offset;
+	int		width , left , middle , right , i , j , k , count;
+
+	count = Files.count;
+	if ( count < 2 ) {
+		return;
+	} /* IF */
+	src = (NAMEKEY *)malloc(2 * count * sizeof(NAMEKEY));
+	if ( src == NULL ) {
+		quit(1,"malloc failed for sort keys");
+	} /* IF */
+	dest = &src[count];
+
+	collation_keys = NULL;
+	offset = 0;
+	if ( opt_locale_sort ) {
+		collation_keys = build_collation_keys(&Files);
+	} /* IF */
+	else {
+		offset = common_path_length(&Files);
+	} /* ELSE */
+	for ( i = 0 ; i < count ; ++i ) {
+		src[i].index = Files.order[i];
+		if ( collation_keys != NULL ) {
+			parts[0] = (const unsigned char *)collation_keys[src[i].index];
+			lengths[0] = NAME_LENGTH(collation_keys[src[i].index]);
+			num_parts = 1;
+		} /* IF */
+		else {
+			num_parts = get_path_parts(&Files,src[i].index,parts,lengths);
+		} /* ELSE */
+		pack_name_key(&src[i],parts,lengths,num_parts,offset);
+	} /* FOR */
+
+	for ( width = 1 ; width < count ; width *= 2 ) {
+		for ( left = 0 ; left < count ; left += 2 * width ) {
+			middle = (left + width < count) ? left + width : count;
+			right = (left + 2 * width < count) ? left + 2 * width : count;
+			i = left;
+			j = middle;
+			for ( k = left ; k < right ; ++k ) {
+				if ( i < middle && (j >= right ||
+						direction * compare_name_keys(&src[i],&src[j],collation_keys) <= 0) ) {
+					dest[k] = src[i++];
+				} /* IF */
+				else {
+					dest[k] = src[j++];
+				} /* ELSE */
+			} /* FOR */
+		} /* FOR each pair of runs */
+		tmp = src;
+		src = dest;
+		dest = tmp;
+	} /* FOR each run width */
+
+	for ( i = 0 ; i < count ; ++i ) {
+		Files.order[i] = src[i].index;
+	} /* FOR */
+	free(src < dest ? src : dest);
+	free(collation_keys);
+
+	return;
+} /* end of sort_list_by_name */
+
+/*********************************************************************
+*
+* Function  : sort_list_by_key
+*
+* Purpose   : Sort the list of files based on an integer key.
+*
+* Inputs    : int key_type - SORT_BY_SIZE or SORT_BY_TIME
+*             int direction - 1 for ascending , -1 for descending
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sort_list_by_key(SORT_BY_SIZE,1);
+*
+* Notes     : LSD radix sort of (key , index) pairs taken from the size
+*             or mtime column , one byte per pass. Passes over a byte
+*             which is the same for every entry are skipped. Radix sort
+*             is stable so entries with equal keys keep the order in
+*             which they were found, a descending sort is done by
+*             complementing the keys.
+*
+*********************************************************************/
+
+void sort_list_by_key(int key_type, int direction)
+{
+	SORTKEY	*src , *dest , *tmp;
+	size_t	counts[256] , offset , n;
+	unsigned long long	key , all_and , all_or;
+	long long	*column;
+	int		i , count , shift;
+
+	count = Files.count;
+	if ( count < 2 ) {
+		return;
+	} /* IF */
+	src = (SORTKEY *)malloc(2 * count * sizeof(SORTKEY));
+	if ( src == NULL ) {
+		quit(1,"malloc failed for sort keys");
+	} /* IF */
+	dest = &src[count];
+	column = (key_type == SORT_BY_SIZE) ? Files.sizes : Files.mtimes;
+
+	all_and = ~0ULL;
+	all_or = 0;
+	for ( i = 0 ; i < count ; ++i ) {
+		key = (unsigned long long)column[Files.order[i]];
+		key ^= 1ULL << 63;	/* signed order becomes unsigned order */
+		if ( direction < 0 ) {
+			key = ~key;
+		} /* IF */
+		src[i].key = key;
+		src[i].index = Files.order[i];
+		all_and &= key;
+		all_or |= key;
+	} /* FOR */
+
+	for ( shift = 0 ; shift < 64 ; shift += 8 ) {
+		if ( ((all_and ^ all_or) >> shift & 0xff) == 0 ) {
+			continue;
+		} /* IF every key has the same byte here */
+		memset(counts,0,sizeof(counts));
+		for ( i = 0 ; i < count ; ++i ) {
+			counts[src[i].key >> shift & 0xff] += 1;
+		} /* FOR */
+		offset = 0;
+		for ( i = 0 ; i < 256 ; ++i ) {
+			n = counts[i];
+			counts[i] = offset;
+			offset += n;
+		} /* FOR */
+		for ( i = 0 ; i < count ; ++i ) {
+			dest[counts[src[i].key >> shift & 0xff]++] = src[i];
+		} /* FOR */
+		tmp = src;
+		src = dest;
+		dest = tmp;
+	} /* FOR each byte of the key */
+
+	for ( i = 0 ; i < count ; ++i ) {
+		Files.order[i] = src[i].index;
+	} /* FOR */
+	free(src < dest ? src : dest);
+
+	return;
+} /* end of sort_list_by_key */
+
+/*********************************************************************
+*
+* Function  : sort_file_list
+*
+* Purpose   : Sort the list of files according to the options.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sort_file_list();
+*
+* Notes     : The result is the display order in Files.order , the
+*             entries themselves are not moved. The 'r' option is
+*             applied here by reversing the sense of the comparison.
+*             '--top' shows the largest or newest entries first.
+*             With 'n' the entries are left in the order in which they
+*             were found.
+*
+*********************************************************************/
+
+void sort_file_list()
+{
+	int		direction , index;
+	clock_t	start;
+	double	seconds;
+
+	Files.order = (int *)grow_column(Files.order,Files.count > 0 ? Files.count : 1,sizeof(int));
+	for ( index = 0 ; index < Files.count ; ++index ) {
+		Files.order[index] = index;
+	} /* FOR */
+
+	direction = opt_r ? -1 : 1;
+	if ( opt_top ) {
+		direction = -direction;
+	} /* IF largest or newest first */
+	start = clock();
+	if ( opt_n ) {
+		if ( opt_r ) {
+			reverse_list();
+		} /* IF */
+	} else if ( opt_t ) {
+		sort_list_by_key(SORT_BY_TIME,direction);
+	} else if ( opt_s ) {
+		sort_list_by_key(SORT_BY_SIZE,direction);
+	} else {
+		sort_list_by_name(direction);
+	} /* ELSE */
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	debug_print("sorted %d entries in %.6f seconds (%.0f entries/sec)\n",
+			Files.count,seconds,seconds > 0 ? Files.count / seconds : 0.0);
+
+	return;
+} /* end of sort_file_list */
+
+/*********************************************************************
+*
+* Function  : compare_top_seqs
+*
+* Purpose   : Compare two entries of the list by when they were found.
+*
+* Inputs    : const void *ptr1 - ptr to the list index of the first entry
+*             const void *ptr2 - ptr to the list index of the second entry
+*
+* Output    : (none)
+*
+* Returns   : negative , zero or positive (ala strcmp)
+*
+* Example   : qsort(slots,count,sizeof(int),compare_top_seqs);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int compare_top_seqs(const void *ptr1, const void *ptr2)
+{
+	long long	seq1 , seq2;
+
+	seq1 = Top.seqs[*(const int *)ptr1];
+	seq2 = Top.seqs[*(const int *)ptr2];
+
+	return( (seq1 > seq2) - (seq1 < seq2) );
+} /* end of compare_top_seqs */
+
+/*********************************************************************
+*
+* Function  : top_shown_after
+*
+* Purpose   : Compare two entries of the list for '--top'.
+*
+* Inputs    : int slot1 - index of the first entry in the list
+*             int slot2 - index of the second entry in the list
+*
+* Output    : (none)
+*
+* Returns   : nonzero if slot1 is shown after slot2
+*
+* Example   : if ( top_shown_after(Top.heap[child],Top.heap[parent]) ) {
+*
+* Notes     : The largest (newest) entries are shown first , the
+*             smallest (oldest) for 'r'. Equal keys are shown in the
+*             order in which they were found.
+*
+*********************************************************************/
+
+int top_shown_after(int slot1, int slot2)
+{
+	long long	*column;
+
+	column = opt_t ? Files.mtimes : Files.sizes;
+	if ( column[slot1] != column[slot2] ) {
+		return( opt_r ? column[slot1] > column[slot2] : column[slot1] < column[slot2] );
+	} /* IF */
+
+	return( Top.seqs[slot1] > Top.seqs[slot2] );
+} /* end of top_shown_after */
+
+/*********************************************************************
+*
+* Function  : sift_top_heap
+*
+* Purpose   : Restore the heap order after an entry has been changed.
+*
+* Inputs    : int position - position of the changed entry in the heap
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sift_top_heap(0);
+*
+* Notes     : The heap holds list indexes with the entry which would
+*             be shown last on top , that is the one to be dropped
+*             first. The entry is moved up and then down as needed.
+*
+*********************************************************************/
+
+void sift_top_heap(int position)
+{
+	int		*heap , slot , parent , child;
+
+	heap = Top.heap;
+	slot = heap[position];
+	for ( ; position > 0 ; position = parent ) {
+		parent = (position - 1) / 2;
+		if ( ! top_shown_after(slot,heap[parent]) ) {
+			break;
+		} /* IF */
+		heap[position] = heap[parent];
+	} /* FOR */
+	for ( ; (child = 2 * position + 1) < Top.count ; position = child ) {
+		if ( child + 1 < Top.count && top_shown_after(heap[child+1],heap[child]) ) {
+			child += 1;
+		} /* IF */
+		if ( ! top_shown_after(heap[child],slot) ) {
+			break;
+		} /* IF */
+		heap[position] = heap[child];
+	} /* FOR */
+	heap[position] = slot;
+
+	return;
+} /* end of sift_top_heap */
+
+/*********************************************************************
+*
+* Function  : compact_top_list
+*
+* Purpose   : Rebuild the list of files kept for '--top'.
+*
+* Inputs    : int found_order - nonzero to put the entries in the order
+*                               in which they were found
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : compact_top_list(0);
+*
+* Notes     : Replacing entries leaves unused names and directories in
+*             the list , copying the entries drops them. Without
+*             found_order the entries keep their indexes , so the heap
+*             is still valid. With found_order the heap is discarded
+*             and the stable sort sees the entries in traversal order.
+*
+*********************************************************************/
+
+void compact_top_list(int found_order)
+{
+	LIST	fresh;
+	int		*slots , index , slot , count;
+	long long	*seqs;
+
+	count = Files.count;
+	slots = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+	seqs = (long long *)malloc((count > 0 ? count : 1) * sizeof(long long));
+	if ( slots == NULL || seqs == NULL ) {
+		quit(1,"malloc failed for %d top entries",count);
+	} /* IF */
+	for ( index = 0 ; index < count ; ++index ) {
+		slots[index] = index;
+	} /* FOR */
+	if ( found_order ) {
+		qsort(slots,count,sizeof(int),compare_top_seqs);
+		Top.count = 0;
+	} /* IF */
+
+	memset(&fresh,0,sizeof(fresh));
+	for ( index = 0 ; index < count ; ++index ) {
+		slot = slots[index];
+		copy_list_entry(&fresh,&Files,slot);
+		seqs[index] = Top.seqs[slot];
+	} /* FOR */
+	free_list(&Files);
+	Files = fresh;
+	memcpy(Top.seqs,seqs,count * sizeof(long long));
+	Top.garbage = 0;
+	Top.num_compactions += 1;
+	free(slots);
+	free(seqs);
+
+	return;
+} /* end of compact_top_list */
+
+/*********************************************************************
+*
+* Function  : add_top_entry
+*
+* Purpose   : Offer a file to the list of files kept for '--top'.
+*
+* Inputs    : DIRINFO *dir - directory containing the file
+*             char *filename - name of file within the directory
+*             int name_length - length of the name
+*             ENTRYINFO *info - the metadata for the file
+*
+* Output    : (none)
+*
+* Returns   : index of the entry , -1 if it was dropped
+*
+* Example   : index = add_top_entry(dir,filename,name_length,&info);
+*
+* Notes     : Only the best opt_top entries are kept in the list. Once
+*             it is full a new entry replaces the worst one if it would
+*             be shown before it , which it can not on a tie since it
+*             was found later.
+*
+*********************************************************************/
+
+int add_top_entry(DIRINFO *dir, char *filename, int name_length, ENTRYINFO *info)
+{
+	int		slot;
+	long long	key , worst;
+
+	if ( Top.heap == NULL ) {
+		Top.heap = (int *)malloc(opt_top * sizeof(int));
+		Top.seqs = (long long *)malloc(opt_top * sizeof(long long));
+		if ( Top.heap == NULL || Top.seqs == NULL ) {
+			quit(1,"malloc failed for %d top entries",opt_top);
+		} /* IF */
+	} /* IF */
+	Top.num_seen += 1;
+
+	if ( Files.count < opt_top ) {
+		slot = add_entry_to_list(&Files,dir,filename,name_length,info);
+		Top.seqs[slot] = Top.num_seen;
+		Top.heap[Top.count] = slot;
+		sift_top_heap(Top.count++);
+		return(slot);
+	} /* IF list is not full yet */
+
+	slot = Top.heap[0];
+	key = opt_t ? info->mtime : info->size;
+	worst = opt_t ? Files.mtimes[slot] : Files.sizes[slot];
+	if ( opt_r ? key >= worst : key <= worst ) {
+		return(-1);
+	} /* IF */
+	Top.garbage += sizeof(unsigned int) + NAME_LENGTH(FILE_NAME(&Files,slot)) + 1;
+	store_list_entry(&Files,slot,dir,filename,name_length,info);
+	Top.seqs[slot] = Top.num_seen;
+	sift_top_heap(0);
+	if ( Top.garbage > Files.names_used / 2 + 64 * 1024 || Files.num_dirs > 2 * Files.count + 1024 ) {
+		compact_top_list(0);
+	} /* IF */
+
+	return(slot);
+} /* end of add_top_entry */
+
+/*********************************************************************
+*
+* Function  : finish_top_list
+*
+* Purpose   : Prepare the list of files kept for '--top' for sorting.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : finish_top_list();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void finish_top_list()
+{
+	if ( Top.heap == NULL ) {
+		return;
+	} /* IF nothing was found */
+	compact_top_list(1);
+	debug_print("--top %d : kept %d of %lld entries , %ld compactions\n",
+			opt_top,Files.count,Top.num_seen,Top.num_compactions);
+	free(Top.heap);
+	free(Top.seqs);
+	memset(&Top,0,sizeof(Top));
+
+	return;
+} /* end of finish_top_list */
+
+/*********************************************************************
+*
+* Function  : add_to_totals
+*
+* Purpose   : Add a file to the totals of its directory for '--du'.
+*
+* Inputs    : DIRINFO *dir - directory containing the file
+*             char *filename - name of file within the directory
+*             struct _stat *filestats - ptr to stat structure
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_to_totals(dir,filename,&filestats);
+*
+* Notes     : A directory is counted through its own "." entry. Every
+*             file is only counted the first time it is seen , whether
+*             it is seen again through a hard link or through a symbolic
+*             link followed by the walk. A file named on the command
+*             line gets totals of its own.
+*
+*********************************************************************/
+
+void add_to_totals(DIRINFO *dir, char *filename, struct _stat *filestats)
+{
+	int		is_dir;
+
+	is_dir = _S_ISDIR(filestats->st_mode & _S_IFMT);
+	if ( dir == &NoDir ) {
+		dir = new_dirinfo(NULL,filename);
+	} /* IF command line file */
+	else if ( EQ(filename,"..") || (is_dir && NE(filename,".")) ) {
+		return;
+	} /* ELSE IF not counted here */
+	if ( ! add_to_inode_set(&Links,filestats->st_dev,filestats->st_ino) ) {
+		atomic_fetch_add(&num_links_skipped,1);
+		return;
+	} /* IF already counted */
+
+	dir->totals->bytes += filestats->st_size;
+	dir->totals->blocks += filestats->st_blocks;
+	dir->totals->files += ! is_dir;
+
+	return;
+} /* end of add_to_totals */
+
+/*********************************************************************
+*
+* Function  : add_file_to_list
+*
+* Purpose   : Add a new entry to the list of files.
+*
+* Inputs    : DIRINFO *dir - directory containing the file
+*             char *filename - name of file within the directory
+*             struct _stat *filestats - ptr to stat structure
+*
+* Output    : (none)
+*
+* Returns   : index of the new entry , -1 if dropped for '--top' or
+*             '--min-depth' , only counted for '--du' or already moved
+*             to a run file for '--max-memory'
+*
+* Example   : index = add_file_to_list(dir,filename,&filestats);
+*
+* Notes     : The list is put in order by sort_file_list() , for 'U'
+*             the entries held so far are shown when the list is full.
+*             For '--max-memory' a list which has reached the limit is
+*             sorted and moved to a run file.
+*
+*********************************************************************/
+
+int add_file_to_list(DIRINFO *dir, char *filename, struct _stat *filestats)
+{
+	ENTRYINFO	info;
+	int		index;
+
+	if ( opt_du ) {
+		add_to_totals(dir,filename,filestats);
+		return(-1);
+	} /* IF */
+	if ( dir->depth + 1 < opt_min_depth ) {
+		return(-1);
+	} /* IF above '--min-depth' */
+	if ( opt_D ) {
+		debug_print("add_file_to_list(%s)\n",build_path(dir,filename));
+	} /* IF */
+
+	if ( opt_U && current_list->count >= STREAM_BATCH_SIZE ) {
+		stream_files();
+	} /* IF */
+	if ( opt_top && current_list == &Files ) {
+		stat_to_info(filestats,&info);
+		return( add_top_entry(dir,filename,strlen(filename),&info) );
+	} /* IF */
+	index = append_file_to_list(dir,filename,filestats);
+	if ( opt_max_memory > 0 && opt_U == 0 && current_list == &Files &&
+				LIST_MEMORY(&Files) >= opt_max_memory ) {
+		spill_run();
+		index = -1;
+	} /* IF the list has outgrown '--max-memory' */
+
+	return(index);
+} /* end of add_file_to_list */
+
+/*********************************************************************
+*
+* Function  : open_dir_reader
+*
+* Purpose   : Open a directory for reading its entries in batches.
+*
+* Inputs    : DIRREADER *reader - the reader to be initialized
+*             int parent_fd - descriptor of the directory containing
+*                             dirname
+*             char *dirname - name of directory
+*
+* Output    : (none)
+*
+* Returns   : descriptor for the directory , -1 on failure
+*
+* Example   : dir_fd = open_dir_reader(&reader,AT_FDCWD,dirname);
+*
+* Notes     : Under Linux the entries are read with getdents64 into a
+*             256 KiB buffer which is shared by all readers in a thread.
+*             A reader must be done with its entries before the next one
+*             in the same thread is read.
+*
+*********************************************************************/
+
+int open_dir_reader(DIRREADER *reader, int parent_fd, char *dirname)
+{
+	reader->num_reads = 0;
+	reader->num_entries = 0;
+	reader->fd = openat(parent_fd,dirname,O_RDONLY | O_DIRECTORY);
+	if ( reader->fd < 0 ) {
+		return(-1);
+	} /* IF */
+#ifdef	__linux__
+	reader->position = 0;
+	reader->length = 0;
+	if ( dir_buffer == NULL ) {
+		dir_buffer = (char *)malloc(DIR_BUFFER_SIZE);
+		if ( dir_buffer == NULL ) {
+			quit(1,"malloc failed for directory buffer");
+		} /* IF */
+	} /* IF */
+#else
+	reader->dirptr = fdopendir(reader->fd);
+	if ( reader->dirptr == NULL ) {
+		close(reader->fd);
+		return(-1);
+	} /* IF */
+#endif
+
+	return(reader->fd);
+} /* end of open_dir_reader */
+
+/*********************************************************************
+*
+* Function  : read_dir_entry
+*
+* Purpose   : Get the next entry from a directory.
+*
+* Inputs    : DIRREADER *reader - the reader for the directory
+*             unsigned char *type - to receive the d_type of the entry
+*
+* Output    : (none)
+*
+* Returns   : name of the entry , NULL when there are no more
+*
+* Example   : name = read_dir_entry(&reader,&type);
+*
+* Notes     : The name is only valid until the next batch is read.
+*
+*********************************************************************/
+
+char *read_dir_entry(DIRREADER *reader, unsigned char *type)
+{
+#ifdef	__linux__
+	DIRENT64	*entry;
+	long	count;
+
+	if ( reader->position >= reader->length ) {
+		count = syscall(SYS_getdents64,reader->fd,dir_buffer,DIR_BUFFER_SIZE);
+		reader->num_reads += 1;
+		if ( count < 0 ) {
+			system_error("getdents64 failed");
+		} /* IF */
+		if ( count <= 0 ) {
+			return(NULL);
+		} /* IF */
+		reader->position = 0;
+		reader->length = count;
+	} /* IF buffer is empty */
+	entry = (DIRENT64 *)&dir_buffer[reader->position];
+	reader->position += entry->d_reclen;
+	reader->num_entries += 1;
+	*type = entry->d_type;
+
+	return(entry->d_name);
+#else
+	struct _dirent	*entry;
+
+	entry = _readdir(reader->dirptr);
+	if ( entry == NULL ) {
+		return(NULL);
+	} /* IF */
+	reader->num_entries += 1;
+#ifdef	DT_UNKNOWN
+	*type = entry->d_type;
+#else
+	*type = 0;
+#endif
+
+	return(entry->d_name);
+#endif
+} /* end of read_dir_entry */
+
+/*********************************************************************
+*
+* Function  : close_dir_reader
+*
+* Purpose   : Close a directory opened by open_dir_reader.
+*
+* Inputs    : DIRREADER *reader - the reader for the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : close_dir_reader(&reader);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void close_dir_reader(DIRREADER *reader)
+{
+#ifdef	__linux__
+	close(reader->fd);
+#else
+	_closedir(reader->dirptr);
+#endif
+	reader->fd = -1;
+
+	return;
+} /* end of close_dir_reader */
+
+/*********************************************************************
+*
+* Function  : new_stat_batch
+*
+* Purpose   : Create an empty stat batch.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : STATBATCH *batch - the batch
+*
+* Example   : batch = new_stat_batch();
+*
+* Notes     : The engine is left for the caller to fill in.
+*
+*********************************************************************/
+
+STATBATCH *new_stat_batch()
+{
+	STATBATCH	*batch;
+
+	batch = (STATBATCH *)calloc(1,sizeof(STATBATCH));
+	if ( batch == NULL ) {
+		quit(1,"calloc failed for STATBATCH");
+	} /* IF */
+	batch->names_size = STAT_BATCH_SIZE * 32;
+	batch->names = (char *)malloc(batch->names_size);
+	if ( batch->names == NULL ) {
+		quit(1,"malloc failed for stat batch names");
+	} /* IF */
+
+	return(batch);
+} /* end of new_stat_batch */
+
+/*********************************************************************
+*
+* Function  : get_stat_batch
+*
+* Purpose   : Get the stat batch of the current thread.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : STATBATCH *batch - the batch
+*
+* Example   : batch = get_stat_batch();
+*
+* Notes     : The batch and its engine are created on first use.
+*
+*********************************************************************/
+
+STATBATCH *get_stat_batch()
+{
+	if ( thread_stat_batch == NULL ) {
+		thread_stat_batch = new_stat_batch();
+		thread_stat_batch->engine = (STATENGINE *)calloc(1,sizeof(STATENGINE));
+		if ( thread_stat_batch->engine == NULL ) {
+			quit(1,"calloc failed for STATENGINE");
+		} /* IF */
+	} /* IF */
+
+	return(thread_stat_batch);
+} /* end of get_stat_batch */
+
+/*********************************************************************
+*
+* Function  : add_to_stat_batch
+*
+* Purpose   : Add a directory entry to a stat batch.
+*
+* Inputs    : STATBATCH *batch - the batch
+*             char *name - name of the entry
+*             unsigned char type - d_type of the entry
+*             int need_stat - 1 if the entry has to be stat'ed
+*             int verdict - result of the filter before the stat
+*
+* Output    : (none)
+*
+* Returns   : 1 if the batch is now full , 0 if not
+*
+* Example   : full = add_to_stat_batch(batch,name,type,need_stat,verdict);
+*
+* Notes     : The name is copied since the directory buffer it is in
+*             may be refilled before the batch is done.
+*
+*********************************************************************/
+
+int add_to_stat_batch(STATBATCH *batch, char *name, unsigned char type, int need_stat, int verdict)
+{
+	BATCHENTRY	*entry;
+	int		length;
+
+	length = strlen(name) + 1;
+	if ( batch->names_used + length > batch->names_size ) {
+		batch->names_size = 2 * (batch->names_used + length);
+		batch->names = (char *)realloc(batch->names,batch->names_size);
+		if ( batch->names == NULL ) {
+			quit(1,"realloc failed for stat batch names");
+		} /* IF */
+	} /* IF */
+	entry = &batch->entries[batch->count++];
+	entry->name_offset = batch->names_used;
+	entry->type = type;
+	entry->need_stat = need_stat;
+	entry->verdict = verdict;
+	entry->status = 0;
+	memcpy(&batch->names[batch->names_used],name,length);
+	batch->names_used += length;
+
+	return( batch->count >= STAT_BATCH_SIZE );
+} /* end of add_to_stat_batch */
+
+#ifdef	USE_IO_URING
+/*********************************************************************
+*
+* Function  : stat_mask
+*
+* Purpose   : Determine which statx fields are needed.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : the STATX_xxx mask
+*
+* Example   : mask = stat_mask();
+*
+* Notes     : Only the fields used for sorting and display are asked
+*             for so that the filesystem can skip the others.
+*
+*********************************************************************/
+
+unsigned stat_mask()
+{
+	unsigned	mask;
+
+	mask = STATX_TYPE | STATX_MODE;
+	if ( opt_1 == 0 ) {
+		mask |= STATX_NLINK | STATX_SIZE | STATX_MTIME;
+	} /* IF long listing */
+	if ( opt_s ) {
+		mask |= STATX_SIZE;
+	} /* IF */
+	if ( opt_t ) {
+		mask |= STATX_MTIME;
+	} /* IF */
+	if ( Filter != NULL && Filter->needs_stat ) {
+		mask |= STATX_SIZE | STATX_MTIME;
+	} /* IF the filter tests them */
+	if ( opt_du ) {
+		mask |= STATX_NLINK | STATX_SIZE | STATX_BLOCKS | STATX_INO;
+	} /* IF */
+	if ( opt_1 == 0 && (opt_o || opt_g) ) {
+		mask |= STATX_UID | STATX_GID;
+	} /* IF */
+
+	return(mask);
+} /* end of stat_mask */
+
+/*********************************************************************
+*
+* Function  : uring_init
+*
+* Purpose   : Set up an io_uring instance.
+*
+* Inputs    : URING *ring - the ring to be set up
+*             unsigned entries - number of submission queue entries
+*
+* Output    : (none)
+*
+* Returns   : 0 if successful , -1 if io_uring is unavailable
+*
+* Example   : status = uring_init(&ring,URING_ENTRIES);
+*
+* Notes     : The rings are mapped directly , liburing is not needed.
+*             A kernel which may drop completions when the completion
+*             queue overflows (no IORING_FEAT_NODROP) is not used.
+*
+*********************************************************************/
+
+int uring_init(URING *ring, unsigned entries)
+{
+	struct io_uring_params	params;
+	size_t	sq_size , cq_size , sqes_size;
+	char	*sq_ptr , *cq_ptr;
+
+	memset(&params,0,sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup,entries,&params);
+	if ( ring->fd < 0 ) {
+		return(-1);
+	} /* IF */
+	if ( (params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_NODROP) == 0 ) {
+		close(ring->fd);
+		errno = ENOSYS;
+		return(-1);
+	} /* IF kernel is too old to be worth supporting */
+
+	sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if ( cq_size > sq_size ) {
+		sq_size = cq_size;
+	} /* IF */
+	sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	sq_ptr = (char *)mmap(NULL,sq_size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,
+					ring->fd,IORING_OFF_SQ_RING);
+	if ( sq_ptr == MAP_FAILED ) {
+		close(ring->fd);
+		return(-1);
+	} /* IF */
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL,sqes_size,PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE,ring->fd,IORING_OFF_SQES);
+	if ( ring->sqes == MAP_FAILED ) {
+		munmap(sq_ptr,sq_size);
+		close(ring->fd);
+		return(-1);
+	} /* IF */
+	cq_ptr = sq_ptr;
+
+	ring->sq_head = (unsigned *)(sq_ptr + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq_ptr + params.sq_off.tail);
+	ring->sq_mask = *(unsigned *)(sq_ptr + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq_ptr + params.sq_off.array);
+	ring->sq_entries = params.sq_entries;
+	ring->cq_head = (unsigned *)(cq_ptr + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq_ptr + params.cq_off.tail);
+	ring->cq_mask = *(unsigned *)(cq_ptr + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+	ring->max_in_flight = (params.sq_entries < params.cq_entries) ? params.sq_entries : params.cq_entries;
+
+	return(0);
+} /* end of uring_init */
+
+/*********************************************************************
+*
+* Function  : statx_to_stat
+*
+* Purpose   : Copy the fields of a statx structure to a stat structure.
+*
+* Inputs    : struct statx *statxbuf - the statx data
+*             struct _stat *filestats - to receive the data
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : statx_to_stat(&entry->statxbuf,&entry->filestats);
+*
+* Notes     : Fields which were not asked for are left as zero.
+*
+*********************************************************************/
+
+void statx_to_stat(struct statx *statxbuf, struct _stat *filestats)
+{
+	unsigned	mask;
+
+	mask = statxbuf->stx_mask;
+	memset(filestats,0,sizeof(struct _stat));
+	filestats->st_mode = statxbuf->stx_mode;
+	filestats->st_ino = statxbuf->stx_ino;
+	filestats->st_dev = makedev(statxbuf->stx_dev_major,statxbuf->stx_dev_minor);
+	if ( mask & STATX_NLINK ) {
+		filestats->st_nlink = statxbuf->stx_nlink;
+	} /* IF */
+	if ( mask & STATX_SIZE ) {
+		filestats->st_size = statxbuf->stx_size;
+	} /* IF */
+	if ( mask & STATX_BLOCKS ) {
+		filestats->st_blocks = statxbuf->stx_blocks;
+	} /* IF */
+	if ( mask & STATX_MTIME ) {
+		filestats->st_mtim.tv_sec = statxbuf->stx_mtime.tv_sec;
+		filestats->st_mtim.tv_nsec = statxbuf->stx_mtime.tv_nsec;
+	} /* IF */
+	if ( mask & STATX_UID ) {
+		filestats->st_uid = statxbuf->stx_uid;
+	} /* IF */
+	if ( mask & STATX_GID ) {
+		filestats->st_gid = statxbuf->stx_gid;
+	} /* IF */
+
+	return;
+} /* end of statx_to_stat */
+
+/*********************************************************************
+*
+* Function  : uring_stat_batch
+*
+* Purpose   : Stat the entries of a batch through io_uring.
+*
+* Inputs    : STATBATCH *batch - the batch
+*             int dir_fd - descriptor for the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : uring_stat_batch(batch,dir_fd);
+*
+* Notes     : The ring is kept as full as possible and completions are
+*             reaped in whatever order they arrive. No more requests are
+*             queued than the completion queue can hold , counting those
+*             still in flight. Requests the kernel did not take , after
+*             a short submit or EINTR , are submitted again on the next
+*             call.
+*
+*********************************************************************/
+
+void uring_stat_batch(STATBATCH *batch, int dir_fd)
+{
+	URING	*ring;
+	BATCHENTRY	*entry;
+	struct io_uring_sqe	*sqe;
+	struct io_uring_cqe	*cqe;
+	unsigned	tail , head , mask;
+	int		next , in_flight , to_submit , max_in_flight , result;
+
+	ring = &batch->engine->ring;
+	mask = stat_mask();
+	next = 0;
+	in_flight = 0;
+	max_in_flight = 0;
+	for ( ; ; ) {
+		tail = *ring->sq_tail;
+		head = __atomic_load_n(ring->sq_head,__ATOMIC_ACQUIRE);
+		for ( ; next < batch->count && tail - head < ring->sq_entries &&
+					(unsigned)in_flight < ring->max_in_flight ; ++next ) {
+			entry = &batch->entries[next];
+			if ( entry->need_stat != STAT_NEEDED ) {
+				continue;
+			} /* IF */
+			sqe = &ring->sqes[tail & ring->sq_mask];
+			memset(sqe,0,sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = dir_fd;
+			sqe->addr = (unsigned long)&batch->names[entry->name_offset];
+			sqe->len = mask;
+			sqe->off = (unsigned long)&entry->statxbuf;
+			sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+			sqe->user_data = next;
+			ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+			tail += 1;
+			in_flight += 1;
+		} /* FOR */
+		__atomic_store_n(ring->sq_tail,tail,__ATOMIC_RELEASE);
+		to_submit = tail - head;			/* with any left over by the last call */
+		if ( in_flight > max_in_flight ) {
+			max_in_flight = in_flight;
+		} /* IF */
+		if ( in_flight == 0 ) {
+			break;
+		} /* IF everything is done */
+
+		result = syscall(__NR_io_uring_enter,ring->fd,to_submit,1,IORING_ENTER_GETEVENTS,NULL,0);
+		batch->engine->num_calls += 1;
+		if ( result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY ) {
+			quit(1,"io_uring_enter failed");
+		} /* IF */
+
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE);
+		for ( ; head != tail ; ++head ) {
+			cqe = &ring->cqes[head & ring->cq_mask];
+			entry = &batch->entries[cqe->user_data];
+			if ( cqe->res < 0 ) {
+				entry->status = -cqe->res;
+			} /* IF */
+			else {
+				statx_to_stat(&entry->statxbuf,&entry->filestats);
+			} /* ELSE */
+			in_flight -= 1;
+			batch->engine->num_stats += 1;
+		} /* FOR each completion */
+		__atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+	} /* FOR */
+	debug_print("uring_stat_batch() : %d entries , at most %d stats in flight\n",
+			batch->count,max_in_flight);
+
+	return;
+} /* end of uring_stat_batch */
+#endif
+
+/*********************************************************************
+*
+* Function  : run_pool_stats
+*
+* Purpose   : Stat entries of the current pool batch until there are
+*             none left.
+*
+* Inputs    : STATPOOL *pool - the pool
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : run_pool_stats(pool);
+*
+* Notes     : Run by the pool threads and by the thread which owns the
+*             batch.
+*
+*********************************************************************/
+
+void run_pool_stats(STATPOOL *pool)
+{
+	BATCHENTRY	*entry;
+	int		index;
+
+	for ( ; ; ) {
+		index = atomic_fetch_add(&pool->next,1);
+		if ( index >= pool->count ) {
+			break;
+		} /* IF */
+		entry = &pool->batch->entries[index];
+		if ( entry->need_stat == STAT_NEEDED &&
+				fstatat(pool->dir_fd,&pool->batch->names[entry->name_offset],&entry->filestats,0) < 0 ) {
+			entry->status = errno;
+		} /* IF */
+	} /* FOR */
+
+	return;
+} /* end of run_pool_stats */
+
+/*********************************************************************
+*
+* Function  : stat_pool_thread
+*
+* Purpose   : Thread function for the stat pool.
+*
+* Inputs    : void *arg - ptr to the STATPOOL
+*
+* Output    : (none)
+*
+* Returns   : NULL (never returns)
+*
+* Example   : pthread_create(&thread,NULL,stat_pool_thread,pool);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void *stat_pool_thread(void *arg)
+{
+	STATPOOL	*pool;
+	unsigned	seen;
+
+	pool = (STATPOOL *)arg;
+	pthread_mutex_lock(&pool->lock);
+	seen = pool->generation;
+	for ( ; ; ) {
+		while ( pool->generation == seen ) {
+			pthread_cond_wait(&pool->work_cond,&pool->lock);
+		} /* WHILE */
+		seen = pool->generation;
+		pool->active += 1;
+		pthread_mutex_unlock(&pool->lock);
+
+		run_pool_stats(pool);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->active -= 1;
+		if ( pool->active == 0 ) {
+			pthread_cond_signal(&pool->done_cond);
+		} /* IF */
+	} /* FOR */
+
+	return(NULL);
+} /* end of stat_pool_thread */
+
+/*********************************************************************
+*
+* Function  : pool_stat_batch
+*
+* Purpose   : Stat the entries of a batch with a small pool of threads.
+*
+* Inputs    : STATBATCH *batch - the batch
+*             int dir_fd - descriptor for the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : pool_stat_batch(batch,dir_fd);
+*
+* Notes     : This is the fallback when io_uring is not available. The
+*             pool is created on first use.
+*
+*********************************************************************/
+
+void pool_stat_batch(STATBATCH *batch, int dir_fd)
+{
+	STATPOOL	*pool;
+	int		index;
+
+	pool = batch->engine->pool;
+	if ( pool == NULL ) {
+		pool = (STATPOOL *)calloc(1,sizeof(STATPOOL));
+		if ( pool == NULL ) {
+			quit(1,"calloc failed for STATPOOL");
+		} /* IF */
+		pthread_mutex_init(&pool->lock,NULL);
+		pthread_cond_init(&pool->work_cond,NULL);
+		pthread_cond_init(&pool->done_cond,NULL);
+		for ( index = 0 ; index < STAT_POOL_THREADS ; ++index ) {
+			if ( pthread_create(&pool->threads[index],NULL,stat_pool_thread,pool) != 0 ) {
+				quit(1,"pthread_create failed");
+			} /* IF */
+			pthread_detach(pool->threads[index]);
+		} /* FOR */
+		batch->engine->pool = pool;
+	} /* IF */
+
+	pthread_mutex_lock(&pool->lock);
+	while ( pool->active > 0 ) {
+		pthread_cond_wait(&pool->done_cond,&pool->lock);
+	} /* WHILE a late thread is still on the last batch */
+	pool->batch = batch;
+	pool->count = batch->count;
+	pool->dir_fd = dir_fd;
+	atomic_store(&pool->next,0);
+	pool->generation += 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_pool_stats(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while ( pool->active > 0 ) {
+		pthread_cond_wait(&pool->done_cond,&pool->lock);
+	} /* WHILE */
+	pthread_mutex_unlock(&pool->lock);
+	for ( index = 0 ; index < batch->count ; ++index ) {
+		batch->engine->num_stats += (batch->entries[index].need_stat == STAT_NEEDED);
+	} /* FOR */
+
+	return;
+} /* end of pool_stat_batch */
+
+/*********************************************************************
+*
+* Function  : stat_batch
+*
+* Purpose   : Stat all the entries of a batch which need it.
+*
+* Inputs    : STATBATCH *batch - the batch
+*             int dir_fd - descriptor for the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : stat_batch(batch,dir_fd);
+*
+* Notes     : io_uring is used when the kernel allows it , otherwise the
+*             stats are spread over a small pool of threads.
+*
+*********************************************************************/
+
+void stat_batch(STATBATCH *batch, int dir_fd)
+{
+#ifdef	USE_IO_URING
+	if ( batch->engine->type == STAT_ENGINE_NONE ) {
+		if ( uring_init(&batch->engine->ring,URING_ENTRIES) == 0 ) {
+			batch->engine->type = STAT_ENGINE_URING;
+			debug_print("stat_batch() : using io_uring\n");
+		} /* IF */
+		else {
+			batch->engine->type = STAT_ENGINE_POOL;
+			debug_print("stat_batch() : io_uring unavailable (%s) , using %d threads\n",
+					strerror(errno),STAT_POOL_THREADS);
+		} /* ELSE */
+	} /* IF */
+	if ( batch->engine->type == STAT_ENGINE_URING ) {
+		uring_stat_batch(batch,dir_fd);
+		return;
+	} /* IF */
+#endif
+	pool_stat_batch(batch,dir_fd);
+
+	return;
+} /* end of stat_batch */
+
+/*********************************************************************
+*
+* Function  : descend_into
+*
+* Purpose   : Determine if a subdirectory is to be walked for 'R'.
+*
+* Inputs    : DIRINFO *dir - the directory holding the subdirectory
+*             char *name - name of the subdirectory
+*
+* Output    : (none)
+*
+* Returns   : 1 if the subdirectory is walked , 0 if not
+*
+* Example   : if ( descend_into(dir,name) ) {
+*
+* Notes     : A subdirectory is skipped when its entries would be
+*             deeper than '--max-depth' or when it matches a '--prune'
+*             pattern. A pattern with a '/' is matched against the path
+*             of the subdirectory , otherwise against its name. Either
+*             way it is never opened.
+*
+*********************************************************************/
+
+int descend_into(DIRINFO *dir, char *name)
+{
+	int		index;
+	char	*subject;
+
+	if ( ! SUBDIRS_WALKED(dir) ) {
+		return(0);
+	} /* IF */
+	for ( index = 0 ; index < num_prunes ; ++index ) {
+		subject = (strchr(prune_patterns[index],'/') != NULL) ? build_path(dir,name) : name;
+		if ( fnmatch(prune_patterns[index],subject,FNM_PATHNAME) == 0 ) {
+			atomic_fetch_add(&num_pruned,1);
+			if ( opt_D ) {
+				debug_print("descend_into() : pruned '%s'\n",build_path(dir,name));
+			} /* IF */
+			return(0);
+		} /* IF */
+	} /* FOR */
+
+	return(1);
+} /* end of descend_into */
+
+/*********************************************************************
+*
+* Function  : enter_directory
+*
+* Purpose   : Determine if a directory just opened for 'R' is walked.
+*
+* Inputs    : DIRINFO *dir - information for the directory
+*             int dir_fd - descriptor for the directory
+*
+* Output    : (none)
+*
+* Returns   : 1 if the directory is to be read , 0 if it is skipped
+*
+* Example   : if ( enter_directory(dir,reader.fd) ) {
+*
+* Notes     : Since symbolic links are followed , a directory can be
+*             reached more than once and a link to one of its ancestors
+*             would make the walk endless. The (device , inode) of every
+*             directory walked goes into a hash set , so the ancestors
+*             only have to be searched for the rare directory seen
+*             before. One which is not an ancestor is listed again under
+*             its other path , except for '--du' where its files would
+*             not be counted again anyway. With 'x' a directory on
+*             another device than its parent is skipped. A top level
+*             directory is always walked.
+*
+*********************************************************************/
+
+int enter_directory(DIRINFO *dir, int dir_fd)
+{
+	struct _stat	dirstats;
+	DIRINFO	*ancestor;
+
+	if ( fstat(dir_fd,&dirstats) < 0 ) {
+		return(1);
+	} /* IF can not tell */
+	dir->device = dirstats.st_dev;
+	dir->inode = dirstats.st_ino;
+	if ( dir->parent == NULL ) {
+		add_to_inode_set(&Visited,dir->device,dir->inode);
+		return(1);
+	} /* IF top level directory */
+
+	if ( opt_x && dir->device != dir->parent->device ) {
+		atomic_fetch_add(&num_mounts_skipped,1);
+		debug_print("enter_directory() : '%s' is on another file system\n",dir->path);
+		dir->skipped = 1;
+		return(0);
+	} /* IF */
+	if ( ! add_to_inode_set(&Visited,dir->device,dir->inode) ) {
+		for ( ancestor = dir->parent ; ancestor != NULL ; ancestor = ancestor->parent ) {
+			if ( ancestor->device == dir->device && ancestor->inode == dir->inode ) {
+				break;
+			} /* IF */
+		} /* FOR */
+		if ( ancestor != NULL ) {
+			atomic_fetch_add(&num_cycles_skipped,1);
+			debug_print("enter_directory() : '%s' is a cycle back to '%s'\n",dir->path,
+					ancestor->path_length > 0 ? ancestor->path : ".");
+		} /* IF */
+		else if ( opt_du ) {
+			atomic_fetch_add(&num_revisits_skipped,1);
+			debug_print("enter_directory() : '%s' has already been counted\n",dir->path);
+		} /* ELSE IF */
+		else {
+			return(1);
+		} /* ELSE */
+		dir->skipped = 1;
+		return(0);
+	} /* IF seen before */
+
+	return(1);
+} /* end of enter_directory */
+
+/*********************************************************************
+*
+* Function  : entry_needs_stat
+*
+* Purpose   : Determine if a directory entry has to be stat'ed.
+*
+* Inputs    : DIRINFO *dir - the directory holding the entry
+*             char *name - name of the entry
+*             unsigned char type - d_type of the entry
+*
+* Output    : (none)
+*
+* Returns   : 1 if a stat is needed , 0 if not
+*
+* Example   : need_stat = entry_needs_stat(dir,name,type);
+*
+* Notes     : When only the names are listed , or the entry is above
+*             '--min-depth' and not listed at all , the d_type of an
+*             entry is used instead of a stat wherever it is good enough.
+*
+*********************************************************************/
+
+int entry_needs_stat(DIRINFO *dir, char *name, unsigned char type)
+{
+	if ( opt_du || ((opt_1 == 0 || opt_s || opt_t) && dir->depth + 1 >= opt_min_depth) ) {
+		return(1);
+	} /* IF the metadata is displayed , sorted on or counted */
+	if ( EQ(name,".") || EQ(name,"..") ) {
+		return(0);
+	} /* IF */
+
+	/* only a stat can tell if it is a directory */
+	return( (type == DT_UNKNOWN || type == DT_LNK) && SUBDIRS_WALKED(dir) );
+} /* end of entry_needs_stat */
+
+/*********************************************************************
+*
+* Function  : new_filter
+*
+* Purpose   : Create a node of the filter expression.
+*
+* Inputs    : int op - FILTER_xxx
+*             FILTER *left - first operand (NULL for a test)
+*             FILTER *right - second operand (NULL for a test or NOT)
+*
+* Output    : (none)
+*
+* Returns   : FILTER *node - the node
+*
+* Example   : node = new_filter(FILTER_AND,left,right);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+FILTER *new_filter(int op, FILTER *left, FILTER *right)
+{
+	FILTER	*node;
+
+	node = (FILTER *)calloc(1,sizeof(FILTER));
+	if ( node == NULL ) {
+		quit(1,"calloc failed for FILTER");
+	} /* IF */
+	node->op = op;
+	node->left = left;
+	node->right = right;
+
+	return(node);
+} /* end of new_filter */
+
+/*********************************************************************
+*
+* Function  : parse_size
+*
+* Purpose   : Convert a size with an optional unit from the command line.
+*
+* Inputs    : char *value - the size , a number optionally followed by
+*                           'k' , 'M' or 'G' in either case
+*
+* Output    : (none)
+*
+* Returns   : the size in bytes , -1 if the value is not valid
+*
+* Example   : opt_max_memory = parse_size(optarg);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+long long parse_size(char *value)
+{
+	long long	size;
+	char	*end;
+
+	if ( *value < '0' || *value > '9' ) {
+		return(-1);
+	} /* IF */
+	size = strtoll(value,&end,10);
+	switch ( *end ) {
+	case 'G':
+	case 'g':
+		size *= 1024;
+		/* FALLTHROUGH */
+	case 'M':
+	case 'm':
+		size *= 1024;
+		/* FALLTHROUGH */
+	case 'K':
+	case 'k':
+		size *= 1024;
+		end += 1;
+		break;
+	} /* SWITCH */
+
+	return( *end == '\0' ? size : -1 );
+} /* end of parse_size */
+
+/*********************************************************************
+*
+* Function  : parse_range
+*
+* Purpose   : Convert a "[+-]N[unit]" test value into a range.
+*
+* Inputs    : char *value - the value from the command line
+*             char *units - the unit letters
+*             long long *scales - the multiplier without a unit followed
+*                                 by the multiplier for each unit
+*             long long *low - to receive the lowest value in the range
+*             long long *high - to receive the highest value in the range
+*
+* Output    : (none)
+*
+* Returns   : 0 if ok , -1 if the value is not valid
+*
+* Example   : status = parse_range(optarg,"ckMG",size_scales,&low,&high);
+*
+* Notes     : "+N" means more than N , "-N" less than N and "N" at least
+*             N but less than N+1 , all in units.
+*
+*********************************************************************/
+
+int parse_range(char *value, char *units, long long *scales, long long *low, long long *high)
+{
+	char	sign , *end , *unit;
+	long long	count , scale;
+
+	sign = (*value == '+' || *value == '-') ? *value++ : '\0';
+	if ( *value < '0' || *value > '9' ) {
+		return(-1);
+	} /* IF */
+	count = strtoll(value,&end,10);
+	scale = scales[0];
+	if ( *end != '\0' ) {
+		unit = strchr(units,*end);
+		if ( unit == NULL || end[1] != '\0' ) {
+			return(-1);
+		} /* IF */
+		scale = scales[unit - units + 1];
+	} /* IF */
+
+	*low = LLONG_MIN;
+	*high = LLONG_MAX;
+	if ( sign == '+' ) {
+		*low = count * scale + 1;
+	} /* IF */
+	else if ( sign == '-' ) {
+		*high = count * scale - 1;
+	} /* ELSE IF */
+	else {
+		*low = count * scale;
+		*high = (count + 1) * scale - 1;
+	} /* ELSE */
+
+	return(0);
+} /* end of parse_range */
+
+/*********************************************************************
+*
+* Function  : add_filter_test
+*
+* Purpose   : Add a filter option to the list of filter tokens.
+*
+* Inputs    : int op - FILTER_xxx
+*             char *value - the value of the option (NULL for none)
+*
+* Output    : (none)
+*
+* Returns   : 0 if ok , -1 if the value is not valid
+*
+* Example   : errflag += add_filter_test(FILTER_NAME,optarg) != 0;
+*
+* Notes     : The tokens are made into an expression by compile_filter()
+*             once all the options have been seen.
+*
+*********************************************************************/
+
+int add_filter_test(int op, char *value)
+{
+	static long long	size_scales[] = { 1 , 1 , 1024 , 1024 * 1024 , 1024 * 1024 * 1024 };
+	static long long	age_scales[] = { 86400 , 1 , 60 , 3600 , 86400 , 7 * 86400 };
+	FILTER	*node;
+	long long	low , high;
+	time_t	now;
+	char	*ptr;
+
+	node = new_filter(op,NULL,NULL);
+	switch ( op ) {
+	case FILTER_NAME:
+		node->pattern = value;
+		break;
+	case FILTER_REGEX:
+		if ( regcomp(&node->regex,value,REG_EXTENDED | REG_NOSUB) != 0 ) {
+			printf("Invalid regular expression '%s'\n",value);
+			return(-1);
+		} /* IF */
+		break;
+	case FILTER_TYPE:
+		for ( ptr = value ; *ptr ; ++ptr ) {
+			if ( strchr(FILTER_TYPES,*ptr) == NULL ) {
+				printf("Invalid file type '%c' , use some of '%s'\n",*ptr,FILTER_TYPES);
+				return(-1);
+			} /* IF */
+			node->types |= 1 << (strchr(FILTER_TYPES,*ptr) - FILTER_TYPES);
+		} /* FOR */
+		break;
+	case FILTER_SIZE:
+		if ( parse_range(value,"ckMG",size_scales,&node->low,&node->high) != 0 ) {
+			printf("Invalid size '%s'\n",value);
+			return(-1);
+		} /* IF */
+		break;
+	case FILTER_MTIME:
+		if ( parse_range(value,"smhdw",age_scales,&low,&high) != 0 ) {
+			printf("Invalid age '%s'\n",value);
+			return(-1);
+		} /* IF */
+		/* an age in seconds is a range of mtimes in nanoseconds the other way around */
+		now = time(NULL);
+		node->low = (high == LLONG_MAX) ? LLONG_MIN : (now - high - 1) * 1000000000LL + 1;
+		node->high = (low == LLONG_MIN) ? LLONG_MAX : (now - low) * 1000000000LL;
+		break;
+	} /* SWITCH */
+	node->needs_stat = (op == FILTER_SIZE || op == FILTER_MTIME);
+
+	filter_tokens = (FILTER **)realloc(filter_tokens,(num_filter_tokens + 1) * sizeof(FILTER *));
+	if ( filter_tokens == NULL ) {
+		quit(1,"realloc failed for filter tokens");
+	} /* IF */
+	filter_tokens[num_filter_tokens++] = node;
+
+	return(0);
+} /* end of add_filter_test */
+
+/*********************************************************************
+*
+* Function  : parse_filter
+*
+* Purpose   : Build the expression for part of the filter tokens.
+*
+* Inputs    : int *next - index of the next token , it is advanced
+*             int level - 0 for an OR list , 1 for an AND list , 2 for
+*                         a single (possibly negated) test
+*
+* Output    : (none)
+*
+* Returns   : FILTER *node - root of the expression
+*
+* Example   : Filter = parse_filter(&next,0);
+*
+* Notes     : Tests next to each other are ANDed , "--or" binds less
+*             tightly and "--not" applies to the following test.
+*
+*********************************************************************/
+
+FILTER *parse_filter(int *next, int level)
+{
+	FILTER	*node , *token;
+
+	if ( level == 2 ) {
+		if ( *next >= num_filter_tokens ) {
+			die(1,"A test is missing at the end of the filter\n");
+		} /* IF */
+		token = filter_tokens[(*next)++];
+		if ( token->op == FILTER_NOT ) {
+			token->left = parse_filter(next,2);
+			token->needs_stat = token->left->needs_stat;
+		} /* IF */
+		else if ( token->op == FILTER_OR ) {
+			die(1,"'--or' must be between two tests\n");
+		} /* ELSE IF */
+		return(token);
+	} /* IF */
+
+	node = parse_filter(next,level + 1);
+	while ( *next < num_filter_tokens ) {
+		token = filter_tokens[*next];
+		if ( level == 0 ) {
+			if ( token->op != FILTER_OR ) {
+				break;
+			} /* IF */
+			*next += 1;
+		} /* IF */
+		else if ( token->op == FILTER_OR ) {
+			break;
+		} /* ELSE IF */
+		else {
+			token = new_filter(FILTER_AND,NULL,NULL);
+		} /* ELSE */
+		token->left = node;
+		token->right = parse_filter(next,level + 1);
+		token->needs_stat = node->needs_stat || token->right->needs_stat;
+		node = token;
+	} /* WHILE */
+
+	return(node);
+} /* end of parse_filter */
+
+/*********************************************************************
+*
+* Function  : compile_filter
+*
+* Purpose   : Build the filter expression from the filter options.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : compile_filter();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void compile_filter()
+{
+	int		next;
+
+	if ( num_filter_tokens == 0 ) {
+		return;
+	} /* IF */
+	next = 0;
+	Filter = parse_filter(&next,0);
+	free(filter_tokens);
+	filter_tokens = NULL;
+
+	return;
+} /* end of compile_filter */
+
+/*********************************************************************
+*
+* Function  : eval_filter
+*
+* Purpose   : Evaluate the filter expression for an entry.
+*
+* Inputs    : FILTER *node - the expression , NULL for none
+*             char *name - name of the entry
+*             unsigned char type - d_type of the entry
+*             struct _stat *filestats - the stat data , NULL if the
+*                                       entry has not been stat'ed
+*             int stat_failed - 1 if the stat of the entry failed , so
+*                               the type of a symbolic link comes from
+*                               d_type
+*
+* Output    : (none)
+*
+* Returns   : FILTER_TRUE , FILTER_FALSE or FILTER_UNKNOWN when the
+*             answer depends on data from a stat not yet done
+*
+* Example   : verdict = eval_filter(Filter,name,type,NULL,0);
+*
+* Notes     : Three valued logic lets a test on the name reject an
+*             entry before its stat , even when the expression also
+*             tests the size. Both sides of AND and OR are skipped when
+*             the first one decides the result.
+*             '--type' follows symbolic links like the stat of the walk ,
+*             so a link is only typed from d_type when it is dangling and
+*             the result does not depend on whether the listing needs a
+*             stat.
+*
+*********************************************************************/
+
+int eval_filter(FILTER *node, char *name, unsigned char type, struct _stat *filestats, int stat_failed)
+{
+	int		left , right;
+	unsigned short	mode;
+	long long	value;
+	char	*base , letter;
+
+	if ( node == NULL ) {
+		return(FILTER_TRUE);
+	} /* IF no filter */
+	switch ( node->op ) {
+	case FILTER_AND:
+	case FILTER_OR:
+		left = eval_filter(node->left,name,type,filestats,stat_failed);
+		if ( left == (node->op == FILTER_AND ? FILTER_FALSE : FILTER_TRUE) ) {
+			return(left);
+		} /* IF first operand decides */
+		right = eval_filter(node->right,name,type,filestats,stat_failed);
+		if ( right == left ) {
+			return(left);
+		} /* IF */
+		if ( right == (node->op == FILTER_AND ? FILTER_FALSE : FILTER_TRUE) ) {
+			return(right);
+		} /* IF */
+		return(FILTER_UNKNOWN);
+	case FILTER_NOT:
+		left = eval_filter(node->left,name,type,filestats,stat_failed);
+		return( left == FILTER_UNKNOWN ? left : (left == FILTER_TRUE ? FILTER_FALSE : FILTER_TRUE) );
+	case FILTER_NAME:
+	case FILTER_REGEX:
+		base = strrchr(name,'/');
+		base = (base == NULL || base[1] == '\0') ? name : base + 1;
+		if ( node->op == FILTER_NAME ) {
+			return( fnmatch(node->pattern,base,0) == 0 ? FILTER_TRUE : FILTER_FALSE );
+		} /* IF */
+		return( regexec(&node->regex,base,0,NULL,0) == 0 ? FILTER_TRUE : FILTER_FALSE );
+	case FILTER_TYPE:
+		if ( filestats != NULL ) {
+			mode = filestats->st_mode;
+		} /* IF */
+		else if ( type == DT_UNKNOWN || (type == DT_LNK && ! stat_failed) ) {
+			return(FILTER_UNKNOWN);
+		} /* ELSE IF */
+		else {
+			mode = DTTOIF(type);
+		} /* ELSE */
+		letter = ftypes[ (mode & 0170000) >> 12 ];
+		base = strchr(FILTER_TYPES,letter == '-' ? 'f' : letter);
+		if ( base == NULL ) {
+			return(FILTER_FALSE);
+		} /* IF */
+		return( (node->types >> (base - FILTER_TYPES)) & 1 ? FILTER_TRUE : FILTER_FALSE );
+	case FILTER_SIZE:
+	case FILTER_MTIME:
+		if ( filestats == NULL ) {
+			return(FILTER_UNKNOWN);
+		} /* IF */
+		value = (node->op == FILTER_SIZE) ? (long long)filestats->st_size :
+				(long long)filestats->st_mtim.tv_sec * 1000000000LL + filestats->st_mtim.tv_nsec;
+		return( value >= node->low && value <= node->high ? FILTER_TRUE : FILTER_FALSE );
+	} /* SWITCH */
+
+	return(FILTER_UNKNOWN);
+} /* end of eval_filter */
+
+/*********************************************************************
+*
+* Function  : prefilter_entry
+*
+* Purpose   : Apply the filter to a directory entry before its stat.
+*
+* Inputs    : DIRINFO *dir - the directory holding the entry
+*             char *name - name of the entry
+*             unsigned char type - d_type of the entry
+*             int *need_stat - whether the entry needs a stat , it is
+*                              updated for the result of the filter
+*
+* Output    : (none)
+*
+* Returns   : FILTER_TRUE , FILTER_FALSE or FILTER_UNKNOWN
+*
+* Example   : verdict = prefilter_entry(dir,name,type,&need_stat);
+*
+* Notes     : A rejected entry is only stat'ed if 'R' needs to know
+*             whether it is a directory. An entry the filter can not
+*             decide on without a stat , such as a symbolic link tested
+*             by '--type' , always gets one.
+*
+*********************************************************************/
+
+int prefilter_entry(DIRINFO *dir, char *name, unsigned char type, int *need_stat)
+{
+	int		verdict , walk_stat;
+
+	if ( Filter == NULL ) {
+		return(FILTER_TRUE);
+	} /* IF */
+	verdict = eval_filter(Filter,name,type,NULL,0);
+	if ( verdict == FILTER_FALSE ) {
+		atomic_fetch_add(&num_rejected_early,1);
+		walk_stat = (type == DT_UNKNOWN || type == DT_LNK) && SUBDIRS_WALKED(dir) &&
+					NE(name,".") && NE(name,"..");
+		if ( *need_stat && ! walk_stat ) {
+			atomic_fetch_add(&num_stats_saved,1);
+		} /* IF */
+		*need_stat = walk_stat;
+	} /* IF */
+	else if ( verdict == FILTER_UNKNOWN ) {
+		*need_stat = 1;
+	} /* ELSE IF */
+
+	return(verdict);
+} /* end of prefilter_entry */
+
+/*********************************************************************
+*
+* Function  : add_subdir_name
+*
+* Purpose   : Add a name to the end of a list of subdirectories.
+*
+* Inputs    : NAMESLIST *subdirs - the list
+*             char *name - name of the subdirectory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_subdir_name(subdirs,name);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void add_subdir_name(NAMESLIST *subdirs, char *name)
+{
+	NAME	*subdir;
+
+	subdirs->num_names += 1;
+	subdir = (NAME *)arena_alloc(&node_arena,sizeof(NAME));
+	subdir->name = arena_name(name,strlen(name));
+	subdir->next_name = NULL;
+	if ( subdirs->num_names == 1 ) {
+		subdirs->first_name = subdir;
+	}
+	else {
+		subdirs->last_name->next_name = subdir;
+	}
+	subdirs->last_name = subdir;
+
+	return;
+} /* end of add_subdir_name */
+
+/*********************************************************************
+*
+* Function  : add_scanned_entry
+*
+* Purpose   : Add a directory entry to the list of files once its stat
+*             (if any) is done.
+*
+* Inputs    : DIRINFO *dir - information for the directory
+*             char *name - name of the entry
+*             unsigned char type - d_type of the entry
+*             int need_stat - 1 if the entry was stat'ed
+*             int status - 0 if the stat worked , else the errno value
+*             struct _stat *filestats - the stat data
+*             NAMESLIST *subdirs - to receive the name of the entry if
+*                                  it is a subdirectory for 'R' (NULL
+*                                  when the caller tracks them itself)
+*             int verdict - result of the filter before the stat
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_scanned_entry(dir,name,type,1,0,&filestats,subdirs,verdict);
+*
+* Notes     : An entry the filter could not decide on is decided on
+*             here from its stat data. A rejected entry is not listed
+*             but a rejected directory is still walked for 'R'.
+*
+*********************************************************************/
+
+void add_scanned_entry(DIRINFO *dir, char *name, unsigned char type, int need_stat,
+				int status, struct _stat *filestats, NAMESLIST *subdirs, int verdict)
+{
+	int		is_dir;
+	unsigned short	filemode;
+
+	if ( cache_record.active ) {
+		add_cache_entry(name,type);
+	} /* IF the directory is kept in the snapshot cache */
+	if ( need_stat == 0 ) {
+		memset(filestats,0,sizeof(struct _stat));
+		filestats->st_mode = DTTOIF(type);
+		if ( verdict == FILTER_TRUE ) {
+			add_file_to_list(dir,name,filestats);
+		} /* IF */
+		is_dir = (type == DT_DIR);
+	} /* IF */
+	else if ( status != 0 ) {
+		if ( verdict == FILTER_UNKNOWN ) {
+			verdict = eval_filter(Filter,name,type,NULL,1);
+		} /* IF */
+		if ( verdict != FILTER_UNKNOWN && opt_du == 0 &&
+				((opt_1 && opt_s == 0 && opt_t == 0) || dir->depth + 1 < opt_min_depth) ) {
+			memset(filestats,0,sizeof(struct _stat));
+			filestats->st_mode = DTTOIF(type);
+			if ( verdict == FILTER_TRUE ) {
+				add_file_to_list(dir,name,filestats);
+			} /* IF */
+		} /* IF the stat was only needed for the recursion */
+		else if ( verdict != FILTER_FALSE ) {
+			errno = status;
+			system_error("stat() failed for \"%s\"",build_path(dir,name));
+		} /* ELSE IF */
+		is_dir = 0;
+	} /* ELSE IF */
+	else {
+		if ( verdict == FILTER_UNKNOWN ) {
+			verdict = eval_filter(Filter,name,type,filestats,0);
+			if ( verdict == FILTER_FALSE ) {
+				atomic_fetch_add(&num_rejected_late,1);
+			} /* IF */
+		} /* IF */
+		if ( verdict == FILTER_TRUE ) {
+			add_file_to_list(dir,name,filestats);
+		} /* IF */
+		filemode = filestats->st_mode & _S_IFMT;
+		is_dir = _S_ISDIR(filemode);
+	} /* ELSE */
+
+	if ( is_dir && subdirs != NULL && NE(name,".") && NE(name,"..") && descend_into(dir,name) ) {
+		add_subdir_name(subdirs,name);
+	} /* IF recursive processing requested */
+
+	return;
+} /* end of add_scanned_entry */
+
+/*********************************************************************
+*
+* Function  : flush_stat_batch
+*
+* Purpose   : Stat the entries of a batch and add them all to the list
+*             of files.
+*
+* Inputs    : STATBATCH *batch - the batch
+*             int dir_fd - descriptor for the directory
+*             DIRINFO *dir - information for the directory
+*             NAMESLIST *subdirs - to receive the names of the
+*                                  subdirectories for 'R'
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : flush_stat_batch(&batch,dir_fd,dir,subdirs);
+*
+* Notes     : The stats complete in any order but the entries are added
+*             in directory order.
+*
+*********************************************************************/
+
+void flush_stat_batch(STATBATCH *batch, int dir_fd, DIRINFO *dir, NAMESLIST *subdirs)
+{
+	BATCHENTRY	*entry;
+	int		index;
+
+	if ( batch->count == 0 ) {
+		return;
+	} /* IF */
+	stat_batch(batch,dir_fd);
+	for ( index = 0 ; index < batch->count ; ++index ) {
+		entry = &batch->entries[index];
+		add_scanned_entry(dir,&batch->names[entry->name_offset],entry->type,
+				entry->need_stat,entry->status,&entry->filestats,subdirs,entry->verdict);
+	} /* FOR */
+	batch->count = 0;
+	batch->names_used = 0;
+
+	return;
+} /* end of flush_stat_batch */
+
+/*********************************************************************
+*
+* Function  : open_cache
+*
+* Purpose   : Map the snapshot cache and start the new one.
+*
+* Inputs    : char *path - name of the cache file
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : open_cache(opt_cache);
+*
+* Notes     : A missing cache , or one written by another version or
+*             with another layout , is treated as empty. The new cache
+*             is written next to it and replaces it in close_cache().
+*
+*********************************************************************/
+
+void open_cache(char *path)
+{
+	struct _stat	filestats;
+	CACHEHEADER	header;
+	int		fd;
+
+	Cache.path = path;
+	pthread_mutex_init(&Cache.lock,NULL);
+	fd = open(path,O_RDONLY);
+	if ( fd >= 0 && fstat(fd,&filestats) == 0 && filestats.st_size >= (off_t)sizeof(CACHEHEADER) ) {
+		Cache.map = (unsigned char *)mmap(NULL,filestats.st_size,PROT_READ,MAP_SHARED,fd,0);
+		if ( Cache.map == MAP_FAILED ) {
+			Cache.map = NULL;
+		} /* IF */
+		else {
+			Cache.map_size = filestats.st_size;
+			Cache.header = (CACHEHEADER *)Cache.map;
+			if ( memcmp(Cache.header->magic,CACHE_MAGIC,sizeof(Cache.header->magic)) != 0 ||
+						Cache.header->version != CACHE_VERSION ||
+						Cache.header->entry_size != sizeof(CACHEENTRY) ||
+						Cache.header->index_offset > Cache.map_size ||
+						Cache.header->index_slots > (Cache.map_size - Cache.header->index_offset) / 8 ||
+						(Cache.header->index_slots & (Cache.header->index_slots - 1)) != 0 ) {
+				debug_print("open_cache(%s) : not a usable cache , ignored\n",path);
+				munmap(Cache.map,Cache.map_size);
+				Cache.map = NULL;
+			} /* IF */
+			else {
+				Cache.index = (unsigned long long *)&Cache.map[Cache.header->index_offset];
+			} /* ELSE */
+		} /* ELSE */
+	} /* IF */
+	if ( fd >= 0 ) {
+		close(fd);
+	} /* IF */
+
+	Cache.new_path = (char *)malloc(strlen(path) + 32);
+	if ( Cache.new_path == NULL ) {
+		quit(1,"malloc failed for cache file name");
+	} /* IF */
+	sprintf(Cache.new_path,"%s.%d",path,(int)getpid());
+	Cache.new_file = fopen(Cache.new_path,"w");
+	if ( Cache.new_file == NULL ) {
+		quit(1,"fopen failed for \"%s\"",Cache.new_path);
+	} /* IF */
+	memset(&header,0,sizeof(header));
+	fwrite(&header,sizeof(header),1,Cache.new_file);
+	Cache.new_size = sizeof(header);
+
+	return;
+} /* end of open_cache */
+
+/*********************************************************************
+*
+* Function  : get_cache_key
+*
+* Purpose   : Get the key of an open directory in the snapshot cache.
+*
+* Inputs    : int dir_fd - descriptor for the directory
+*             CACHEKEY *key - to receive the key
+*
+* Output    : (none)
+*
+* Returns   : 0 if ok , -1 if the directory could not be stat'ed
+*
+* Example   : if ( get_cache_key(reader->fd,&key) == 0 ) {
+*
+* Notes     : Creating , removing or renaming an entry changes the
+*             mtime of the directory , changing its permissions or owner
+*             changes the ctime.
+*
+*********************************************************************/
+
+int get_cache_key(int dir_fd, CACHEKEY *key)
+{
+	struct _stat	dirstats;
+
+	if ( fstat(dir_fd,&dirstats) < 0 ) {
+		return(-1);
+	} /* IF */
+	memset(key,0,sizeof(CACHEKEY));
+	key->device = dirstats.st_dev;
+	key->inode = dirstats.st_ino;
+	key->mtime = (long long)dirstats.st_mtim.tv_sec * 1000000000LL + dirstats.st_mtim.tv_nsec;
+	key->ctime = (long long)dirstats.st_ctim.tv_sec * 1000000000LL + dirstats.st_ctim.tv_nsec;
+
+	return(0);
+} /* end of get_cache_key */
+
+/*********************************************************************
+*
+* Function  : cache_record_checksum
+*
+* Purpose   : Compute the checksum of a directory record of the
+*             snapshot cache.
+*
+* Inputs    : CACHEDIR *record - the record , entries included
+*             unsigned char *digest - to receive the 8 byte checksum
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : cache_record_checksum(record,record->checksum);
+*
+* Notes     : Covers the whole record except the checksum itself.
+*
+*********************************************************************/
+
+void cache_record_checksum(CACHEDIR *record, unsigned char *digest)
+{
+	XXH3STATE	state;
+
+	xxh3_start(&state);
+	xxh3_update(&state,(unsigned char *)record,offsetof(CACHEDIR,checksum));
+	xxh3_update(&state,(unsigned char *)&record[1],record->length - sizeof(CACHEDIR));
+	xxh3_digest(&state,digest);
+
+	return;
+} /* end of cache_record_checksum */
+
+/*********************************************************************
+*
+* Function  : find_cached_dir
+*
+* Purpose   : Look up a directory in the snapshot cache.
+*
+* Inputs    : CACHEKEY *key - key of the directory
+*
+* Output    : (none)
+*
+* Returns   : CACHEDIR *cached - the entries of the directory , NULL if
+*                                it is not in the cache
+*
+* Example   : cached = find_cached_dir(&key);
+*
+* Notes     : The index is an open addressed hash table of offsets into
+*             the file , 0 marks a free slot. A record which does not
+*             fit in the file , or does not match its checksum , ends
+*             the search , as does a probe of every slot without finding
+*             a free one.
+*
+*********************************************************************/
+
+CACHEDIR *find_cached_dir(CACHEKEY *key)
+{
+	CACHEDIR	*cached;
+	unsigned long long	slot , mask , offset , probes;
+	unsigned char	checksum[8];
+
+	if ( Cache.map == NULL || Cache.header->index_slots == 0 ) {
+		return(NULL);
+	} /* IF */
+	mask = Cache.header->index_slots - 1;
+	slot = CACHE_HASH(key) & mask;
+	for ( probes = 0 ; probes < Cache.header->index_slots ; ++probes , slot = (slot + 1) & mask ) {
+		offset = Cache.index[slot];
+		if ( offset == 0 || offset + sizeof(CACHEDIR) > Cache.header->index_offset ) {
+			return(NULL);
+		} /* IF */
+		cached = (CACHEDIR *)&Cache.map[offset];
+		if ( memcmp(&cached->key,key,sizeof(CACHEKEY)) == 0 ) {
+			if ( cached->length < sizeof(CACHEDIR) || cached->length > Cache.header->index_offset - offset ) {
+				return(NULL);
+			} /* IF damaged */
+			cache_record_checksum(cached,checksum);
+			if ( memcmp(checksum,cached->checksum,sizeof(checksum)) != 0 ) {
+				debug_print("find_cached_dir() : checksum mismatch , record ignored\n");
+				return(NULL);
+			} /* IF */
+			return(cached);
+		} /* IF */
+	} /* FOR */
+	debug_print("find_cached_dir() : the index has no free slot , damaged cache\n");
+
+	return(NULL);
+} /* end of find_cached_dir */
+
+/*********************************************************************
+*
+* Function  : cache_entry_space
+*
+* Purpose   : Make room in the record of the directory being scanned.
+*
+* Inputs    : size_t length - number of bytes needed
+*
+* Output    : (none)
+*
+* Returns   : ptr to the space
+*
+* Example   : entry = (CACHEENTRY *)cache_entry_space(length);
+*
+* Notes     : Each thread builds the record of its directory in its
+*             own buffer.
+*
+*********************************************************************/
+
+void *cache_entry_space(size_t length)
+{
+	void	*space;
+
+	if ( cache_record.used + length > cache_record.size ) {
+		cache_record.size = 2 * (cache_record.used + length) + 4096;
+		cache_record.data = (unsigned char *)realloc(cache_record.data,cache_record.size);
+		if ( cache_record.data == NULL ) {
+			quit(1,"realloc failed for cache record");
+		} /* IF */
+	} /* IF */
+	space = &cache_record.data[cache_record.used];
+	cache_record.used += length;
+
+	return(space);
+} /* end of cache_entry_space */
+
+/*********************************************************************
+*
+* Function  : start_cache_record
+*
+* Purpose   : Start the record of a directory for the new cache.
+*
+* Inputs    : CACHEKEY *key - key of the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : start_cache_record(&key);
+*
+* Notes     : The entries are added by add_scanned_entry() until
+*             finish_cache_record() is called.
+*
+*********************************************************************/
+
+void start_cache_record(CACHEKEY *key)
+{
+	CACHEDIR	*record;
+
+	cache_record.used = 0;
+	record = (CACHEDIR *)cache_entry_space(sizeof(CACHEDIR));
+	memset(record,0,sizeof(CACHEDIR));
+	record->key = *key;
+	cache_record.active = 1;
+
+	return;
+} /* end of start_cache_record */
+
+/*********************************************************************
+*
+* Function  : add_cache_entry
+*
+* Purpose   : Add a directory entry to the record being built.
+*
+* Inputs    : char *name - name of the entry
+*             int type - d_type of the entry
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_cache_entry(name,type);
+*
+* Notes     : Only the name and type are kept. The stat data of a file
+*             changes when the file is rewritten in place , which does
+*             not change the key of its directory.
+*
+*********************************************************************/
+
+void add_cache_entry(char *name, int type)
+{
+	CACHEENTRY	*entry;
+	size_t	name_length;
+
+	name_length = strlen(name);
+	entry = (CACHEENTRY *)cache_entry_space(CACHE_ENTRY_LENGTH(name_length));
+	memset(entry,0,CACHE_ENTRY_LENGTH(name_length));
+	entry->name_length = name_length;
+	entry->type = type;
+	memcpy(&entry[1],name,name_length);
+	((CACHEDIR *)cache_record.data)->num_entries += 1;
+
+	return;
+} /* end of add_cache_entry */
+
+/*********************************************************************
+*
+* Function  : finish_cache_record
+*
+* Purpose   : Add the record of a directory to the new cache.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : finish_cache_record();
+*
+* Notes     : The records of all the threads go into the one file , the
+*             index is written at the end by close_cache().
+*
+*********************************************************************/
+
+void finish_cache_record()
+{
+	CACHEDIR	*record;
+
+	if ( cache_record.active == 0 ) {
+		return;
+	} /* IF */
+	cache_record.active = 0;
+	record = (CACHEDIR *)cache_record.data;
+	record->length = cache_record.used;
+	cache_record_checksum(record,record->checksum);
+
+	pthread_mutex_lock(&Cache.lock);
+	if ( Cache.num_new >= Cache.new_capacity ) {
+		Cache.new_capacity = (Cache.new_capacity > 0) ? 2 * Cache.new_capacity : 1024;
+		Cache.new_offsets = (unsigned long long *)realloc(Cache.new_offsets,
+					Cache.new_capacity * sizeof(unsigned long long));
+		Cache.new_hashes = (unsigned long long *)realloc(Cache.new_hashes,
+					Cache.new_capacity * sizeof(unsigned long long));
+		if ( Cache.new_offsets == NULL || Cache.new_hashes == NULL ) {
+			quit(1,"realloc failed for cache index");
+		} /* IF */
+	} /* IF */
+	Cache.new_offsets[Cache.num_new] = Cache.new_size;
+	Cache.new_hashes[Cache.num_new] = CACHE_HASH(&record->key);
+	Cache.num_new += 1;
+	fwrite(record,1,cache_record.used,Cache.new_file);
+	Cache.new_size += cache_record.used;
+	pthread_mutex_unlock(&Cache.lock);
+
+	return;
+} /* end of finish_cache_record */
+
+/*********************************************************************
+*
+* Function  : replay_cached_dir
+*
+* Purpose   : Add the entries of a directory from the snapshot cache.
+*
+* Inputs    : DIRREADER *reader - reader for the directory
+*             DIRINFO *dir - information for the directory
+*             NAMESLIST *subdirs - to receive the names of the
+*                                  subdirectories for 'R'
+*             CACHEDIR *cached - the cached entries
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : replay_cached_dir(reader,dir,subdirs,cached);
+*
+* Notes     : The cache stands in for reading the directory , the
+*             entries which need a stat are stat'ed as usual , in
+*             batches with "--async-stat".
+*
+*********************************************************************/
+
+void replay_cached_dir(DIRREADER *reader, DIRINFO *dir, NAMESLIST *subdirs, CACHEDIR *cached)
+{
+	struct _stat	filestats;
+	CACHEENTRY	*entry;
+	STATBATCH	*batch;
+	unsigned char	*next , *end;
+	char	*name;
+	int		need_stat , status , verdict;
+	unsigned int	index;
+
+	batch = opt_async_stat ? get_stat_batch() : NULL;
+	next = (unsigned char *)&cached[1];
+	end = (unsigned char *)cached + cached->length;
+	for ( index = 0 ; index < cached->num_entries ; ++index ) {
+		entry = (CACHEENTRY *)next;
+		if ( next + sizeof(CACHEENTRY) > end || next + CACHE_ENTRY_LENGTH(entry->name_length) > end ) {
+			break;
+		} /* IF damaged */
+		next += CACHE_ENTRY_LENGTH(entry->name_length);
+		name = (char *)&entry[1];
+		need_stat = entry_needs_stat(dir,name,entry->type);
+		verdict = prefilter_entry(dir,name,entry->type,&need_stat);
+		if ( batch != NULL ) {
+			if ( add_to_stat_batch(batch,name,entry->type,need_stat,verdict) ) {
+				flush_stat_batch(batch,reader->fd,dir,subdirs);
+			} /* IF batch is full */
+			continue;
+		} /* IF */
+		status = 0;
+		if ( need_stat && fstatat(reader->fd,name,&filestats,0) < 0 ) {
+			status = errno;
+		} /* IF */
+		add_scanned_entry(dir,name,entry->type,need_stat,status,&filestats,subdirs,verdict);
+	} /* FOR */
+	if ( batch != NULL ) {
+		flush_stat_batch(batch,reader->fd,dir,subdirs);
+	} /* IF */
+	atomic_fetch_add(&Cache.num_entries_reused,index);
+	debug_print("list_directory(%s) : %u entries from the cache\n",dir->path,index);
+
+	return;
+} /* end of replay_cached_dir */
+
+/*********************************************************************
+*
+* Function  : close_cache
+*
+* Purpose   : Finish the new snapshot cache and put it in place.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : close_cache();
+*
+* Notes     : The new cache only holds the directories of this run. It
+*             is renamed over the old one , so a reader never sees a
+*             half written cache.
+*
+*********************************************************************/
+
+void close_cache()
+{
+	CACHEHEADER	header;
+	unsigned long long	*index , slots , slot;
+	long	count;
+	long	hits , lookups;
+
+	slots = 16;
+	while ( slots < 2 * (unsigned long long)Cache.num_new ) {
+		slots *= 2;
+	} /* WHILE */
+	index = (unsigned long long *)calloc(slots,sizeof(unsigned long long));
+	if ( index == NULL ) {
+		quit(1,"calloc failed for cache index");
+	} /* IF */
+	for ( count = 0 ; count < Cache.num_new ; ++count ) {
+		slot = Cache.new_hashes[count] & (slots - 1);
+		while ( index[slot] != 0 ) {
+			slot = (slot + 1) & (slots - 1);
+		} /* WHILE */
+		index[slot] = Cache.new_offsets[count];
+	} /* FOR */
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,CACHE_MAGIC,sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.entry_size = sizeof(CACHEENTRY);
+	header.num_dirs = Cache.num_new;
+	header.index_offset = Cache.new_size;
+	header.index_slots = slots;
+	fwrite(index,sizeof(unsigned long long),slots,Cache.new_file);
+	fseek(Cache.new_file,0L,SEEK_SET);
+	fwrite(&header,sizeof(header),1,Cache.new_file);
+	if ( ferror(Cache.new_file) | fclose(Cache.new_file) ) {
+		unlink(Cache.new_path);
+		quit(1,"write failed for \"%s\"",Cache.new_path);
+	} /* IF */
+	if ( rename(Cache.new_path,Cache.path) < 0 ) {
+		unlink(Cache.new_path);
+		quit(1,"rename failed for \"%s\"",Cache.path);
+	} /* IF */
+
+	hits = atomic_load(&Cache.num_hits);
+	lookups = hits + atomic_load(&Cache.num_misses);
+	debug_print("close_cache(%s) : %ld of %ld directories from the cache (%.1f%%) , "
+			"%ld entries reused\n",Cache.path,hits,lookups,
+			lookups > 0 ? 100.0 * hits / lookups : 0.0,atomic_load(&Cache.num_entries_reused));
+	if ( Cache.map != NULL ) {
+		munmap(Cache.map,Cache.map_size);
+	} /* IF */
+	free(index);
+	free(Cache.new_offsets);
+	free(Cache.new_hashes);
+	free(Cache.new_path);
+	free(cache_record.data);
+
+	return;
+} /* end of close_cache */
+
+/*********************************************************************
+*
+* Function  : scan_directory
+*
+* Purpose   : Add the entries of an open directory to the list of files.
+*
+* Inputs    : DIRREADER *reader - reader for the directory
+*             DIRINFO *dir - information for the directory
+*             NAMESLIST *subdirs - to receive the names of the
+*                                  subdirectories for 'R'
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : scan_directory(&reader,dir,&subdirs);
+*
+* Notes     : With "--async-stat" the entries are gathered into batches
+*             whose stats are all issued at once. With "--cache" a
+*             directory which is unchanged since the last run is not
+*             read , its entries come from the snapshot cache.
+*
+*********************************************************************/
+
+void scan_directory(DIRREADER *reader, DIRINFO *dir, NAMESLIST *subdirs)
+{
+	struct _stat	filestats;
+	char	*name;
+	int		need_stat , num_skipped , status , verdict;
+	unsigned char	type;
+	STATBATCH	*batch;
+	CACHEKEY	key;
+	CACHEDIR	*cached;
+
+	subdirs->num_names = 0;
+	subdirs->first_name = NULL;
+	subdirs->last_name = NULL;
+#ifdef	__linux__
+	if ( opt_watch ) {
+		add_watch_dir(dir,reader->fd);
+	} /* IF */
+#endif
+	if ( Cache.path != NULL && get_cache_key(reader->fd,&key) == 0 ) {
+		cached = find_cached_dir(&key);
+		start_cache_record(&key);
+		if ( cached != NULL ) {
+			atomic_fetch_add(&Cache.num_hits,1);
+			replay_cached_dir(reader,dir,subdirs,cached);
+			finish_cache_record();
+			if ( opt_U ) {
+				stream_files();
+			} /* IF */
+			return;
+		} /* IF unchanged since the last run */
+		atomic_fetch_add(&Cache.num_misses,1);
+	} /* IF */
+	batch = opt_async_stat ? get_stat_batch() : NULL;
+
+	num_skipped = 0;
+	name = read_dir_entry(reader,&type);
+	for ( ; name != NULL ; name = read_dir_entry(reader,&type) ) {
+		need_stat = entry_needs_stat(dir,name,type);
+		verdict = prefilter_entry(dir,name,type,&need_stat);
+		if ( need_stat == 0 ) {
+			num_skipped += 1;
+		} /* IF */
+		if ( batch != NULL ) {
+			if ( add_to_stat_batch(batch,name,type,need_stat,verdict) ) {
+				flush_stat_batch(batch,reader->fd,dir,subdirs);
+			} /* IF batch is full */
+			continue;
+		} /* IF */
+		status = 0;
+		if ( need_stat && fstatat(reader->fd,name,&filestats,0) < 0 ) {
+			status = errno;
+		} /* IF */
+		add_scanned_entry(dir,name,type,need_stat,status,&filestats,subdirs,verdict);
+	} /* FOR */
+	if ( batch != NULL ) {
+		flush_stat_batch(batch,reader->fd,dir,subdirs);
+	} /* IF */
+	finish_cache_record();
+	debug_print("list_directory(%s) : %d entries , %d getdents64 calls , %d stat calls saved\n",
+			dir->path,reader->num_entries,reader->num_reads,num_skipped);
+	if ( opt_U ) {
+		stream_files();
+	} /* IF */
+
+	return;
+} /* end of scan_directory */
+
+
+/*********************************************************************
+*
+* Function  : traverse_tree
+*
+* Purpose   : Walk the tree under a directory.
+*
+* Inputs    : char *dirname - name of the top level directory
+*             void (*scan_dir)() - function to read one open directory
+*                                  and gather its subdirectories
+*             int release_subtrees - 1 to free the memory of each
+*                                    subtree once it has been walked
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : traverse_tree(dirname,scan_directory,opt_U);
+*
+* Notes     : The walk is depth first with an explicit stack of open
+*             directories instead of recursion , so the depth of the
+*             tree is only limited by the number of descriptors. Each
+*             directory stays open while its subdirectories are walked
+*             so that every file is opened and stat'ed relative to the
+*             descriptor of its own directory. The subdirectories are
+*             taken in the order in which they were found.
+*
+*********************************************************************/
+
+void traverse_tree(char *dirname, void (*scan_dir)(DIRREADER *, DIRINFO *, NAMESLIST *),
+				int release_subtrees)
+{
+	DIRFRAME	*stack , *frame;
+	NAMESLIST	subdirs;
+	NAME	*subdir;
+	DIRINFO	*dir;
+	char	*trimmed;
+	int		depth , stack_size;
+	ARENAMARK	node_mark , string_mark;
+
+	trimmed = _strdup(dirname);
+	if ( trimmed == NULL ) {
+		quit(1,"strdup failed for dirname");
+	} /* IF */
+	trim_trailing_chars(trimmed,'/');
+	memset(&node_mark,0,sizeof(node_mark));
+	memset(&string_mark,0,sizeof(string_mark));
+
+	stack_size = 64;
+	stack = (DIRFRAME *)malloc(stack_size * sizeof(DIRFRAME));
+	if ( stack == NULL ) {
+		quit(1,"malloc failed for traversal stack");
+	} /* IF */
+	depth = 0;
+	dir = new_dirinfo(NULL,trimmed);
+	subdir = NULL;
+	for ( ; ; ) {
+		frame = &stack[depth];
+		debug_print("traverse_tree(%s) : depth %d\n",dir->path,depth);
+		if ( open_dir_reader(&frame->reader,depth == 0 ? AT_FDCWD : stack[depth-1].reader.fd,
+					depth == 0 ? trimmed : subdir->name) < 0 ) {
+			if ( opt_watch == 0 ) {
+				quit(1,"_opendir failed for \"%s\"",dir->path_length > 0 ? dir->path : ".");
+			} /* IF */
+			system_error("_opendir failed for \"%s\"",dir->path_length > 0 ? dir->path : ".");
+		} /* IF it may have gone while being watched */
+		frame->dir = dir;
+		frame->node_mark = node_mark;
+		frame->string_mark = string_mark;
+		frame->next_subdir = NULL;
+		if ( frame->reader.fd >= 0 && (opt_R == 0 || enter_directory(dir,frame->reader.fd)) ) {
+			scan_dir(&frame->reader,dir,&subdirs);
+			frame->next_subdir = subdirs.first_name;
+		} /* IF */
+
+		for ( ; depth >= 0 && stack[depth].next_subdir == NULL ; --depth ) {
+			close_dir_reader(&stack[depth].reader);
+			if ( release_subtrees && depth > 0 ) {
+				arena_rewind(node_arena,&stack[depth].node_mark);
+				arena_rewind(string_arena,&stack[depth].string_mark);
+			} /* IF the subtree has already been shown */
+		} /* FOR each directory which is done */
+		if ( depth < 0 ) {
+			break;
+		} /* IF the whole tree is done */
+
+		frame = &stack[depth];
+		subdir = frame->next_subdir;
+		frame->next_subdir = subdir->next_name;
+		arena_mark(node_arena,&node_mark);
+		arena_mark(string_arena,&string_mark);
+		dir = new_dirinfo(frame->dir,subdir->name);
+		depth += 1;
+		if ( depth >= stack_size ) {
+			stack_size *= 2;
+			stack = (DIRFRAME *)realloc(stack,stack_size * sizeof(DIRFRAME));
+			if ( stack == NULL ) {
+				quit(1,"realloc failed for traversal stack");
+			} /* IF */
+		} /* IF */
+	} /* FOR */
+	free(stack);
+	free(trimmed);
+
+	return;
+} /* end of traverse_tree */
+
+/*********************************************************************
+*
+* Function  : list_directory
+*
+* Purpose   : List the files under a directory.
+*
+* Inputs    : char *dirname - name of directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : list_directory(dirname);
+*
+* Notes     : For 'U' the memory used by each subtree is released once
+*             it has been listed.
+*
+*********************************************************************/
+
+void list_directory(char *dirname)
+{
+	traverse_tree(dirname,scan_directory,opt_U);
+
+	return;
+} /* end of list_directory */
+
+/*********************************************************************
+*
+* Function  : push_job
+*
+* Purpose   : Push a directory job onto the bottom of a worker's deque.
+*
+* Inputs    : WORKER *worker - the worker which owns the deque
+*             DIRJOB *job - the job
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : push_job(worker,job);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void push_job(WORKER *worker, DIRJOB *job)
+{
+	DEQUE	*deque;
+	DIRJOB	**jobs;
+	int		count;
+
+	deque = &worker->deque;
+	pthread_mutex_lock(&deque->lock);
+	if ( deque->bottom >= deque->capacity ) {
+		count = deque->bottom - deque->top;
+		if ( count < deque->capacity / 2 ) {
+			memmove(deque->jobs,&deque->jobs[deque->top],count * sizeof(DIRJOB *));
+		} /* IF there is enough room below the top */
+		else {
+			deque->capacity = (deque->capacity == 0) ? 256 : deque->capacity * 2;
+			jobs = (DIRJOB **)malloc(deque->capacity * sizeof(DIRJOB *));
+			if ( jobs == NULL ) {
+				quit(1,"malloc failed for %d deque entries",deque->capacity);
+			} /* IF */
+			if ( count > 0 ) {
+				memcpy(jobs,&deque->jobs[deque->top],count * sizeof(DIRJOB *));
+			} /* IF */
+			free(deque->jobs);
+			deque->jobs = jobs;
+		} /* ELSE */
+		deque->top = 0;
+		deque->bottom = count;
+	} /* IF deque is full */
+	deque->jobs[deque->bottom++] = job;
+	pthread_mutex_unlock(&deque->lock);
+
+	return;
+} /* end of push_job */
+
+/*********************************************************************
+*
+* Function  : take_job
+*
+* Purpose   : Take a directory job from a worker's deque.
+*
+* Inputs    : WORKER *worker - the worker which owns the deque
+*             int steal - 0 to pop from the bottom (the owner) , 1 to
+*                         steal from the top (another worker)
+*
+* Output    : (none)
+*
+* Returns   : DIRJOB *job - the job , NULL if the deque is empty
+*
+* Example   : job = take_job(worker,0);
+*
+* Notes     : The owner works depth first on the newest jobs while a
+*             thief takes the oldest one , which is nearest the top of
+*             the tree and so most likely to have a large subtree.
+*
+*********************************************************************/
+
+DIRJOB *take_job(WORKER *worker, int steal)
+{
+	DEQUE	*deque;
+	DIRJOB	*job;
+
+	deque = &worker->deque;
+	job = NULL;
+	pthread_mutex_lock(&deque->lock);
+	if ( deque->bottom > deque->top ) {
+		if ( steal ) {
+			job = deque->jobs[deque->top++];
+		} /* IF */
+		else {
+			job = deque->jobs[--deque->bottom];
+		} /* ELSE */
+		if ( deque->top == deque->bottom ) {
+			deque->top = deque->bottom = 0;
+		} /* IF */
+	} /* IF */
+	pthread_mutex_unlock(&deque->lock);
+
+	return(job);
+} /* end of take_job */
+
+/*********************************************************************
+*
+* Function  : release_parent_job
+*
+* Purpose   : Note that a child of a directory job has been opened.
+*
+* Inputs    : DIRJOB *parent - the parent job
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : release_parent_job(job->parent);
+*
+* Notes     : The parent directory is closed once all of its children
+*             have been opened relative to it.
+*
+*********************************************************************/
+
+void release_parent_job(DIRJOB *parent)
+{
+	if ( atomic_fetch_sub(&parent->pending,1) == 1 ) {
+		close_dir_reader(&parent->reader);
+	} /* IF last child */
+
+	return;
+} /* end of release_parent_job */
+
+/*********************************************************************
+*
+* Function  : run_dir_job
+*
+* Purpose   : List one directory for a traversal worker.
+*
+* Inputs    : WORKER *worker - the worker
+*             DIRJOB *job - the job for the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : run_dir_job(worker,job);
+*
+* Notes     : The entries go to the worker's own list , the job records
+*             where they are. A job is created for every subdirectory
+*             and pushed so that the first one is popped first.
+*
+*********************************************************************/
+
+void run_dir_job(WORKER *worker, DIRJOB *job)
+{
+	NAMESLIST	subdirs;
+	NAME	*subdir;
+	DIRJOB	*child;
+	int		parent_fd , index;
+
+	debug_print("run_dir_job(%s) : worker %d\n",job->dir->path,worker->id);
+	parent_fd = (job->parent == NULL) ? AT_FDCWD : job->parent->reader.fd;
+	if ( open_dir_reader(&job->reader,parent_fd,job->name) < 0 ) {
+		quit(1,"_opendir failed for \"%s\"",job->dir->path_length > 0 ? job->dir->path : ".");
+	} /* IF */
+	if ( job->parent != NULL ) {
+		release_parent_job(job->parent);
+	} /* IF */
+
+	job->list = &worker->files;
+	job->first = worker->files.count;
+	if ( ! enter_directory(job->dir,job->reader.fd) ) {
+		job->count = 0;
+		close_dir_reader(&job->reader);
+		return;
+	} /* IF */
+	scan_directory(&job->reader,job->dir,&subdirs);
+	job->count = worker->files.count - job->first;
+	worker->num_jobs += 1;
+
+	job->num_children = subdirs.num_names;
+	if ( job->num_children == 0 ) {
+		close_dir_reader(&job->reader);
+		return;
+	} /* IF */
+	job->children = (DIRJOB **)calloc(job->num_children,sizeof(DIRJOB *));
+	if ( job->children == NULL ) {
+		quit(1,"calloc failed for %d child jobs",job->num_children);
+	} /* IF */
+	subdir = subdirs.first_name;
+	for ( index = 0 ; subdir != NULL ; subdir = subdir->next_name , ++index ) {
+		child = (DIRJOB *)calloc(1,sizeof(DIRJOB));
+		if ( child == NULL ) {
+			quit(1,"calloc failed for DIRJOB");
+		} /* IF */
+		child->parent = job;
+		child->name = subdir->name;
+		child->dir = new_dirinfo(job->dir,subdir->name);
+		job->children[index] = child;
+	} /* FOR */
+
+	atomic_store(&job->pending,job->num_children);
+	atomic_fetch_add(&outstanding_jobs,job->num_children);
+	for ( index = job->num_children - 1 ; index >= 0 ; --index ) {
+		push_job(worker,job->children[index]);
+	} /* FOR */
+	pthread_mutex_lock(&idle_lock);
+	pthread_cond_broadcast(&idle_cond);
+	pthread_mutex_unlock(&idle_lock);
+
+	return;
+} /* end of run_dir_job */
+
+/*********************************************************************
+*
+* Function  : traversal_worker
+*
+* Purpose   : Thread function for the parallel directory traversal.
+*
+* Inputs    : void *arg - ptr to the WORKER for the thread
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&worker->thread,NULL,traversal_worker,worker);
+*
+* Notes     : A worker runs the jobs from its own deque and steals from
+*             the other workers when that is empty. It finishes when no
+*             job is queued or running anywhere.
+*
+*********************************************************************/
+
+void *traversal_worker(void *arg)
+{
+	WORKER	*worker;
+	DIRJOB	*job;
+	LIST	*saved_list;
+	int		index;
+	struct timespec	deadline;
+
+	worker = (WORKER *)arg;
+	saved_list = current_list;
+	current_list = &worker->files;
+	for ( ; ; ) {
+		job = take_job(worker,0);
+		for ( index = 1 ; job == NULL && index < opt_j ; ++index ) {
+			job = take_job(&workers[(worker->id + index) % opt_j],1);
+			if ( job != NULL ) {
+				worker->num_steals += 1;
+			} /* IF */
+		} /* FOR each other worker */
+		if ( job != NULL ) {
+			run_dir_job(worker,job);
+			if ( atomic_fetch_sub(&outstanding_jobs,1) == 1 ) {
+				pthread_mutex_lock(&idle_lock);
+				pthread_cond_broadcast(&idle_cond);
+				pthread_mutex_unlock(&idle_lock);
+			} /* IF that was the last job */
+			continue;
+		} /* IF */
+
+		pthread_mutex_lock(&idle_lock);
+		if ( atomic_load(&outstanding_jobs) == 0 ) {
+			pthread_mutex_unlock(&idle_lock);
+			break;
+		} /* IF all done */
+		clock_gettime(CLOCK_REALTIME,&deadline);
+		deadline.tv_nsec += 1000000;
+		if ( deadline.tv_nsec >= 1000000000 ) {
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000;
+		} /* IF */
+		pthread_cond_timedwait(&idle_cond,&idle_lock,&deadline);
+		pthread_mutex_unlock(&idle_lock);
+	} /* FOR */
+	current_list = saved_list;
+
+	return(NULL);
+} /* end of traversal_worker */
+
+/*********************************************************************
+*
+* Function  : merge_job_entries
+*
+* Purpose   : Move the entries found by a directory job and all of its
+*             descendants to the list of files.
+*
+* Inputs    : DIRJOB *job - the job
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : merge_job_entries(root_job);
+*
+* Notes     : The jobs are visited in the order used by list_directory
+*             so the list ends up exactly as a serial traversal would
+*             have left it. For '--top' the entries are offered to the
+*             bounded list instead.
+*
+*********************************************************************/
+
+void merge_job_entries(DIRJOB *job)
+{
+	int		index;
+	ENTRYINFO	info;
+	char	*name;
+
+	for ( index = 0 ; index < job->count ; ++index ) {
+		if ( opt_top ) {
+			get_entry_info(job->list,job->first + index,&info);
+			name = FILE_NAME(job->list,job->first + index);
+			add_top_entry(FILE_DIR(job->list,job->first + index),name,NAME_LENGTH(name),&info);
+		} /* IF */
+		else {
+			copy_list_entry(&Files,job->list,job->first + index);
+		} /* ELSE */
+	} /* FOR */
+	for ( index = 0 ; index < job->num_children ; ++index ) {
+		merge_job_entries(job->children[index]);
+		free(job->children[index]);
+	} /* FOR */
+	free(job->children);
+
+	return;
+} /* end of merge_job_entries */
+
+/*********************************************************************
+*
+* Function  : list_directory_parallel
+*
+* Purpose   : Recursively list the files under a directory using a pool
+*             of worker threads.
+*
+* Inputs    : char *dirname - name of directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : list_directory_parallel(dirname);
+*
+* Notes     : The calling thread acts as worker 0.
+*
+*********************************************************************/
+
+void list_directory_parallel(char *dirname)
+{
+	DIRJOB	root;
+	int		index;
+
+	if ( workers == NULL ) {
+		workers = (WORKER *)calloc(opt_j,sizeof(WORKER));
+		if ( workers == NULL ) {
+			quit(1,"calloc failed for %d workers",opt_j);
+		} /* IF */
+		for ( index = 0 ; index < opt_j ; ++index ) {
+			workers[index].id = index;
+			pthread_mutex_init(&workers[index].deque.lock,NULL);
+		} /* FOR */
+	} /* IF */
+
+	memset(&root,0,sizeof(root));
+	root.name = _strdup(dirname);
+	if ( root.name == NULL ) {
+		quit(1,"strdup failed for dirname");
+	} /* IF */
+	trim_trailing_chars(root.name,'/');
+	root.dir = new_dirinfo(NULL,root.name);
+
+	atomic_store(&outstanding_jobs,1);
+	push_job(&workers[0],&root);
+	for ( index = 1 ; index < opt_j ; ++index ) {
+		if ( pthread_create(&workers[index].thread,NULL,traversal_worker,&workers[index]) != 0 ) {
+			quit(1,"pthread_create failed");
+		} /* IF */
+	} /* FOR */
+	traversal_worker(&workers[0]);
+	for ( index = 1 ; index < opt_j ; ++index ) {
+		pthread_join(workers[index].thread,NULL);
+	} /* FOR */
+
+	merge_job_entries(&root);
+	free(root.name);
+	for ( index = 0 ; index < opt_j ; ++index ) {
+		debug_print("list_directory_parallel(%s) : worker %d ran %ld jobs , %ld stolen\n",
+				dirname,index,workers[index].num_jobs,workers[index].num_steals);
+		clear_list(&workers[index].files);
+		workers[index].num_jobs = 0;
+		workers[index].num_steals = 0;
+	} /* FOR */
+
+	return;
+} /* end of list_directory_parallel */
+
+/*********************************************************************
+*
+* Function  : init_queue
+*
+* Purpose   : Initialize a bounded single producer / single consumer
+*             queue.
+*
+* Inputs    : QUEUE *queue - the queue
+*             int size - number of slots , a power of 2
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : init_queue(&Pipe.stat_queue,PIPE_BATCHES);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void init_queue(QUEUE *queue, int size)
+{
+	queue->slots = (void **)calloc(size,sizeof(void *));
+	if ( queue->slots == NULL ) {
+		quit(1,"calloc failed for %d queue slots",size);
+	} /* IF */
+	queue->mask = size - 1;
+	atomic_store(&queue->head,0);
+	atomic_store(&queue->tail,0);
+	atomic_store(&queue->sleepers,0);
+	queue->num_waits = 0;
+	pthread_mutex_init(&queue->lock,NULL);
+	pthread_cond_init(&queue->cond,NULL);
+
+	return;
+} /* end of init_queue */
+
+/*********************************************************************
+*
+* Function  : wait_queue
+*
+* Purpose   : Wait until a queue has room or has an item.
+*
+* Inputs    : QUEUE *queue - the queue
+*             int for_room - 1 to wait for a free slot , 0 for an item
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : wait_queue(queue,1);
+*
+* Notes     : Only the slow path takes the lock. The sleeper count is
+*             raised before the queue is checked again and the other
+*             side checks it after moving its index , so one of the two
+*             always sees the other and no wakeup is lost.
+*
+*********************************************************************/
+
+void wait_queue(QUEUE *queue, int for_room)
+{
+	unsigned long	head , tail;
+	int		spins;
+
+	for ( spins = 0 ; spins < QUEUE_SPINS ; ++spins ) {
+		head = atomic_load(&queue->head);
+		tail = atomic_load(&queue->tail);
+		if ( for_room ? tail - head <= queue->mask : tail != head ) {
+			return;
+		} /* IF */
+	} /* FOR */
+
+	pthread_mutex_lock(&queue->lock);
+	atomic_fetch_add(&queue->sleepers,1);
+	head = atomic_load(&queue->head);
+	tail = atomic_load(&queue->tail);
+	if ( for_room ? tail - head > queue->mask : tail == head ) {
+		queue->num_waits += 1;
+		pthread_cond_wait(&queue->cond,&queue->lock);
+	} /* IF still blocked */
+	atomic_fetch_sub(&queue->sleepers,1);
+	pthread_mutex_unlock(&queue->lock);
+
+	return;
+} /* end of wait_queue */
+
+/*********************************************************************
+*
+* Function  : wake_queue
+*
+* Purpose   : Wake up the other side of a queue if it is asleep.
+*
+* Inputs    : QUEUE *queue - the queue
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : wake_queue(queue);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void wake_queue(QUEUE *queue)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if ( atomic_load(&queue->sleepers) > 0 ) {
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->lock);
+	} /* IF */
+
+	return;
+} /* end of wake_queue */
+
+/*********************************************************************
+*
+* Function  : put_on_queue
+*
+* Purpose   : Add an item to the end of a queue.
+*
+* Inputs    : QUEUE *queue - the queue
+*             void *item - the item (NULL marks the end of the data)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : put_on_queue(&Pipe.stat_queue,batch);
+*
+* Notes     : Blocks while the queue is full , which is what holds back
+*             a stage that gets ahead of the next one.
+*
+*********************************************************************/
+
+void put_on_queue(QUEUE *queue, void *item)
+{
+	unsigned long	tail;
+
+	tail = atomic_load_explicit(&queue->tail,memory_order_relaxed);
+	while ( tail - atomic_load_explicit(&queue->head,memory_order_acquire) > queue->mask ) {
+		wait_queue(queue,1);
+	} /* WHILE */
+	queue->slots[tail & queue->mask] = item;
+	atomic_store_explicit(&queue->tail,tail + 1,memory_order_release);
+	wake_queue(queue);
+
+	return;
+} /* end of put_on_queue */
+
+/*********************************************************************
+*
+* Function  : get_from_queue
+*
+* Purpose   : Take the item at the front of a queue.
+*
+* Inputs    : QUEUE *queue - the queue
+*
+* Output    : (none)
+*
+* Returns   : the item
+*
+* Example   : batch = (PIPEBATCH *)get_from_queue(&Pipe.stat_queue);
+*
+* Notes     : Blocks while the queue is empty.
+*
+*********************************************************************/
+
+void *get_from_queue(QUEUE *queue)
+{
+	unsigned long	head;
+	void	*item;
+
+	head = atomic_load_explicit(&queue->head,memory_order_relaxed);
+	while ( atomic_load_explicit(&queue->tail,memory_order_acquire) == head ) {
+		wait_queue(queue,0);
+	} /* WHILE */
+	item = queue->slots[head & queue->mask];
+	atomic_store_explicit(&queue->head,head + 1,memory_order_release);
+	wake_queue(queue);
+
+	return(item);
+} /* end of get_from_queue */
+
+/*********************************************************************
+*
+* Function  : pipe_stat_stage
+*
+* Purpose   : Thread function for the stat stage of the pipeline.
+*
+* Inputs    : void *arg - (not used)
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&Pipe.stat_thread,NULL,pipe_stat_stage,NULL);
+*
+* Notes     : Batches of directory entries are stat'ed and passed on to
+*             the list stage. With "--async-stat" the stats of a batch
+*             are issued all at once through the engine of this thread.
+*
+*********************************************************************/
+
+void *pipe_stat_stage(void *arg)
+{
+	PIPEBATCH	*pipe_batch;
+	STATBATCH	*batch;
+	BATCHENTRY	*entry;
+	int		index;
+
+	for ( ; ; ) {
+		pipe_batch = (PIPEBATCH *)get_from_queue(&Pipe.stat_queue);
+		if ( pipe_batch == NULL ) {
+			break;
+		} /* IF end of the data */
+		batch = pipe_batch->stats;
+		if ( opt_async_stat ) {
+			batch->engine = get_stat_batch()->engine;
+			stat_batch(batch,pipe_batch->dir_fd);
+		} /* IF */
+		else {
+			for ( index = 0 ; index < batch->count ; ++index ) {
+				entry = &batch->entries[index];
+				if ( entry->need_stat == STAT_NEEDED && fstatat(pipe_batch->dir_fd,
+						&batch->names[entry->name_offset],&entry->filestats,0) < 0 ) {
+					entry->status = errno;
+				} /* IF */
+			} /* FOR */
+		} /* ELSE */
+		if ( pipe_batch->dir_fd >= 0 ) {
+			close(pipe_batch->dir_fd);
+			pipe_batch->dir_fd = -1;
+		} /* IF */
+		put_on_queue(&Pipe.list_queue,pipe_batch);
+	} /* FOR */
+	put_on_queue(&Pipe.list_queue,NULL);
+
+	return(NULL);
+} /* end of pipe_stat_stage */
+
+/*********************************************************************
+*
+* Function  : pipe_list_stage
+*
+* Purpose   : Thread function for the list stage of the pipeline.
+*
+* Inputs    : void *arg - (not used)
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&Pipe.list_thread,NULL,pipe_list_stage,NULL);
+*
+* Notes     : The stat'ed entries are added to the list of files , for
+*             'U' they are formatted as soon as a directory is done.
+*             This is the only thread which touches the list of files
+*             while the pipeline runs.
+*
+*********************************************************************/
+
+void *pipe_list_stage(void *arg)
+{
+	PIPEBATCH	*pipe_batch;
+	STATBATCH	*batch;
+	BATCHENTRY	*entry;
+	int		index;
+
+	for ( ; ; ) {
+		pipe_batch = (PIPEBATCH *)get_from_queue(&Pipe.list_queue);
+		if ( pipe_batch == NULL ) {
+			break;
+		} /* IF end of the data */
+		batch = pipe_batch->stats;
+		for ( index = 0 ; index < batch->count ; ++index ) {
+			entry = &batch->entries[index];
+			add_scanned_entry(pipe_batch->dir,&batch->names[entry->name_offset],entry->type,
+					entry->need_stat != 0,entry->status,&entry->filestats,NULL,entry->verdict);
+		} /* FOR */
+		if ( opt_U && pipe_batch->last ) {
+			stream_files();
+		} /* IF */
+		batch->count = 0;
+		batch->names_used = 0;
+		put_on_queue(&Pipe.free_batches,pipe_batch);
+	} /* FOR */
+
+	return(NULL);
+} /* end of pipe_list_stage */
+
+/*********************************************************************
+*
+* Function  : get_pipe_batch
+*
+* Purpose   : Get an empty batch for the traversal stage.
+*
+* Inputs    : DIRINFO *dir - the directory of the entries
+*             int dir_fd - descriptor for the directory , -1 for none
+*
+* Output    : (none)
+*
+* Returns   : PIPEBATCH *batch - the batch
+*
+* Example   : pipe_batch = get_pipe_batch(dir,reader.fd);
+*
+* Notes     : Waits until a batch comes back from the list stage when
+*             they are all in use. The batch gets its own copy of the
+*             descriptor since the traversal may be done with the
+*             directory before the batch is stat'ed.
+*
+*********************************************************************/
+
+PIPEBATCH *get_pipe_batch(DIRINFO *dir, int dir_fd)
+{
+	PIPEBATCH	*pipe_batch;
+
+	pipe_batch = (PIPEBATCH *)get_from_queue(&Pipe.free_batches);
+	pipe_batch->dir = dir;
+	pipe_batch->last = 0;
+	pipe_batch->dir_fd = -1;
+	if ( dir_fd >= 0 ) {
+		pipe_batch->dir_fd = fcntl(dir_fd,F_DUPFD_CLOEXEC,0);
+		if ( pipe_batch->dir_fd < 0 ) {
+			quit(1,"dup failed for \"%s\"",dir->path_length > 0 ? dir->path : ".");
+		} /* IF */
+	} /* IF */
+
+	return(pipe_batch);
+} /* end of get_pipe_batch */
+
+/*********************************************************************
+*
+* Function  : pipe_scan_directory
+*
+* Purpose   : Send the entries of an open directory down the pipeline.
+*
+* Inputs    : DIRREADER *reader - reader for the directory
+*             DIRINFO *dir - information for the directory
+*             NAMESLIST *subdirs - to receive the names of the
+*                                  subdirectories for 'R'
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : traverse_tree(dirname,pipe_scan_directory,0);
+*
+* Notes     : This is the traversal stage , it only reads the directory.
+*             An entry is stat'ed here only when 'R' needs to know
+*             whether it is a directory and d_type can not tell.
+*
+*********************************************************************/
+
+void pipe_scan_directory(DIRREADER *reader, DIRINFO *dir, NAMESLIST *subdirs)
+{
+	PIPEBATCH	*pipe_batch;
+	BATCHENTRY	*entry;
+	char	*name;
+	unsigned char	type;
+	int		need_stat , is_dir , is_full , verdict;
+
+	memset(subdirs,0,sizeof(NAMESLIST));
+	pipe_batch = get_pipe_batch(dir,reader->fd);
+	name = read_dir_entry(reader,&type);
+	for ( ; name != NULL ; name = read_dir_entry(reader,&type) ) {
+		need_stat = entry_needs_stat(dir,name,type);
+		verdict = prefilter_entry(dir,name,type,&need_stat);
+		is_full = add_to_stat_batch(pipe_batch->stats,name,type,need_stat,verdict);
+		if ( (type != DT_DIR && type != DT_UNKNOWN && type != DT_LNK) ||
+					EQ(name,".") || EQ(name,"..") || ! descend_into(dir,name) ) {
+			is_dir = 0;
+		} /* IF it is not a directory to be walked */
+		else if ( type == DT_DIR ) {
+			is_dir = 1;
+		} /* ELSE IF */
+		else {
+			entry = &pipe_batch->stats->entries[pipe_batch->stats->count-1];
+			if ( fstatat(reader->fd,name,&entry->filestats,0) < 0 ) {
+				entry->status = errno;
+			} /* IF */
+			entry->need_stat = STAT_DONE;
+			is_dir = (entry->status == 0 && _S_ISDIR(entry->filestats.st_mode & _S_IFMT));
+		} /* ELSE only a stat can tell if it is a directory */
+		if ( is_dir ) {
+			add_subdir_name(subdirs,name);
+		} /* IF */
+		if ( is_full ) {
+			put_on_queue(&Pipe.stat_queue,pipe_batch);
+			pipe_batch = get_pipe_batch(dir,reader->fd);
+		} /* IF */
+	} /* FOR */
+	pipe_batch->last = 1;
+	put_on_queue(&Pipe.stat_queue,pipe_batch);
+	debug_print("pipe_scan_directory(%s) : %d entries , %d getdents64 calls\n",
+			dir->path,reader->num_entries,reader->num_reads);
+
+	return;
+} /* end of pipe_scan_directory */
+
+/*********************************************************************
+*
+* Function  : pipe_list_directory
+*
+* Purpose   : List the files under a directory through the pipeline.
+*
+* Inputs    : char *dirname - name of directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : pipe_list_directory(dirname);
+*
+* Notes     : The tree is walked in the same order as list_directory().
+*             Nothing is released along the way since the later stages
+*             may still be using the directory information.
+*
+*********************************************************************/
+
+void pipe_list_directory(char *dirname)
+{
+	traverse_tree(dirname,pipe_scan_directory,0);
+
+	return;
+} /* end of pipe_list_directory */
+
+/*********************************************************************
+*
+* Function  : pipe_add_file
+*
+* Purpose   : Send a file named on the command line down the pipeline.
+*
+* Inputs    : char *filename - name of the file
+*             struct _stat *filestats - ptr to stat structure
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : pipe_add_file(filename,&filestats);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void pipe_add_file(char *filename, struct _stat *filestats)
+{
+	PIPEBATCH	*pipe_batch;
+	BATCHENTRY	*entry;
+
+	pipe_batch = get_pipe_batch(&NoDir,-1);
+	add_to_stat_batch(pipe_batch->stats,filename,DT_UNKNOWN,STAT_DONE,FILTER_UNKNOWN);
+	entry = &pipe_batch->stats->entries[0];
+	entry->filestats = *filestats;
+	pipe_batch->last = 1;
+	put_on_queue(&Pipe.stat_queue,pipe_batch);
+
+	return;
+} /* end of pipe_add_file */
+
+/*********************************************************************
+*
+* Function  : start_pipeline
+*
+* Purpose   : Start the threads of the pipeline.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : start_pipeline();
+*
+* Notes     : The calling thread becomes the traversal stage. The output
+*             writer is started as well and keeps running through the
+*             display of a sorted listing.
+*
+*********************************************************************/
+
+void start_pipeline()
+{
+	int		index;
+
+	init_queue(&Pipe.free_batches,PIPE_BATCHES);
+	init_queue(&Pipe.stat_queue,PIPE_BATCHES);
+	init_queue(&Pipe.list_queue,PIPE_BATCHES);
+	for ( index = 0 ; index < PIPE_BATCHES ; ++index ) {
+		Pipe.batches[index].stats = new_stat_batch();
+		put_on_queue(&Pipe.free_batches,&Pipe.batches[index]);
+	} /* FOR */
+
+	init_queue(&Pipe.free_outputs,PIPE_OUTPUTS);
+	init_queue(&Pipe.full_outputs,PIPE_OUTPUTS);
+	for ( index = 0 ; index < PIPE_OUTPUTS ; ++index ) {
+		Pipe.outputs[index].size = OUTPUT_BUFFER_SIZE;
+		Pipe.outputs[index].data = (char *)malloc(OUTPUT_BUFFER_SIZE);
+		if ( Pipe.outputs[index].data == NULL ) {
+			quit(1,"malloc failed for output buffer");
+		} /* IF */
+		put_on_queue(&Pipe.free_outputs,&Pipe.outputs[index]);
+	} /* FOR */
+
+	atomic_store(&Pipe.running,1);
+	if ( pthread_create(&Pipe.writer_thread,NULL,output_writer,NULL) != 0 ||
+			pthread_create(&Pipe.stat_thread,NULL,pipe_stat_stage,NULL) != 0 ||
+			pthread_create(&Pipe.list_thread,NULL,pipe_list_stage,NULL) != 0 ) {
+		quit(1,"pthread_create failed");
+	} /* IF */
+	Pipe.writing = 1;
+
+	return;
+} /* end of start_pipeline */
+
+/*********************************************************************
+*
+* Function  : finish_pipeline
+*
+* Purpose   : Wait for the stat and list stages to drain.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : finish_pipeline();
+*
+* Notes     : The end of the data is passed down the stages as a NULL
+*             batch.
+*
+*********************************************************************/
+
+void finish_pipeline()
+{
+	int		index;
+
+	put_on_queue(&Pipe.stat_queue,NULL);
+	pthread_join(Pipe.stat_thread,NULL);
+	pthread_join(Pipe.list_thread,NULL);
+	atomic_store(&Pipe.running,0);
+	debug_print("finish_pipeline() : waits for a batch %ld , for the stat stage %ld , for the list stage %ld\n",
+			Pipe.free_batches.num_waits,Pipe.stat_queue.num_waits,Pipe.list_queue.num_waits);
+	for ( index = 0 ; index < PIPE_BATCHES ; ++index ) {
+		free(Pipe.batches[index].stats->names);
+		free(Pipe.batches[index].stats);
+	} /* FOR */
+
+	return;
+} /* end of finish_pipeline */
+
+/*********************************************************************
+*
+* Function  : build_mode_table
+*
+* Purpose   : Build the table of permission strings.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : build_mode_table();
+*
+* Notes     : There is one 9 character string for each of the 4096
+*             combinations of the permission , setuid , setgid and
+*             sticky bits.
+*
+*********************************************************************/
+
+void build_mode_table()
+{
+	int		mode , setids;
+	char	*ptr;
+
+	for ( mode = 0 ; mode < 4096 ; ++mode ) {
+		ptr = mode_table[mode];
+		memcpy(&ptr[0],perms[ (mode & 0700) >> 6 ],3);
+		memcpy(&ptr[3],perms[ (mode & 0070) >> 3 ],3);
+		memcpy(&ptr[6],perms[ mode & 0007 ],3);
+		setids = (mode & 07000) >> 9;
+		if ( setids & 01 ) { // sticky bit
+			ptr[8] = (ptr[8] == 'x') ? 't' : 'T';
+		}
+		if ( setids & 04 ) { // setuid bit
+			ptr[2] = (ptr[2] == 'x') ? 's' : 'S';
+		}
+		if ( setids & 02 ) { // setgid bit
+			ptr[5] = (ptr[5] == 'x') ? 's' : 'S';
+		}
+	} /* FOR */
+
+	return;
+} /* end of build_mode_table */
+
+/*********************************************************************
+*
+* Function  : format_mode
+*
+* Purpose   : Format binary permission bits into a printable ASCII string
+*
+* Inputs    : unsigned short file_mode - mode bits from stat()
+*             char *mode_info - buffer to receive formatted info
+*
+* Output    : (none)
+*
+* Returns   : formatted mode info
+*
+* Example   : format_mode(filestat->st_mode,mode_info);
+*
+* Notes     : mode_info receives 10 characters , it is not terminated.
+*
+*********************************************************************/
+
+void format_mode(unsigned short file_mode, char *mode_info)
+{
+	mode_info[0] = ftypes[ (file_mode & 0170000) >> 12 ];
+	memcpy(&mode_info[1],mode_table[file_mode & 07777],9);
+
+	return;
+} /* end of format_mode */
+
+/*********************************************************************
+*
+* Function  : write_output
+*
+* Purpose   : Write a block of data to standard output.
+*
+* Inputs    : char *data - the data
+*             size_t length - number of bytes
+*
+* Output    : the data
+*
+* Returns   : (nothing)
+*
+* Example   : write_output(Output.data,Output.used);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void write_output(char *data, size_t length)
+{
+	ssize_t	count;
+
+	while ( length > 0 ) {
+		count = write(1,data,length);
+		if ( count < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			} /* IF */
+			quit(1,"write failed for standard output");
+		} /* IF */
+		data += count;
+		length -= count;
+	} /* WHILE */
+
+	return;
+} /* end of write_output */
+
+/*********************************************************************
+*
+* Function  : output_writer
+*
+* Purpose   : Thread function for the output stage of the pipeline.
+*
+* Inputs    : void *arg - (not used)
+*
+* Output    : the listing
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&Pipe.writer_thread,NULL,output_writer,NULL);
+*
+* Notes     : Full buffers are written out and handed back empty , so
+*             formatting goes on while a write is blocked.
+*
+*********************************************************************/
+
+void *output_writer(void *arg)
+{
+	OUTBUF	*buffer;
+
+	for ( ; ; ) {
+		buffer = (OUTBUF *)get_from_queue(&Pipe.full_outputs);
+		if ( buffer == NULL ) {
+			break;
+		} /* IF end of the data */
+		write_output(buffer->data,buffer->used);
+		buffer->used = 0;
+		put_on_queue(&Pipe.free_outputs,buffer);
+	} /* FOR */
+
+	return(NULL);
+} /* end of output_writer */
+
+/*********************************************************************
+*
+* Function  : stop_output_writer
+*
+* Purpose   : Write out everything still queued and stop the writer.
+*
+* Inputs    : (none)
+*
+* Output    : the rest of the listing
+*
+* Returns   : (nothing)
+*
+* Example   : stop_output_writer();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void stop_output_writer()
+{
+	if ( Pipe.writing == 0 ) {
+		return;
+	} /* IF */
+	flush_output();
+	put_on_queue(&Pipe.full_outputs,NULL);
+	pthread_join(Pipe.writer_thread,NULL);
+	Pipe.writing = 0;
+	debug_print("stop_output_writer() : waits for a buffer %ld , for the writer %ld\n",
+			Pipe.free_outputs.num_waits,Pipe.full_outputs.num_waits);
+
+	return;
+} /* end of stop_output_writer */
+
+/*********************************************************************
+*
+* Function  : flush_output
+*
+* Purpose   : Write out the contents of the output buffer.
+*
+* Inputs    : (none)
+*
+* Output    : the buffered output
+*
+* Returns   : (nothing)
+*
+* Example   : flush_output();
+*
+* Notes     : Also registered with atexit(). While the output writer
+*             runs the buffer is swapped for an empty one and queued.
+*
+*********************************************************************/
+
+void flush_output()
+{
+	OUTBUF	*buffer , full;
+
+	if ( Output.used == 0 ) {
+		return;
+	} /* IF */
+	if ( Pipe.writing ) {
+		buffer = (OUTBUF *)get_from_queue(&Pipe.free_outputs);
+		full = Output;
+		Output = *buffer;
+		*buffer = full;
+		put_on_queue(&Pipe.full_outputs,buffer);
+		return;
+	} /* IF */
+	write_output(Output.data,Output.used);
+	Output.used = 0;
+
+	return;
+} /* end of flush_output */
+
+/*********************************************************************
+*
+* Function  : output_space
+*
+* Purpose   : Make room in the output buffer.
+*
+* Inputs    : size_t length - number of bytes about to be added
+*
+* Output    : (none)
+*
+* Returns   : ptr to where the bytes go
+*
+* Example   : ptr = output_space(length);
+*
+* Notes     : The caller must add the bytes to Output.used.
+*
+*********************************************************************/
+
+char *output_space(size_t length)
+{
+	if ( Output.data == NULL ) {
+		Output.size = OUTPUT_BUFFER_SIZE;
+		Output.data = (char *)malloc(Output.size);
+		if ( Output.data == NULL ) {
+			quit(1,"malloc failed for output buffer");
+		} /* IF */
+		atexit(flush_output);
+	} /* IF */
+	if ( Output.used + length > Output.size ) {
+		flush_output();
+		if ( length > Output.size ) {
+			Output.size = length;
+			free(Output.data);
+			Output.data = (char *)malloc(Output.size);
+			if ( Output.data == NULL ) {
+				quit(1,"malloc failed for output buffer");
+			} /* IF */
+		} /* IF a single item is bigger than the buffer */
+	} /* IF */
+
+	return(&Output.data[Output.used]);
+} /* end of output_space */
+
+/*********************************************************************
+*
+* Function  : format_int
+*
+* Purpose   : Format an integer right justified in a field.
+*
+* Inputs    : char *buffer - buffer to receive the digits
+*             long long value - the value
+*             int width - minimum field width (blank filled)
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : ptr += format_int(ptr,nlink,4);
+*
+* Notes     : Same result as sprintf() with "%*lld".
+*
+*********************************************************************/
+
+int format_int(char *buffer, long long value, int width)
+{
+	char	digits[24] , *ptr;
+	unsigned long long	magnitude;
+	int		length , pad;
+
+	ptr = &digits[sizeof(digits)];
+	magnitude = (value < 0) ? -(unsigned long long)value : (unsigned long long)value;
+	do {
+		*--ptr = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while ( magnitude > 0 );
+	if ( value < 0 ) {
+		*--ptr = '-';
+	} /* IF */
+	length = &digits[sizeof(digits)] - ptr;
+	pad = (width > length) ? width - length : 0;
+	memset(buffer,' ',pad);
+	memcpy(&buffer[pad],ptr,length);
+
+	return(pad + length);
+} /* end of format_int */
+
+/*********************************************************************
+*
+* Function  : format_day
+*
+* Purpose   : Format the date part of a time as "Mon DD, YYYY".
+*
+* Inputs    : char *buffer - buffer to receive the date
+*             struct tm *filetime - the broken down time
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : length = format_day(buffer,&filetime);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int format_day(char *buffer, struct tm *filetime)
+{
+	char	*ptr;
+
+	ptr = buffer;
+	memcpy(ptr,months[filetime->tm_mon],3);
+	ptr += 3;
+	*ptr++ = ' ';
+	ptr += format_int(ptr,filetime->tm_mday,2);
+	*ptr++ = ',';
+	*ptr++ = ' ';
+	ptr += format_int(ptr,1900 + filetime->tm_year,0);
+
+	return(ptr - buffer);
+} /* end of format_day */
+
+/*********************************************************************
+*
+* Function  : cache_day
+*
+* Purpose   : Remember the local day containing a time.
+*
+* Inputs    : time_t seconds - the time
+*             struct tm *filetime - the broken down time for seconds
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : cache_day(seconds,&filetime);
+*
+* Notes     : A day is only cached when it is exactly 86400 seconds
+*             long with one UTC offset, i.e. it contains no DST change
+*             (or leap second). Those days always go to localtime_r().
+*             The day is stored in the slots of both its first and
+*             last second so a lookup only has to probe one slot.
+*
+*********************************************************************/
+
+void cache_day(time_t seconds, struct tm *filetime)
+{
+	struct tm	edge;
+	DATECACHE	*slot;
+	time_t	start , end;
+
+	start = seconds - (filetime->tm_hour * 3600 + filetime->tm_min * 60 + filetime->tm_sec);
+	end = start + SECONDS_PER_DAY - 1;
+	if ( localtime_r(&start,&edge) == NULL || edge.tm_hour != 0 || edge.tm_min != 0
+				|| edge.tm_sec != 0 || edge.tm_mday != filetime->tm_mday ) {
+		return;
+	} /* IF day does not start at midnight */
+	if ( localtime_r(&end,&edge) == NULL || edge.tm_hour != 23 || edge.tm_min != 59
+				|| edge.tm_sec != 59 || edge.tm_mday != filetime->tm_mday ) {
+		return;
+	} /* IF day does not end at 23:59:59 */
+
+	slot = &date_cache[DATE_CACHE_SLOT(start)];
+	slot->start = start;
+	slot->length = format_day(slot->prefix,filetime);
+	date_cache[DATE_CACHE_SLOT(end)] = *slot;
+
+	return;
+} /* end of cache_day */
+
+/*********************************************************************
+*
+* Function  : format_date
+*
+* Purpose   : Format a time as "Mon DD, YYYY HH:MM:SS".
+*
+* Inputs    : char *buffer - buffer to receive the date
+*             time_t seconds - the time
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : ptr += format_date(ptr,seconds);
+*
+* Notes     : Files tend to share a handful of days , so the date part
+*             is taken from a per-thread cache of days and only the
+*             time of day is computed. On a miss localtime_r() is used
+*             and the day is added to the cache.
+*
+*********************************************************************/
+
+int format_date(char *buffer, time_t seconds)
+{
+	DATECACHE	*slot;
+	struct tm	filetime;
+	char	*ptr;
+	long	offset;
+
+	slot = &date_cache[DATE_CACHE_SLOT(seconds)];
+	if ( slot->length > 0 && seconds >= slot->start && seconds - slot->start < SECONDS_PER_DAY ) {
+		offset = seconds - slot->start;
+		filetime.tm_hour = offset / 3600;
+		filetime.tm_min = (offset / 60) % 60;
+		filetime.tm_sec = offset % 60;
+		memcpy(buffer,slot->prefix,slot->length);
+		ptr = buffer + slot->length;
+	} /* IF cached day */
+	else {
+		if ( localtime_r(&seconds,&filetime) == NULL ) {
+			memset(&filetime,0,sizeof(filetime));
+		} /* IF */
+		else {
+			cache_day(seconds,&filetime);
+		} /* ELSE */
+		ptr = buffer + format_day(buffer,&filetime);
+	} /* ELSE */
+	*ptr++ = ' ';
+	*ptr++ = '0' + filetime.tm_hour / 10;
+	*ptr++ = '0' + filetime.tm_hour % 10;
+	*ptr++ = ':';
+	*ptr++ = '0' + filetime.tm_min / 10;
+	*ptr++ = '0' + filetime.tm_min % 10;
+	*ptr++ = ':';
+	*ptr++ = '0' + filetime.tm_sec / 10;
+	*ptr++ = '0' + filetime.tm_sec % 10;
+
+	return(ptr - buffer);
+} /* end of format_date */
+
+
+/*********************************************************************
+*
+* Function  : find_hash_entry
+*
+* Purpose   : Find the slot of a version of a file in the digest table.
+*
+* Inputs    : unsigned long long device - device of the file
+*             unsigned long long inode - inode of the file
+*             long long size - size of the file
+*             long long mtime - mtime of the file in nanoseconds
+*
+* Output    : (none)
+*
+* Returns   : ptr to the entry , or to the empty slot where it goes
+*
+* Example   : entry = find_hash_entry(info->device,info->inode,info->size,info->mtime);
+*
+* Notes     : Open addressing with linear probing. The table is only
+*             added to before the workers start , so the lookups made
+*             while displaying need no lock.
+*
+*********************************************************************/
+
+HASHENTRY *find_hash_entry(unsigned long long device, unsigned long long inode, long long size, long long mtime)
+{
+	HASHENTRY	*entry;
+	unsigned long long	slot;
+
+	for ( slot = INODE_HASH(device,inode) & Hashes.mask ; ; slot = (slot + 1) & Hashes.mask ) {
+		entry = &Hashes.entries[slot];
+		if ( entry->state == HASH_EMPTY || (entry->record.inode == inode && entry->record.device == device &&
+					entry->record.size == size && entry->record.mtime == mtime) ) {
+			return(entry);
+		} /* IF */
+	} /* FOR */
+} /* end of find_hash_entry */
+
+/*********************************************************************
+*
+* Function  : load_hash_cache
+*
+* Purpose   : Read the digest cache for '--hash-cache' and size the
+*             digest table.
+*
+* Inputs    : long num_files - number of files about to be looked up
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : load_hash_cache(list->count);
+*
+* Notes     : A missing cache , or one for another algorithm or
+*             version , is treated as empty. So is one whose number of
+*             records does not match its size , as that number sizes
+*             the table , and one whose records do not match their
+*             checksum.
+*
+*********************************************************************/
+
+void load_hash_cache(long num_files)
+{
+	HASHHEADER	header;
+	HASHRECORD	record;
+	HASHENTRY	*entry;
+	FILE	*file;
+	struct _stat	filestats;
+	XXH3STATE	checksum;
+	unsigned char	digest[8];
+	unsigned long long	slots , count;
+
+	memset(&header,0,sizeof(header));
+	file = (opt_hash_cache != NULL) ? fopen(opt_hash_cache,"r") : NULL;
+	if ( file != NULL && (fread(&header,sizeof(header),1,file) != 1 ||
+				memcmp(header.magic,HASH_MAGIC,sizeof(header.magic)) != 0 ||
+				header.version != HASH_VERSION || header.algorithm != (unsigned int)opt_hash ||
+				fstat(fileno(file),&filestats) < 0 || filestats.st_size < (off_t)sizeof(header) ||
+				header.num_records != (filestats.st_size - sizeof(header)) / sizeof(HASHRECORD) ||
+				(filestats.st_size - sizeof(header)) % sizeof(HASHRECORD) != 0) ) {
+		debug_print("load_hash_cache(%s) : not a usable cache , ignored\n",opt_hash_cache);
+		header.num_records = 0;
+	} /* IF */
+
+	slots = 16;
+	while ( slots < 2 * (header.num_records + num_files) && slots < HASH_MAX_SLOTS ) {
+		slots *= 2;
+	} /* WHILE */
+	if ( header.num_records + num_files >= slots ) {
+		debug_print("load_hash_cache(%s) : %llu records do not fit , ignored\n",opt_hash_cache,header.num_records);
+		header.num_records = 0;
+	} /* IF the table could fill up , with no empty slot to end a probe */
+	Hashes.entries = (HASHENTRY *)calloc(slots,sizeof(HASHENTRY));
+	if ( Hashes.entries == NULL ) {
+		quit(1,"calloc failed for %llu digests",slots);
+	} /* IF */
+	Hashes.mask = slots - 1;
+
+	xxh3_start(&checksum);
+	for ( count = 0 ; count < header.num_records && fread(&record,sizeof(record),1,file) == 1 ; ++count ) {
+		xxh3_update(&checksum,(unsigned char *)&record,sizeof(record));
+		entry = find_hash_entry(record.device,record.inode,record.size,record.mtime);
+		if ( entry->state == HASH_EMPTY ) {
+			entry->record = record;
+			entry->state = HASH_CACHED;
+		} /* IF */
+	} /* FOR */
+	xxh3_digest(&checksum,digest);
+	if ( count != header.num_records || (count > 0 && memcmp(digest,header.checksum,sizeof(digest)) != 0) ) {
+		debug_print("load_hash_cache(%s) : checksum mismatch , ignored\n",opt_hash_cache);
+		memset(Hashes.entries,0,slots * sizeof(HASHENTRY));
+	} /* IF none of the records can be trusted */
+	if ( file != NULL ) {
+		fclose(file);
+	} /* IF */
+
+	return;
+} /* end of load_hash_cache */
+
+/*********************************************************************
+*
+* Function  : save_hash_cache
+*
+* Purpose   : Write the digests of this run to the '--hash-cache' file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : save_hash_cache();
+*
+* Notes     : Only the files listed this time are kept , so the cache
+*             does not grow with files which are gone. Digests of files
+*             which changed while they were read are left out. The
+*             header , with the checksum of the records , is written
+*             last. The new cache replaces the old one by a rename.
+*
+*********************************************************************/
+
+void save_hash_cache()
+{
+	HASHHEADER	header;
+	XXH3STATE	checksum;
+	FILE	*file;
+	char	*new_path;
+	unsigned long long	slot;
+
+	new_path = (char *)malloc(strlen(opt_hash_cache) + 32);
+	if ( new_path == NULL ) {
+		quit(1,"malloc failed for cache file name");
+	} /* IF */
+	sprintf(new_path,"%s.%d",opt_hash_cache,(int)getpid());
+	file = fopen(new_path,"w");
+	if ( file == NULL ) {
+		quit(1,"fopen failed for \"%s\"",new_path);
+	} /* IF */
+	memset(&header,0,sizeof(header));
+	fwrite(&header,sizeof(header),1,file);
+	xxh3_start(&checksum);
+	for ( slot = 0 ; slot <= Hashes.mask ; ++slot ) {
+		if ( Hashes.entries[slot].state == HASH_DONE ) {
+			fwrite(&Hashes.entries[slot].record,sizeof(HASHRECORD),1,file);
+			xxh3_update(&checksum,(unsigned char *)&Hashes.entries[slot].record,sizeof(HASHRECORD));
+			header.num_records += 1;
+		} /* IF */
+	} /* FOR */
+	xxh3_digest(&checksum,header.checksum);
+	memcpy(header.magic,HASH_MAGIC,sizeof(header.magic));
+	header.version = HASH_VERSION;
+	header.algorithm = opt_hash;
+	fseek(file,0L,SEEK_SET);
+	fwrite(&header,sizeof(header),1,file);
+	if ( ferror(file) | fclose(file) ) {
+		unlink(new_path);
+		quit(1,"write failed for \"%s\"",new_path);
+	} /* IF */
+	if ( rename(new_path,opt_hash_cache) < 0 ) {
+		unlink(new_path);
+		quit(1,"rename failed for \"%s\"",opt_hash_cache);
+	} /* IF */
+	free(new_path);
+
+	return;
+} /* end of save_hash_cache */
+
+/*********************************************************************
+*
+* Function  : note_cached_pages
+*
+* Purpose   : Note which pages of a window of a file are in the page
+*             cache.
+*
+* Inputs    : char *map - mapping of the whole file
+*             size_t map_size - size of the file
+*             size_t start - offset of the window , a multiple of
+*                            HASH_WINDOW
+*             unsigned char *residency - to receive a byte per page
+*             long page_size - size of a page
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : note_cached_pages(map,map_size,HASH_WINDOW,residency[1],page_size);
+*
+* Notes     : If mincore() fails every page is taken to be cached , so
+*             none is dropped.
+*
+*********************************************************************/
+
+void note_cached_pages(char *map, size_t map_size, size_t start, unsigned char *residency, long page_size)
+{
+	size_t	length;
+
+	if ( start < map_size ) {
+		length = map_size - start;
+		if ( length > HASH_WINDOW ) {
+			length = HASH_WINDOW;
+		} /* IF */
+		if ( mincore(&map[start],length,residency) < 0 ) {
+			memset(residency,1,(length + page_size - 1) / page_size);
+		} /* IF */
+	} /* IF */
+
+	return;
+} /* end of note_cached_pages */
+
+/*********************************************************************
+*
+* Function  : drop_cold_pages
+*
+* Purpose   : Drop from the page cache the pages of a block of a file
+*             which were not cached before the block was read.
+*
+* Inputs    : int fd - descriptor of the file
+*             off_t offset - offset of the block
+*             size_t length - length of the block
+*             unsigned char *residency - from note_cached_pages() for
+*                                        the block
+*             long page_size - size of a page
+*             COLDRUN *run - the cold pages not dropped yet
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : drop_cold_pages(fd,offset,count,&residency[0][page],page_size,&run);
+*
+* Notes     : The kernel only drops a folio which lies wholly inside the
+*             range it is given , and a large folio can span blocks. So
+*             cold pages are gathered into a run across blocks , which
+*             is dropped when a cached page ends it or it reaches
+*             HASH_WINDOW. In the latter case the end of the run is kept
+*             in the next one , for a folio which goes on past it. The
+*             caller drops what is left at the end of the file.
+*
+*********************************************************************/
+
+void drop_cold_pages(int fd, off_t offset, size_t length, unsigned char *residency, long page_size, COLDRUN *run)
+{
+	size_t	page , num_pages;
+
+	num_pages = (length + page_size - 1) / page_size;
+	for ( page = 0 ; page < num_pages ; ++page ) {
+		if ( residency[page] & 1 ) {
+			if ( run->end > run->start ) {
+				posix_fadvise(fd,run->start,run->end - run->start,POSIX_FADV_DONTNEED);
+			} /* IF */
+			run->start = run->end = 0;
+		} /* IF already cached */
+		else {
+			if ( run->end != offset + (off_t)(page * page_size) ) {
+				run->start = offset + page * page_size;
+			} /* IF */
+			run->end = offset + (page + 1) * page_size;
+		} /* ELSE */
+	} /* FOR */
+	if ( run->end - run->start >= HASH_WINDOW ) {
+		posix_fadvise(fd,run->start,run->end - run->start,POSIX_FADV_DONTNEED);
+		run->start = run->end - HASH_FOLIO_SLACK;
+	} /* IF */
+
+	return;
+} /* end of drop_cold_pages */
+
+/*********************************************************************
+*
+* Function  : hash_worker
+*
+* Purpose   : Hash files for '--hash' until there are none left.
+*
+* Inputs    : void *arg - (not used)
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&threads[index],NULL,hash_worker,NULL);
+*
+* Notes     : The jobs are taken in turn from a shared counter. Files
+*             are read in large page aligned blocks with the kernel told
+*             the reads are sequential. So that a big tree does not push
+*             out everything else , the pages this run brought into the
+*             page cache are dropped once hashed. Which pages were
+*             already cached is asked of mincore() , through a mapping
+*             of the file which is never touched , a whole window ahead
+*             of the reads so the pages read ahead by the kernel for this
+*             run are not taken for cached ones. The kernel only answers
+*             that for files the user owns or may write , nothing is
+*             dropped for other files. A
+*             file whose size or mtime changed since it was listed gets
+*             a digest which is shown but not cached.
+*
+*********************************************************************/
+
+void *hash_worker(void *arg)
+{
+	HASHENTRY	*entry;
+	XXH3STATE	xxh3;
+	SHA256STATE	sha256;
+	struct _stat	filestats;
+	unsigned char	*buffer , *residency[2] , *swap;
+	COLDRUN	run;
+	char	*path , *map;
+	size_t	map_size , window;
+	off_t	offset;
+	ssize_t	count;
+	long	job , page_size;
+	int		fd , flags;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	buffer = (unsigned char *)aligned_alloc(4096,HASH_BUFFER_SIZE);
+	residency[0] = (unsigned char *)malloc(2 * (HASH_WINDOW / page_size));
+	residency[1] = residency[0] + HASH_WINDOW / page_size;
+	if ( buffer == NULL || residency[0] == NULL ) {
+		quit(1,"alloc failed for hash buffers");
+	} /* IF */
+	for ( job = atomic_fetch_add(&Hashes.next_job,1) ; job < Hashes.num_jobs ;
+				job = atomic_fetch_add(&Hashes.next_job,1) ) {
+		entry = &Hashes.entries[Hashes.jobs[job]];
+		path = FILE_PATH(Hashes.list,entry->index);
+		flags = O_RDONLY;
+#ifdef	O_NOATIME
+		flags |= O_NOATIME;
+#endif
+		fd = open(path,flags);
+		if ( fd < 0 && errno == EPERM ) {
+			fd = open(path,O_RDONLY);
+		} /* IF only the owner may use O_NOATIME */
+		if ( fd < 0 ) {
+			system_error("open() failed for \"%s\"",path);
+			entry->state = HASH_FAILED;
+			continue;
+		} /* IF */
+		posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+		map = NULL;
+		map_size = 0;
+		if ( fstat(fd,&filestats) == 0 && filestats.st_size > 0 && (geteuid() == 0 ||
+					filestats.st_uid == geteuid() || faccessat(AT_FDCWD,path,W_OK,AT_EACCESS) == 0) ) {
+			map_size = filestats.st_size;
+			map = (char *)mmap(NULL,map_size,PROT_READ,MAP_SHARED,fd,0);
+			if ( map == MAP_FAILED ) {
+				map = NULL;
+			} /* IF */
+			else {
+				note_cached_pages(map,map_size,0,residency[0],page_size);
+				note_cached_pages(map,map_size,HASH_WINDOW,residency[1],page_size);
+			} /* ELSE */
+		} /* IF mincore() will tell which pages are cached */
+		offset = 0;
+		window = 0;
+		run.start = run.end = 0;
+		if ( opt_hash == HASH_XXH3 ) {
+			xxh3_start(&xxh3);
+		} /* IF */
+		else {
+			sha256_start(&sha256);
+		} /* ELSE */
+		while ( (count = read(fd,buffer,HASH_BUFFER_SIZE)) > 0 ) {
+			if ( opt_hash == HASH_XXH3 ) {
+				xxh3_update(&xxh3,buffer,count);
+			} /* IF */
+			else {
+				sha256_update(&sha256,buffer,count);
+			} /* ELSE */
+			atomic_fetch_add(&Hashes.bytes_read,count);
+			if ( map != NULL && (size_t)offset + count <= map_size && offset % page_size == 0 &&
+						offset % HASH_WINDOW + count <= HASH_WINDOW ) {
+				if ( offset / HASH_WINDOW != window ) {
+					window = offset / HASH_WINDOW;
+					swap = residency[0];
+					residency[0] = residency[1];
+					residency[1] = swap;
+					note_cached_pages(map,map_size,(window + 1) * HASH_WINDOW,residency[1],page_size);
+				} /* IF the reads moved on to the next window */
+				drop_cold_pages(fd,offset,count,&residency[0][offset % HASH_WINDOW / page_size],page_size,&run);
+			} /* IF */
+			offset += count;
+		} /* WHILE */
+		if ( count < 0 ) {
+			system_error("read() failed for \"%s\"",path);
+			entry->state = HASH_FAILED;
+		} /* IF */
+		else {
+			if ( opt_hash == HASH_XXH3 ) {
+				xxh3_digest(&xxh3,entry->record.digest);
+			} /* IF */
+			else {
+				sha256_digest(&sha256,entry->record.digest);
+			} /* ELSE */
+			entry->state = HASH_DONE;
+			if ( fstat(fd,&filestats) < 0 || filestats.st_size != entry->record.size ||
+						(long long)filestats.st_mtim.tv_sec * 1000000000LL + filestats.st_mtim.tv_nsec != entry->record.mtime ) {
+				entry->state = HASH_CHANGED;
+			} /* IF */
+		} /* ELSE */
+		if ( run.end > run.start ) {
+			posix_fadvise(fd,run.start,run.end - run.start,POSIX_FADV_DONTNEED);
+		} /* IF */
+		if ( map != NULL ) {
+			munmap(map,map_size);
+		} /* IF */
+		close(fd);
+	} /* FOR */
+	free(buffer);
+	free(residency[0] < residency[1] ? residency[0] : residency[1]);
+
+	return(NULL);
+} /* end of hash_worker */
+
+/*********************************************************************
+*
+* Function  : hash_files
+*
+* Purpose   : Compute the digests of the regular files of a list for
+*             '--hash'.
+*
+* Inputs    : LIST *list - the list
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : hash_files(&Files);
+*
+* Notes     : Each version of a file , by device , inode , size and
+*             mtime , is hashed once , so hard links are read once and
+*             a file found in the cache is not read at all. The rest are
+*             shared out to a pool of 'j' threads , or one per processor
+*             without 'j' , at most HASH_MAX_THREADS.
+*
+*********************************************************************/
+
+void hash_files(LIST *list)
+{
+	HASHENTRY	*entry;
+	pthread_t	threads[HASH_MAX_THREADS];
+	struct timespec	start , end;
+	double	seconds;
+	long	num_hits , num_files , bytes_read;
+	int		index , num_threads;
+
+	load_hash_cache(list->count);
+	Hashes.list = list;
+	Hashes.jobs = (unsigned long long *)malloc((list->count + 1) * sizeof(unsigned long long));
+	if ( Hashes.jobs == NULL ) {
+		quit(1,"malloc failed for %d hash jobs",list->count);
+	} /* IF */
+	num_hits = 0;
+	for ( index = 0 ; index < list->count ; ++index ) {
+		if ( ! S_ISREG(list->modes[index]) ) {
+			continue;
+		} /* IF */
+		entry = find_hash_entry(list->devices[list->device_indexes[index]],list->inodes[index],
+						list->sizes[index],list->mtimes[index]);
+		if ( entry->state == HASH_CACHED ) {
+			entry->state = HASH_DONE;
+			num_hits += 1;
+		} /* IF */
+		else if ( entry->state == HASH_EMPTY ) {
+			entry->record.device = list->devices[list->device_indexes[index]];
+			entry->record.inode = list->inodes[index];
+			entry->record.size = list->sizes[index];
+			entry->record.mtime = list->mtimes[index];
+			entry->index = index;
+			entry->state = HASH_PENDING;
+			Hashes.jobs[Hashes.num_jobs++] = entry - Hashes.entries;
+		} /* ELSE IF */
+	} /* FOR */
+
+	num_threads = (opt_j > 1) ? opt_j : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if ( num_threads > HASH_MAX_THREADS ) {
+		num_threads = HASH_MAX_THREADS;
+	} /* IF */
+	if ( num_threads > Hashes.num_jobs ) {
+		num_threads = Hashes.num_jobs;
+	} /* IF */
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	for ( index = 0 ; index < num_threads ; ++index ) {
+		if ( pthread_create(&threads[index],NULL,hash_worker,NULL) != 0 ) {
+			quit(1,"pthread_create failed for hash thread");
+		} /* IF */
+	} /* FOR */
+	for ( index = 0 ; index < num_threads ; ++index ) {
+		pthread_join(threads[index],NULL);
+	} /* FOR */
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	bytes_read = atomic_load(&Hashes.bytes_read);
+	num_files = num_hits + Hashes.num_jobs;
+	debug_print("hash_files() : %ld files , %ld digests from the cache (%.1f%%) , %ld files read by %d threads , "
+			"%.1f MB in %.3f seconds (%.1f MB/s)\n",num_files,num_hits,
+			num_files > 0 ? 100.0 * num_hits / num_files : 0.0,Hashes.num_jobs,num_threads,
+			bytes_read / 1e6,seconds,seconds > 0 ? bytes_read / 1e6 / seconds : 0.0);
+	if ( opt_hash_cache != NULL ) {
+		save_hash_cache();
+	} /* IF */
+	free(Hashes.jobs);
+
+	return;
+} /* end of hash_files */
+
+/*********************************************************************
+*
+* Function  : format_digest
+*
+* Purpose   : Format the digest column for '--hash'.
+*
+* Inputs    : char *buffer - buffer to receive the column
+*             ENTRYINFO *info - the information for the file
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : ptr += format_digest(ptr,info);
+*
+* Notes     : The digest is shown in hex. The column holds '-' for
+*             anything but a regular file and '?' for a file which could
+*             not be read.
+*
+*********************************************************************/
+
+int format_digest(char *buffer, ENTRYINFO *info)
+{
+	static char	hex_digits[] = "0123456789abcdef";
+	HASHENTRY	*entry;
+	int		index , width;
+
+	width = 2 * Hashes.digest_size;
+	memset(buffer,' ',width);
+	if ( ! S_ISREG(info->mode) ) {
+		buffer[0] = '-';
+		return(width);
+	} /* IF */
+	entry = find_hash_entry(info->device,info->inode,info->size,info->mtime);
+	if ( entry->state != HASH_DONE && entry->state != HASH_CHANGED ) {
+		buffer[0] = '?';
+		return(width);
+	} /* IF */
+	for ( index = 0 ; index < Hashes.digest_size ; ++index ) {
+		buffer[2 * index] = hex_digits[entry->record.digest[index] >> 4];
+		buffer[2 * index + 1] = hex_digits[entry->record.digest[index] & 15];
+	} /* FOR */
+
+	return(width);
+} /* end of format_digest */
+
+/*********************************************************************
+*
+* Function  : lookup_id_name
+*
+* Purpose   : Get the name of a user or group from the system.
+*
+* Inputs    : int is_group - 1 for a group id , 0 for a user id
+*             unsigned int id - the id
+*
+* Output    : (none)
+*
+* Returns   : the name in a new string , the id in decimal if it has
+*             no name
+*
+* Example   : name = lookup_id_name(cache->is_group,id);
+*
+* Notes     : Uses the reentrant calls , with a bigger buffer for as
+*             long as the entry does not fit.
+*
+*********************************************************************/
+
+char *lookup_id_name(int is_group, unsigned int id)
+{
+	struct passwd	user , *user_result;
+	struct group	group , *group_result;
+	char	*buffer , *name , digits[16];
+	size_t	size;
+	int		status;
+
+	name = NULL;
+	size = 1024;
+	buffer = NULL;
+	do {
+		size *= 2;
+		buffer = (char *)realloc(buffer,size);
+		if ( buffer == NULL ) {
+			quit(1,"realloc failed for id lookup");
+		} /* IF */
+		if ( is_group ) {
+			status = getgrgid_r(id,&group,buffer,size,&group_result);
+			if ( status == 0 && group_result != NULL ) {
+				name = strdup(group.gr_name);
+			} /* IF */
+		} /* IF */
+		else {
+			status = getpwuid_r(id,&user,buffer,size,&user_result);
+			if ( status == 0 && user_result != NULL ) {
+				name = strdup(user.pw_name);
+			} /* IF */
+		} /* ELSE */
+	} while ( status == ERANGE );
+	free(buffer);
+	if ( name == NULL ) {
+		sprintf(digits,"%u",id);
+		name = strdup(digits);
+	} /* IF no name */
+	if ( name == NULL ) {
+		quit(1,"strdup failed for id name");
+	} /* IF */
+
+	return(name);
+} /* end of lookup_id_name */
+
+/*********************************************************************
+*
+* Function  : find_id_slot
+*
+* Purpose   : Find the slot of an id in a table of names.
+*
+* Inputs    : IDTABLE *table - the table
+*             unsigned int id - the id
+*
+* Output    : (none)
+*
+* Returns   : ptr to the slot of the id , or to the empty slot where it
+*             goes
+*
+* Example   : slot = find_id_slot(table,id);
+*
+* Notes     : Open addressing with linear probing.
+*
+*********************************************************************/
+
+IDSLOT *find_id_slot(IDTABLE *table, unsigned int id)
+{
+	IDSLOT	*slot;
+	unsigned int	index , mask;
+
+	mask = (1U << table->bits) - 1;
+	for ( index = ID_HASH(id,table->bits) ; ; index = (index + 1) & mask ) {
+		slot = &table->slots[index];
+		if ( atomic_load_explicit(&slot->name,memory_order_acquire) == NULL || slot->id == id ) {
+			return(slot);
+		} /* IF */
+	} /* FOR */
+} /* end of find_id_slot */
+
+/*********************************************************************
+*
+* Function  : grow_id_table
+*
+* Purpose   : Replace the table of names of a cache by one twice as big.
+*
+* Inputs    : IDCACHE *cache - the cache , its lock held
+*
+* Output    : (none)
+*
+* Returns   : the new table
+*
+* Example   : table = grow_id_table(cache);
+*
+* Notes     : The names are shared with the old table , which is kept
+*             for the threads still probing it.
+*
+*********************************************************************/
+
+IDTABLE *grow_id_table(IDCACHE *cache)
+{
+	IDTABLE	*old , *table;
+	IDSLOT	*slot;
+	char	*name;
+	unsigned int	index;
+	int		bits;
+
+	old = atomic_load_explicit(&cache->table,memory_order_relaxed);
+	bits = (old != NULL) ? old->bits + 1 : ID_CACHE_BITS;
+	table = (IDTABLE *)calloc(1,sizeof(IDTABLE) + ((size_t)1 << bits) * sizeof(IDSLOT));
+	if ( table == NULL ) {
+		quit(1,"calloc failed for %d id slots",1 << bits);
+	} /* IF */
+	table->bits = bits;
+	table->older = old;
+	for ( index = 0 ; old != NULL && index < (1U << old->bits) ; ++index ) {
+		name = atomic_load_explicit(&old->slots[index].name,memory_order_relaxed);
+		if ( name != NULL ) {
+			slot = find_id_slot(table,old->slots[index].id);
+			slot->id = old->slots[index].id;
+			atomic_store_explicit(&slot->name,name,memory_order_relaxed);
+		} /* IF */
+	} /* FOR */
+	atomic_store_explicit(&cache->table,table,memory_order_release);
+
+	return(table);
+} /* end of grow_id_table */
+
+/*********************************************************************
+*
+* Function  : resolve_id
+*
+* Purpose   : Get the name shown for a user or group id.
+*
+* Inputs    : IDCACHE *cache - the cache of names for the kind of id
+*             unsigned int id - the id
+*
+* Output    : (none)
+*
+* Returns   : the name
+*
+* Example   : owner = resolve_id(&Owners,info->uid);
+*
+* Notes     : Each id is looked up once per run , the name service may
+*             well go over the network. The cache is an open addressing
+*             table. A slot is published by storing its name after its
+*             id , so rows can be rendered by several threads with only
+*             the misses taking the lock. When the table is 3/4 full it
+*             is copied to one twice as big , which is published the
+*             same way.
+*
+*********************************************************************/
+
+char *resolve_id(IDCACHE *cache, unsigned int id)
+{
+	IDTABLE	*table;
+	IDSLOT	*slot;
+	char	*name;
+
+	table = atomic_load_explicit(&cache->table,memory_order_acquire);
+	if ( table != NULL ) {
+		slot = find_id_slot(table,id);
+		name = atomic_load_explicit(&slot->name,memory_order_acquire);
+		if ( name != NULL && slot->id == id ) {
+			atomic_fetch_add_explicit(&cache->num_hits,1,memory_order_relaxed);
+			return(name);
+		} /* IF */
+	} /* IF */
+
+	pthread_mutex_lock(&cache->lock);
+	table = atomic_load_explicit(&cache->table,memory_order_relaxed);
+	name = NULL;
+	if ( table != NULL ) {
+		slot = find_id_slot(table,id);
+		name = atomic_load_explicit(&slot->name,memory_order_relaxed);
+	} /* IF another thread may have added it */
+	if ( name == NULL ) {
+		name = lookup_id_name(cache->is_group,id);
+		atomic_fetch_add(&cache->num_lookups,1);
+		if ( table == NULL || cache->count + 1 > (3 << table->bits) / 4 ) {
+			table = grow_id_table(cache);
+		} /* IF */
+		slot = find_id_slot(table,id);
+		slot->id = id;
+		atomic_store_explicit(&slot->name,name,memory_order_release);
+		cache->count += 1;
+	} /* IF */
+	else {
+		atomic_fetch_add_explicit(&cache->num_hits,1,memory_order_relaxed);
+	} /* ELSE */
+	pthread_mutex_unlock(&cache->lock);
+
+	return(name);
+} /* end of resolve_id */
+
+/*********************************************************************
+*
+* Function  : format_id_name
+*
+* Purpose   : Format a user or group name left justified in a field.
+*
+* Inputs    : char *buffer - buffer to receive the name
+*             char *name - the name
+*             size_t length - length of the name
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : ptr += format_id_name(ptr,owner,owner_length);
+*
+* Notes     : Same result as sprintf() with "%-8s " , a longer name
+*             widens its own row.
+*
+*********************************************************************/
+
+int format_id_name(char *buffer, char *name, size_t length)
+{
+	memcpy(buffer,name,length);
+	if ( length < ID_NAME_WIDTH ) {
+		memset(&buffer[length],' ',ID_NAME_WIDTH - length);
+		length = ID_NAME_WIDTH;
+	} /* IF */
+	buffer[length] = ' ';
+
+	return(length + 1);
+} /* end of format_id_name */
+
+/*********************************************************************
+*
+* Function  : build_json_table
+*
+* Purpose   : Build the table of JSON escapes for the bytes of a path.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : build_json_table();
+*
+* Notes     : Control characters , the quote and the backslash need an
+*             escape , every other ASCII byte is copied. The other bytes
+*             are checked by format_json_string() as UTF-8.
+*
+*********************************************************************/
+
+void build_json_table()
+{
+	static char	*short_escapes[32] = {
+		NULL , NULL , NULL , NULL , NULL , NULL , NULL , NULL ,
+		"\\b" , "\\t" , "\\n" , NULL , "\\f" , "\\r" , NULL , NULL } ;
+	int		ch;
+
+	for ( ch = 0 ; ch < 256 ; ++ch ) {
+		if ( ch < 32 && short_escapes[ch] != NULL ) {
+			json_escape_lengths[ch] = 2;
+			memcpy(json_escapes[ch],short_escapes[ch],2);
+		} /* IF */
+		else if ( ch < 32 ) {
+			json_escape_lengths[ch] = 6;
+			sprintf(json_escapes[ch],"\\u%04x",ch);
+		} /* ELSE IF */
+		else if ( ch == '"' || ch == '\\' ) {
+			json_escape_lengths[ch] = 2;
+			json_escapes[ch][0] = '\\';
+			json_escapes[ch][1] = ch;
+		} /* ELSE IF */
+	} /* FOR */
+
+	return;
+} /* end of build_json_table */
+
+/*********************************************************************
+*
+* Function  : utf8_length
+*
+* Purpose   : Check for a UTF-8 character at the start of some bytes.
+*
+* Inputs    : unsigned char *bytes - the bytes , the first not ASCII
+*             size_t count - number of bytes available
+*
+* Output    : (none)
+*
+* Returns   : number of bytes in the character , or if it is not valid
+*             minus the number of bytes which are to be replaced by a
+*             single U+FFFD
+*
+* Example   : length = utf8_length(&bytes[index],path_length - index);
+*
+* Notes     : Overlong forms , surrogates and values past U+10FFFF are
+*             not valid. A bad sequence is replaced up to the byte which
+*             makes it bad , the "maximal subpart" of Unicode.
+*
+*********************************************************************/
+
+int utf8_length(unsigned char *bytes, size_t count)
+{
+	unsigned char	low , high;
+	int		length , index;
+
+	low = 0x80;
+	high = 0xbf;
+	if ( bytes[0] >= 0xc2 && bytes[0] <= 0xdf ) {
+		length = 2;
+	} /* IF */
+	else if ( bytes[0] >= 0xe0 && bytes[0] <= 0xef ) {
+		length = 3;
+		if ( bytes[0] == 0xe0 ) {
+			low = 0xa0;
+		} /* IF */
+		else if ( bytes[0] == 0xed ) {
+			high = 0x9f;
+		} /* ELSE IF */
+	} /* ELSE IF */
+	else if ( bytes[0] >= 0xf0 && bytes[0] <= 0xf4 ) {
+		length = 4;
+		if ( bytes[0] == 0xf0 ) {
+			low = 0x90;
+		} /* IF */
+		else if ( bytes[0] == 0xf4 ) {
+			high = 0x8f;
+		} /* ELSE IF */
+	} /* ELSE IF */
+	else {
+		return(-1);
+	} /* ELSE */
+	for ( index = 1 ; index < length ; ++index ) {
+		if ( (size_t)index >= count || bytes[index] < low || bytes[index] > high ) {
+			return(-index);
+		} /* IF */
+		low = 0x80;
+		high = 0xbf;
+	} /* FOR */
+
+	return(length);
+} /* end of utf8_length */
+
+/*********************************************************************
+*
+* Function  : format_json_string
+*
+* Purpose   : Format a path as a JSON string.
+*
+* Inputs    : char *buffer - buffer to receive the string
+*             char *path - the path
+*             size_t path_length - length of the path
+*             int *invalid - set to 1 if the path is not UTF-8 , else 0
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : ptr += format_json_string(ptr,path,path_length,&invalid);
+*
+* Notes     : The buffer needs room for 6 characters per byte of the
+*             path and the quotes. Bytes which are not a valid UTF-8
+*             character become U+FFFD , so the line is still valid
+*             JSON. The caller gives the exact bytes separately.
+*
+*********************************************************************/
+
+int format_json_string(char *buffer, char *path, size_t path_length, int *invalid)
+{
+	unsigned char	*bytes;
+	char	*ptr;
+	size_t	index;
+	int		length;
+
+	bytes = (unsigned char *)path;
+	ptr = buffer;
+	*invalid = 0;
+	*ptr++ = '"';
+	for ( index = 0 ; index < path_length ; ) {
+		if ( bytes[index] >= 0x80 ) {
+			length = utf8_length(&bytes[index],path_length - index);
+			if ( length < 0 ) {
+				memcpy(ptr,"\\ufffd",6);
+				ptr += 6;
+				*invalid = 1;
+				index -= length;
+			} /* IF */
+			else {
+				memcpy(ptr,&bytes[index],length);
+				ptr += length;
+				index += length;
+			} /* ELSE */
+			continue;
+		} /* IF */
+		length = json_escape_lengths[bytes[index]];
+		if ( length == 0 ) {
+			*ptr++ = bytes[index];
+		} /* IF */
+		else {
+			memcpy(ptr,json_escapes[bytes[index]],length);
+			ptr += length;
+		} /* ELSE */
+		index += 1;
+	} /* FOR */
+	*ptr++ = '"';
+
+	return(ptr - buffer);
+} /* end of format_json_string */
+
+/*********************************************************************
+*
+* Function  : format_base64
+*
+* Purpose   : Format bytes in base64.
+*
+* Inputs    : char *buffer - buffer to receive the text
+*             unsigned char *bytes - the bytes
+*             size_t count - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : number of characters stored
+*
+* Example   : ptr += format_base64(ptr,(unsigned char *)path,path_length);
+*
+* Notes     : Padded with '=' as in RFC 4648.
+*
+*********************************************************************/
+
+int format_base64(char *buffer, unsigned char *bytes, size_t count)
+{
+	static char	digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	unsigned long	value;
+	size_t	index;
+	char	*ptr;
+
+	ptr = buffer;
+	for ( index = 0 ; index + 2 < count ; index += 3 ) {
+		value = (unsigned long)bytes[index] << 16 | bytes[index + 1] << 8 | bytes[index + 2];
+		*ptr++ = digits[value >> 18];
+		*ptr++ = digits[(value >> 12) & 63];
+		*ptr++ = digits[(value >> 6) & 63];
+		*ptr++ = digits[value & 63];
+	} /* FOR */
+	if ( index < count ) {
+		value = (unsigned long)bytes[index] << 16;
+		if ( index + 1 < count ) {
+			value |= bytes[index + 1] << 8;
+		} /* IF */
+		*ptr++ = digits[value >> 18];
+		*ptr++ = digits[(value >> 12) & 63];
+		*ptr++ = (index + 1 < count) ? digits[(value >> 6) & 63] : '=';
+		*ptr++ = '=';
+	} /* IF */
+
+	return(ptr - buffer);
+} /* end of format_base64 */
+
+/*********************************************************************
+*
+* Function  : show_machine_entry
+*
+* Purpose   : Display one file in the format chosen with '--format'.
+*
+* Inputs    : char *path - path of the file
+*             size_t path_length - length of the path
+*             ENTRYINFO *info - the information saved for the file
+*
+* Output    : the record for the file
+*
+* Returns   : (nothing)
+*
+* Example   : show_machine_entry(path,path_length,info);
+*
+* Notes     : All the numbers are given in full , the size in 64 bits
+*             and the mtime in nanoseconds since the epoch. The mode is
+*             st_mode as a number.
+*
+*             nul   - path , size , mtime , mode , nlink , inode and
+*                     device , each followed by a NUL
+*             jsonl - an object per line with the same fields , just
+*                     the path for '1'. A path which is not UTF-8 also
+*                     gets "path_bytes" , its bytes in base64
+*             bin   - a BINRECORD followed by the path and its NUL ,
+*                     padded to 8 bytes , after a BINHEADER at the start
+*                     of the output
+*
+*********************************************************************/
+
+void show_machine_entry(char *path, size_t path_length, ENTRYINFO *info)
+{
+	BINRECORD	*record;
+	char	*ptr;
+	size_t	length;
+	int		invalid;
+
+	if ( opt_format == FORMAT_BIN ) {
+		length = BIN_RECORD_LENGTH(path_length);
+		ptr = output_space(length);
+		record = (BINRECORD *)ptr;
+		record->size = info->size;
+		record->mtime = info->mtime;
+		record->inode = info->inode;
+		record->device = info->device;
+		record->nlink = info->nlink;
+		record->mode = info->mode;
+		record->path_length = path_length;
+		record->length = length;
+		memcpy(&ptr[sizeof(BINRECORD)],path,path_length);
+		memset(&ptr[sizeof(BINRECORD) + path_length],0,length - sizeof(BINRECORD) - path_length);
+		Output.used += length;
+		return;
+	} /* IF */
+
+	if ( opt_format == FORMAT_NUL ) {
+		ptr = output_space(LINE_OVERHEAD + path_length);
+		memcpy(ptr,path,path_length);
+		ptr += path_length;
+		*ptr++ = '\0';
+		ptr += format_int(ptr,info->size,0);
+		*ptr++ = '\0';
+		ptr += format_int(ptr,info->mtime,0);
+		*ptr++ = '\0';
+		ptr += format_int(ptr,info->mode,0);
+		*ptr++ = '\0';
+		ptr += format_int(ptr,info->nlink,0);
+		*ptr++ = '\0';
+		ptr += format_int(ptr,(long long)info->inode,0);
+		*ptr++ = '\0';
+		ptr += format_int(ptr,(long long)info->device,0);
+		*ptr++ = '\0';
+	} /* IF */
+	else {
+		ptr = output_space(2 * LINE_OVERHEAD + 6 * path_length + (path_length + 2) / 3 * 4);
+		memcpy(ptr,"{\"path\":",8);
+		ptr += 8;
+		ptr += format_json_string(ptr,path,path_length,&invalid);
+		if ( invalid ) {
+			memcpy(ptr,",\"path_bytes\":\"",15);
+			ptr += 15;
+			ptr += format_base64(ptr,(unsigned char *)path,path_length);
+			*ptr++ = '"';
+		} /* IF the path is not UTF-8 */
+		if ( opt_1 == 0 ) {
+			memcpy(ptr,",\"size\":",8);
+			ptr += 8;
+			ptr += format_int(ptr,info->size,0);
+			memcpy(ptr,",\"mtime_ns\":",12);
+			ptr += 12;
+			ptr += format_int(ptr,info->mtime,0);
+			memcpy(ptr,",\"mode\":",8);
+			ptr += 8;
+			ptr += format_int(ptr,info->mode,0);
+			memcpy(ptr,",\"nlink\":",9);
+			ptr += 9;
+			ptr += format_int(ptr,info->nlink,0);
+			memcpy(ptr,",\"inode\":",9);
+			ptr += 9;
+			ptr += format_int(ptr,(long long)info->inode,0);
+			memcpy(ptr,",\"device\":",10);
+			ptr += 10;
+			ptr += format_int(ptr,(long long)info->device,0);
+		} /* IF */
+		*ptr++ = '}';
+		*ptr++ = '\n';
+	} /* ELSE */
+	Output.used = ptr - Output.data;
+
+	return;
+} /* end of show_machine_entry */
+
+/*********************************************************************
+*
+* Function  : start_machine_output
+*
+* Purpose   : Start the output for '--format'.
+*
+* Inputs    : (none)
+*
+* Output    : the BINHEADER for 'bin'
+*
+* Returns   : (nothing)
+*
+* Example   : start_machine_output();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void start_machine_output()
+{
+	BINHEADER	header;
+
+	if ( opt_format == FORMAT_BIN ) {
+		memset(&header,0,sizeof(header));
+		memcpy(header.magic,BIN_MAGIC,sizeof(header.magic));
+		header.version = BIN_VERSION;
+		header.record_size = sizeof(BINRECORD);
+		memcpy(output_space(sizeof(header)),&header,sizeof(header));
+		Output.used += sizeof(header);
+	} /* IF */
+	else if ( opt_format == FORMAT_JSONL ) {
+		build_json_table();
+	} /* ELSE IF */
+
+	return;
+} /* end of start_machine_output */
+
+/*********************************************************************
+*
+* Function  : show_entry
+*
+* Purpose   : Display information for one file
+*
+* Inputs    : char *path - path of the file
+*             size_t path_length - length of the path
+*             ENTRYINFO *info - the information saved for the file
+*
+* Output    : file information
+*
+* Returns   : nothing
+*
+* Example   : show_entry(path,path_length,&info);
+*
+* Notes     : With "--restat" the file is stat'ed again and skipped if
+*             that fails. With '1' only the name is shown and info is
+*             not used , NUL terminated for '--format=nul'. With
+*             '--manifest' the entry is written to the manifest instead.
+*             The owner ('o') and group ('g') come after the number of
+*             links.
+*
+*********************************************************************/
+
+void show_entry(char *path, size_t path_length, ENTRYINFO *info)
+{
+	struct _stat	restats;
+	ENTRYINFO	reinfo;
+	char	*ptr , *owner , *group;
+	size_t	owner_length , group_length;
+	time_t	seconds;
+
+	if ( opt_1 && opt_format != FORMAT_JSONL ) {
+		ptr = output_space(path_length + 1);
+		memcpy(ptr,path,path_length);
+		ptr[path_length] = (opt_format == FORMAT_NUL) ? '\0' : '\n';
+		Output.used += path_length + 1;
+		return;
+	} /* IF only the names are listed */
+
+	if ( opt_restat ) {
+		if ( _stat(path,&restats) != 0 ) {
+			return;
+		} /* IF */
+		stat_to_info(&restats,&reinfo);
+		info = &reinfo;
+	} /* IF */
+	if ( opt_manifest != NULL ) {
+		add_manifest_entry(path,path_length,info);
+		return;
+	} /* IF the entries go to the manifest */
+	if ( opt_format != FORMAT_LONG ) {
+		show_machine_entry(path,path_length,info);
+		return;
+	} /* IF */
+
+	seconds = MTIME_SECONDS(info->mtime);
+	owner = group = NULL;
+	owner_length = group_length = 0;
+	if ( opt_o ) {
+		owner = resolve_id(&Owners,info->uid);
+		owner_length = strlen(owner);
+	} /* IF */
+	if ( opt_g ) {
+		group = resolve_id(&Groups,info->gid);
+		group_length = strlen(group);
+	} /* IF */
+
+	/* "%s %4d %10d %s %s\n" with the mode , nlink , size , date and path */
+	ptr = output_space(LINE_OVERHEAD + 2 * HASH_MAX_SIZE + 2 * ID_NAME_WIDTH + owner_length + group_length + path_length);
+	format_mode(info->mode,ptr);
+	ptr += 10;
+	*ptr++ = ' ';
+	ptr += format_int(ptr,(int)info->nlink,4);
+	*ptr++ = ' ';
+	if ( owner != NULL ) {
+		ptr += format_id_name(ptr,owner,owner_length);
+	} /* IF */
+	if ( group != NULL ) {
+		ptr += format_id_name(ptr,group,group_length);
+	} /* IF */
+	ptr += format_int(ptr,(int)info->size,10);
+	*ptr++ = ' ';
+	ptr += format_date(ptr,seconds);
+	*ptr++ = ' ';
+	if ( opt_hash ) {
+		ptr += format_digest(ptr,info);
+		*ptr++ = ' ';
+	} /* IF */
+	memcpy(ptr,path,path_length);
+	ptr += path_length;
+	*ptr++ = '\n';
+	Output.used = ptr - Output.data;
+
+	return;
+} /* end of show_entry */
+
+/*********************************************************************
+*
+* Function  : display_file_info
+*
+* Purpose   : Display information for one file
+*
+* Inputs    : LIST *list - the list holding the file
+*             int index - index of the file in the list
+*
+* Output    : file information
+*
+* Returns   : nothing
+*
+* Example   : display_file_info(&Files,Files.order[index]);
+*
+* Notes     : The information saved when the file was added to the list
+*             is displayed, so the values shown are the ones which were
+*             used for sorting.
+*
+*********************************************************************/
+
+void display_file_info(LIST *list, int index)
+{
+	ENTRYINFO	info;
+
+	if ( opt_1 == 0 && opt_restat == 0 ) {
+		get_entry_info(list,index,&info);
+	} /* IF */
+	show_entry(FILE_PATH(list,index),FILE_PATH_LENGTH(list,index),&info);
+
+	return;
+} /* end of display_file_info */
+
+/*********************************************************************
+*
+* Function  : put_varint
+*
+* Purpose   : Write a number to a run file in as few bytes as it
+*             needs.
+*
+* Inputs    : FILE *file - the file
+*             unsigned long long value - the number
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : put_varint(runs->file,length);
+*
+* Notes     : 7 bits per byte , low bits first , the top bit of a byte
+*             is set when more bytes follow.
+*
+*********************************************************************/
+
+void put_varint(FILE *file, unsigned long long value)
+{
+	while ( value >= 0x80 ) {
+		putc_unlocked((int)(value & 0x7f) | 0x80,file);
+		value >>= 7;
+	} /* WHILE */
+	putc_unlocked((int)value,file);
+
+	return;
+} /* end of put_varint */
+
+/*********************************************************************
+*
+* Function  : write_run_record
+*
+* Purpose   : Add an entry to the run being written.
+*
+* Inputs    : RUNS *runs - the run file
+*             char *path - path of the entry
+*             size_t path_length - length of the path
+*             ENTRYINFO *info - the information for the entry
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : write_run_record(&Runs,path,path_length,&info);
+*
+* Notes     : A record holds the number of leading bytes shared with
+*             the path of the record before it , the rest of the path
+*             and then the fields of info , all numbers as varints. The
+*             signed fields are zigzag encoded so small negative values
+*             stay short.
+*
+*********************************************************************/
+
+void write_run_record(RUNS *runs, char *path, size_t path_length, ENTRYINFO *info)
+{
+	size_t	shared;
+
+	for ( shared = 0 ; shared < path_length && shared < runs->last_length &&
+				path[shared] == runs->last_path[shared] ; ++shared ) {
+	} /* FOR */
+	put_varint(runs->file,shared);
+	put_varint(runs->file,path_length - shared);
+	fwrite(&path[shared],1,path_length - shared,runs->file);
+	put_varint(runs->file,ZIGZAG(info->size));
+	put_varint(runs->file,ZIGZAG(info->mtime));
+	put_varint(runs->file,info->inode);
+	put_varint(runs->file,info->device);
+	put_varint(runs->file,info->nlink);
+	put_varint(runs->file,info->mode);
+	put_varint(runs->file,info->uid);
+	put_varint(runs->file,info->gid);
+
+	if ( path_length > runs->last_size ) {
+		runs->last_size = 2 * path_length;
+		runs->last_path = (char *)realloc(runs->last_path,runs->last_size);
+		if ( runs->last_path == NULL ) {
+			quit(error_status,"realloc failed for run path");
+		} /* IF */
+	} /* IF */
+	memcpy(&runs->last_path[shared],&path[shared],path_length - shared);
+	runs->last_length = path_length;
+
+	return;
+} /* end of write_run_record */
+
+/*********************************************************************
+*
+* Function  : spill_run
+*
+* Purpose   : Sort the list of files and move it to the run file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : spill_run();
+*
+* Notes     : Called when the list reaches '--max-memory' and once more
+*             for whatever is left at the end. All the runs go one after
+*             the other into a single unnamed temporary file.
+*
+*********************************************************************/
+
+void spill_run()
+{
+	ENTRYINFO	info;
+	int		index , count;
+
+	if ( Runs.file == NULL ) {
+		Runs.file = tmpfile();
+		if ( Runs.file == NULL ) {
+			quit(1,"tmpfile failed for the sort runs");
+		} /* IF */
+		setvbuf(Runs.file,NULL,_IOFBF,RUN_BUFFER_SIZE);
+	} /* IF */
+	if ( Runs.count >= Runs.size ) {
+		Runs.size = (Runs.size > 0) ? 2 * Runs.size : 16;
+		Runs.ends = (long long *)realloc(Runs.ends,Runs.size * sizeof(long long));
+		if ( Runs.ends == NULL ) {
+			quit(1,"realloc failed for %d runs",Runs.size);
+		} /* IF */
+	} /* IF */
+
+	sort_file_list();
+	count = Files.count;
+	Runs.last_length = 0;
+	for ( index = 0 ; index < count ; ++index ) {
+		get_entry_info(&Files,Files.order[index],&info);
+		write_run_record(&Runs,FILE_PATH(&Files,Files.order[index]),
+				FILE_PATH_LENGTH(&Files,Files.order[index]),&info);
+	} /* FOR */
+	if ( ferror(Runs.file) ) {
+		quit(1,"write failed for the sort runs");
+	} /* IF */
+	Runs.ends[Runs.count++] = ftello(Runs.file);
+	clear_list(&Files);
+	debug_print("spill_run() : run %d , %d entries , file now %lld bytes\n",
+			Runs.count,count,Runs.ends[Runs.count-1]);
+
+	return;
+} /* end of spill_run */
+
+/*********************************************************************
+*
+* Function  : get_run_byte
+*
+* Purpose   : Get the next byte of a run.
+*
+* Inputs    : RUNREADER *reader - reader for the run
+*
+* Output    : (none)
+*
+* Returns   : the byte
+*
+* Example   : byte = get_run_byte(reader);
+*
+* Notes     : The run is read in blocks with pread() so that all the
+*             readers of a file can share its descriptor.
+*
+*********************************************************************/
+
+int get_run_byte(RUNREADER *reader)
+{
+	ssize_t	count;
+	size_t	wanted;
+
+	if ( reader->used >= reader->filled ) {
+		wanted = (reader->end - reader->next < RUN_BUFFER_SIZE) ?
+					(size_t)(reader->end - reader->next) : RUN_BUFFER_SIZE;
+		count = (wanted > 0) ? pread(reader->fd,reader->buffer,wanted,reader->next) : 0;
+		if ( count <= 0 ) {
+			quit(error_status,"read failed for %s",reader->name);
+		} /* IF */
+		reader->next += count;
+		reader->filled = count;
+		reader->used = 0;
+	} /* IF */
+
+	return( reader->buffer[reader->used++] );
+} /* end of get_run_byte */
+
+/*********************************************************************
+*
+* Function  : get_varint
+*
+* Purpose   : Get a number written by put_varint() from a run.
+*
+* Inputs    : RUNREADER *reader - reader for the run
+*
+* Output    : (none)
+*
+* Returns   : the number
+*
+* Example   : length = get_varint(reader);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+unsigned long long get_varint(RUNREADER *reader)
+{
+	unsigned long long	value;
+	int		byte , shift;
+
+	value = 0;
+	shift = 0;
+	do {
+		byte = get_run_byte(reader);
+		value |= (unsigned long long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while ( byte & 0x80 );
+
+	return(value);
+} /* end of get_varint */
+
+/*********************************************************************
+*
+* Function  : read_run_path
+*
+* Purpose   : Read the bytes of a path from a run.
+*
+* Inputs    : RUNREADER *reader - reader for the run
+*             size_t shared - bytes kept from the path read before
+*             size_t length - length of the path
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : read_run_path(reader,shared,shared + rest);
+*
+* Notes     : The path is left NUL terminated in reader->path.
+*
+*********************************************************************/
+
+void read_run_path(RUNREADER *reader, size_t shared, size_t length)
+{
+	size_t	index;
+
+	reader->path_length = length;
+	if ( length + 1 > reader->path_size ) {
+		reader->path_size = 2 * (length + 1);
+		reader->path = (char *)realloc(reader->path,reader->path_size);
+		if ( reader->path == NULL ) {
+			quit(error_status,"realloc failed for run path");
+		} /* IF */
+	} /* IF */
+	for ( index = shared ; index < length ; ++index ) {
+		reader->path[index] = get_run_byte(reader);
+	} /* FOR */
+	reader->path[length] = '\0';
+
+	return;
+} /* end of read_run_path */
+
+/*********************************************************************
+*
+* Function  : read_run_record
+*
+* Purpose   : Read the next record of a run.
+*
+* Inputs    : RUNREADER *reader - reader for the run
+*
+* Output    : (none)
+*
+* Returns   : 1 if a record was read , 0 at the end of the run
+*
+* Example   : read_run_record(&readers[run]);
+*
+* Notes     : The path is rebuilt on top of the path of the record
+*             before it.
+*
+*********************************************************************/
+
+int read_run_record(RUNREADER *reader)
+{
+	size_t	shared , rest;
+	unsigned long long	value;
+
+	if ( reader->used >= reader->filled && reader->next >= reader->end ) {
+		reader->done = 1;
+		return(0);
+	} /* IF */
+	shared = get_varint(reader);
+	rest = get_varint(reader);
+	read_run_path(reader,shared,shared + rest);
+	value = get_varint(reader);
+	reader->info.size = UNZIGZAG(value);
+	value = get_varint(reader);
+	reader->info.mtime = UNZIGZAG(value);
+	reader->info.inode = get_varint(reader);
+	reader->info.device = get_varint(reader);
+	reader->info.nlink = get_varint(reader);
+	reader->info.mode = get_varint(reader);
+	reader->info.uid = get_varint(reader);
+	reader->info.gid = get_varint(reader);
+
+	return(1);
+} /* end of read_run_record */
+
+/*********************************************************************
+*
+* Function  : run_goes_first
+*
+* Purpose   : Determine which of the current records of two runs is to
+*             be displayed first.
+*
+* Inputs    : RUNREADER *readers - the readers of all the runs
+*             int run1 - first run
+*             int run2 - second run
+*
+* Output    : (none)
+*
+* Returns   : 1 if the record of run1 goes first , 0 if not
+*
+* Example   : if ( run_goes_first(readers,run1,run2) ) {
+*
+* Notes     : Uses the same order as sort_file_list(). Records which
+*             compare equal go in the order of their runs , the order
+*             in which they were found , so the merge is stable. For 'n'
+*             each run goes as a whole , backwards for 'r'.
+*
+*********************************************************************/
+
+int run_goes_first(RUNREADER *readers, int run1, int run2)
+{
+	RUNREADER	*reader1 , *reader2;
+	size_t	length;
+	int		result;
+
+	reader1 = &readers[run1];
+	reader2 = &readers[run2];
+	if ( reader1->done || reader2->done ) {
+		return( reader2->done && (reader1->done == 0 || run1 < run2) );
+	} /* IF an ended run goes last */
+
+	result = 0;
+	if ( opt_n ) {
+		return( opt_r ? run1 > run2 : run1 < run2 );
+	} /* IF */
+	else if ( opt_t ) {
+		result = (reader1->info.mtime > reader2->info.mtime) - (reader1->info.mtime < reader2->info.mtime);
+	} /* ELSE IF */
+	else if ( opt_s ) {
+		result = (reader1->info.size > reader2->info.size) - (reader1->info.size < reader2->info.size);
+	} /* ELSE IF */
+	else if ( opt_locale_sort ) {
+		result = strcoll(reader1->path,reader2->path);
+	} /* ELSE IF */
+	else {
+		length = (reader1->path_length < reader2->path_length) ? reader1->path_length : reader2->path_length;
+		result = memcmp(reader1->path,reader2->path,length);
+		if ( result == 0 ) {
+			result = (reader1->path_length > reader2->path_length) - (reader1->path_length < reader2->path_length);
+		} /* IF */
+	} /* ELSE */
+	if ( result != 0 ) {
+		return( opt_r ? result > 0 : result < 0 );
+	} /* IF */
+
+	return( run1 < run2 );
+} /* end of run_goes_first */
+
+/*********************************************************************
+*
+* Function  : replay_loser_tree
+*
+* Purpose   : Move a run up the loser tree after its record changed.
+*
+* Inputs    : int *nodes - the tree , nodes[0] is the overall winner
+*             int num_runs - number of runs
+*             RUNREADER *readers - the readers of all the runs
+*             int winner - the run whose record changed
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : replay_loser_tree(nodes,Runs.count,readers,winner);
+*
+* Notes     : The runs are the leaves num_runs to 2*num_runs-1 of an
+*             implicit binary tree. Each inner node keeps the loser of
+*             the match played there , so a new record only plays the
+*             log2(num_runs) matches on the way from its leaf to the top.
+*             While the tree is built an empty node (-1) keeps the first
+*             run to get there and the climb stops.
+*
+*********************************************************************/
+
+void replay_loser_tree(int *nodes, int num_runs, RUNREADER *readers, int winner)
+{
+	int		node , loser;
+
+	for ( node = (winner + num_runs) / 2 ; node > 0 ; node /= 2 ) {
+		loser = nodes[node];
+		if ( loser < 0 ) {
+			nodes[node] = winner;
+			return;
+		} /* IF empty node */
+		if ( run_goes_first(readers,loser,winner) ) {
+			nodes[node] = winner;
+			winner = loser;
+		} /* IF */
+	} /* FOR */
+	nodes[0] = winner;
+
+	return;
+} /* end of replay_loser_tree */
+
+/*********************************************************************
+*
+* Function  : merge_runs
+*
+* Purpose   : Display the entries of all the runs in sorted order.
+*
+* Inputs    : (none)
+*
+* Output    : the file information
+*
+* Returns   : (nothing)
+*
+* Example   : merge_runs();
+*
+* Notes     : The entries still in the list become the last run. A k-way
+*             merge through a loser tree then takes one record at a time
+*             from the run holding the next one to show.
+*
+*********************************************************************/
+
+void merge_runs()
+{
+	RUNREADER	*readers;
+	int		*nodes , run , winner;
+	long long	start;
+
+	if ( Files.count > 0 ) {
+		spill_run();
+	} /* IF */
+	if ( fflush(Runs.file) != 0 ) {
+		quit(1,"write failed for the sort runs");
+	} /* IF */
+
+	readers = (RUNREADER *)calloc(Runs.count,sizeof(RUNREADER));
+	nodes = (int *)malloc(Runs.count * sizeof(int));
+	if ( readers == NULL || nodes == NULL ) {
+		quit(1,"malloc failed for merging %d runs",Runs.count);
+	} /* IF */
+	start = 0;
+	for ( run = 0 ; run < Runs.count ; ++run ) {
+		readers[run].fd = fileno(Runs.file);
+		readers[run].name = "the sort runs";
+		readers[run].next = start;
+		readers[run].end = Runs.ends[run];
+		readers[run].buffer = (unsigned char *)malloc(RUN_BUFFER_SIZE);
+		if ( readers[run].buffer == NULL ) {
+			quit(1,"malloc failed for run buffer");
+		} /* IF */
+		start = Runs.ends[run];
+		read_run_record(&readers[run]);
+		nodes[run] = -1;
+	} /* FOR */
+	for ( run = 0 ; run < Runs.count ; ++run ) {
+		replay_loser_tree(nodes,Runs.count,readers,run);
+	} /* FOR */
+
+	for ( winner = nodes[0] ; readers[winner].done == 0 ; winner = nodes[0] ) {
+		show_entry(readers[winner].path,readers[winner].path_length,&readers[winner].info);
+		num_merged += 1;
+		read_run_record(&readers[winner]);
+		replay_loser_tree(nodes,Runs.count,readers,winner);
+	} /* FOR */
+	debug_print("merge_runs() : %ld entries merged from %d runs\n",num_merged,Runs.count);
+
+	for ( run = 0 ; run < Runs.count ; ++run ) {
+		free(readers[run].buffer);
+		free(readers[run].path);
+	} /* FOR */
+	free(readers);
+	free(nodes);
+	free(Runs.ends);
+	free(Runs.last_path);
+	fclose(Runs.file);
+	memset(&Runs,0,sizeof(Runs));
+
+	return;
+} /* end of merge_runs */
+
+/*********************************************************************
+*
+* Function  : hash_bytes
+*
+* Purpose   : Add some bytes to a running hash.
+*
+* Inputs    : unsigned long long hash - the hash so far
+*             void *data - the bytes
+*             size_t length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : the new hash
+*
+* Example   : hash = hash_bytes(MANIFEST_HASH_START,path,path_length);
+*
+* Notes     : FNV-1a.
+*
+*********************************************************************/
+
+unsigned long long hash_bytes(unsigned long long hash, void *data, size_t length)
+{
+	unsigned char	*bytes;
+	size_t	index;
+
+	bytes = (unsigned char *)data;
+	for ( index = 0 ; index < length ; ++index ) {
+		hash = (hash ^ bytes[index]) * 0x100000001b3ULL;
+	} /* FOR */
+
+	return(hash);
+} /* end of hash_bytes */
+
+/*********************************************************************
+*
+* Function  : open_manifest
+*
+* Purpose   : Create the manifest file for '--manifest'.
+*
+* Inputs    : char *path - name of the manifest file
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : open_manifest(opt_manifest);
+*
+* Notes     : The header records the order of the entries , taken from
+*             the sort options , so that '--diff' knows how to merge two
+*             manifests. The block index is gathered in a temporary file
+*             and copied after the records by finish_manifest().
+*
+*********************************************************************/
+
+void open_manifest(char *path)
+{
+	MANIFESTHEADER	header;
+
+	Manifest.path = path;
+	Manifest.records.file = fopen(path,"w");
+	if ( Manifest.records.file == NULL ) {
+		quit(1,"fopen failed for \"%s\"",path);
+	} /* IF */
+	setvbuf(Manifest.records.file,NULL,_IOFBF,RUN_BUFFER_SIZE);
+	Manifest.index = tmpfile();
+	if ( Manifest.index == NULL ) {
+		quit(1,"tmpfile failed for the manifest index");
+	} /* IF */
+	setvbuf(Manifest.index,NULL,_IOFBF,RUN_BUFFER_SIZE);
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,MANIFEST_MAGIC,sizeof(header.magic));
+	header.version = MANIFEST_VERSION;
+	header.order = opt_n ? MANIFEST_AS_FOUND : opt_t ? MANIFEST_BY_TIME : opt_s ? MANIFEST_BY_SIZE : MANIFEST_BY_NAME;
+	if ( opt_r ) {
+		header.order |= MANIFEST_REVERSE;
+	} /* IF */
+	if ( opt_locale_sort && header.order == MANIFEST_BY_NAME ) {
+		header.order |= MANIFEST_LOCALE;
+	} /* IF */
+	fwrite(&header,sizeof(header),1,Manifest.records.file);
+	Manifest.block_start = sizeof(header);
+
+	return;
+} /* end of open_manifest */
+
+/*********************************************************************
+*
+* Function  : end_manifest_block
+*
+* Purpose   : Finish the index entry of the current block of the
+*             manifest.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : end_manifest_block();
+*
+* Notes     : The first path of the block went into the index entry
+*             when the block was started.
+*
+*********************************************************************/
+
+void end_manifest_block()
+{
+	long long	end;
+
+	end = ftello(Manifest.records.file);
+	put_varint(Manifest.index,Manifest.block_start);
+	put_varint(Manifest.index,end - Manifest.block_start);
+	put_varint(Manifest.index,Manifest.block_count);
+	put_varint(Manifest.index,Manifest.block_hash);
+	Manifest.num_blocks += 1;
+	Manifest.block_start = end;
+	Manifest.block_count = 0;
+
+	return;
+} /* end of end_manifest_block */
+
+/*********************************************************************
+*
+* Function  : add_manifest_entry
+*
+* Purpose   : Write an entry to the manifest.
+*
+* Inputs    : char *path - path of the entry
+*             size_t path_length - length of the path
+*             ENTRYINFO *info - the information for the entry
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_manifest_entry(path,path_length,info);
+*
+* Notes     : The entries go in blocks of the run record format , each
+*             block starting over its prefix compression. A block ends
+*             after an entry whose path hashes to a cut point , once it
+*             holds MANIFEST_MIN_BLOCK entries , so an added or removed
+*             entry only moves the cuts of its own block and the blocks
+*             of two manifests line up again right after it. The hash of
+*             a block covers the paths and the fields '--diff' compares.
+*             The owner and group are only known with 'o' or 'g'.
+*
+*********************************************************************/
+
+void add_manifest_entry(char *path, size_t path_length, ENTRYINFO *info)
+{
+	unsigned long long	path_hash , entry_hash;
+	long long	fields[7];
+
+	if ( Manifest.block_count == 0 ) {
+		put_varint(Manifest.index,path_length);
+		fwrite(path,1,path_length,Manifest.index);
+		Manifest.records.last_length = 0;
+		Manifest.block_hash = MANIFEST_HASH_START;
+	} /* IF first entry of a block */
+	write_run_record(&Manifest.records,path,path_length,info);
+	Manifest.block_count += 1;
+	Manifest.num_entries += 1;
+
+	path_hash = hash_bytes(MANIFEST_HASH_START,path,path_length);
+	fields[0] = path_length;
+	fields[1] = info->size;
+	fields[2] = info->mtime;
+	fields[3] = info->mode;
+	fields[4] = info->nlink;
+	fields[5] = info->uid;
+	fields[6] = info->gid;
+	entry_hash = hash_bytes(path_hash,fields,sizeof(fields));
+	Manifest.block_hash = hash_bytes(Manifest.block_hash,&entry_hash,sizeof(entry_hash));
+	if ( Manifest.block_count >= MANIFEST_MAX_BLOCK ||
+				(Manifest.block_count >= MANIFEST_MIN_BLOCK && ((path_hash >> 32) & MANIFEST_CUT_MASK) == 0) ) {
+		end_manifest_block();
+	} /* IF */
+
+	return;
+} /* end of add_manifest_entry */
+
+/*********************************************************************
+*
+* Function  : finish_manifest
+*
+* Purpose   : Write the block index and the trailer of the manifest.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : finish_manifest();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void finish_manifest()
+{
+	MANIFESTTRAILER	trailer;
+	char	buffer[8192];
+	size_t	count;
+
+	if ( Manifest.block_count > 0 ) {
+		end_manifest_block();
+	} /* IF */
+	memset(&trailer,0,sizeof(trailer));
+	trailer.index_offset = Manifest.block_start;
+	trailer.num_blocks = Manifest.num_blocks;
+	trailer.num_entries = Manifest.num_entries;
+	memcpy(trailer.magic,MANIFEST_MAGIC,sizeof(trailer.magic));
+
+	rewind(Manifest.index);
+	while ( (count = fread(buffer,1,sizeof(buffer),Manifest.index)) > 0 ) {
+		fwrite(buffer,1,count,Manifest.records.file);
+	} /* WHILE */
+	if ( ferror(Manifest.index) ) {
+		quit(1,"read failed for the manifest index");
+	} /* IF */
+	fwrite(&trailer,sizeof(trailer),1,Manifest.records.file);
+	debug_print("finish_manifest(%s) : %lld entries in %lld blocks , %lld bytes\n",Manifest.path,
+			Manifest.num_entries,Manifest.num_blocks,(long long)ftello(Manifest.records.file));
+	if ( ferror(Manifest.records.file) || fclose(Manifest.records.file) != 0 ) {
+		quit(1,"write failed for \"%s\"",Manifest.path);
+	} /* IF */
+	fclose(Manifest.index);
+	free(Manifest.records.last_path);
+
+	return;
+} /* end of finish_manifest */
+
+/*********************************************************************
+*
+* Function  : open_manifest_reader
+*
+* Purpose   : Open a manifest for '--diff'.
+*
+* Inputs    : char *path - name of the manifest file
+*             MANIFESTREADER *reader - to receive the reader
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : open_manifest_reader(old_path,&old);
+*
+* Notes     : The records and the block index are read through two run
+*             readers sharing the descriptor.
+*
+*********************************************************************/
+
+void open_manifest_reader(char *path, MANIFESTREADER *reader)
+{
+	struct _stat	filestats;
+	MANIFESTHEADER	header;
+	MANIFESTTRAILER	trailer;
+	int		fd;
+
+	memset(reader,0,sizeof(MANIFESTREADER));
+	fd = open(path,O_RDONLY);
+	if ( fd < 0 || fstat(fd,&filestats) < 0 ) {
+		quit(error_status,"open failed for \"%s\"",path);
+	} /* IF */
+	if ( filestats.st_size < (off_t)(sizeof(header) + sizeof(trailer)) ||
+				pread(fd,&header,sizeof(header),0) != sizeof(header) ||
+				pread(fd,&trailer,sizeof(trailer),filestats.st_size - sizeof(trailer)) != sizeof(trailer) ||
+				memcmp(header.magic,MANIFEST_MAGIC,sizeof(header.magic)) != 0 ||
+				memcmp(trailer.magic,MANIFEST_MAGIC,sizeof(trailer.magic)) != 0 ||
+				header.version != MANIFEST_VERSION ||
+				trailer.index_offset < (long long)sizeof(header) ||
+				trailer.index_offset > filestats.st_size - (long long)sizeof(trailer) ) {
+		die(error_status,"\"%s\" is not a manifest written by '--manifest'\n",path);
+	} /* IF */
+	reader->order = header.order;
+	reader->blocks_left = trailer.num_blocks;
+	reader->num_blocks = trailer.num_blocks;
+
+	reader->records.fd = fd;
+	reader->records.name = path;
+	reader->records.next = sizeof(header);
+	reader->records.end = trailer.index_offset;
+	reader->index.fd = fd;
+	reader->index.name = path;
+	reader->index.next = trailer.index_offset;
+	reader->index.end = filestats.st_size - sizeof(trailer);
+	reader->records.buffer = (unsigned char *)malloc(RUN_BUFFER_SIZE);
+	reader->index.buffer = (unsigned char *)malloc(RUN_BUFFER_SIZE);
+	if ( reader->records.buffer == NULL || reader->index.buffer == NULL ) {
+		quit(error_status,"malloc failed for manifest buffers");
+	} /* IF */
+
+	return;
+} /* end of open_manifest_reader */
+
+/*********************************************************************
+*
+* Function  : seek_run_reader
+*
+* Purpose   : Move a run reader to another offset of its file.
+*
+* Inputs    : RUNREADER *reader - the reader
+*             long long offset - where the next byte is to come from
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : seek_run_reader(&reader->records,offset);
+*
+* Notes     : An offset which is already in the buffer is reached
+*             without reading again.
+*
+*********************************************************************/
+
+void seek_run_reader(RUNREADER *reader, long long offset)
+{
+	long long	position;
+
+	position = reader->next - (reader->filled - reader->used);
+	if ( offset >= position && offset <= reader->next ) {
+		reader->used += offset - position;
+	} /* IF */
+	else {
+		reader->next = offset;
+		reader->used = 0;
+		reader->filled = 0;
+	} /* ELSE */
+
+	return;
+} /* end of seek_run_reader */
+
+/*********************************************************************
+*
+* Function  : load_manifest_block
+*
+* Purpose   : Read the index entry of the next block of a manifest once
+*             the current block has been used up.
+*
+* Inputs    : MANIFESTREADER *reader - reader for the manifest
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : load_manifest_block(&old);
+*
+* Notes     : reader->done is set after the last block. The first path
+*             of the block is left in reader->index.path.
+*
+*********************************************************************/
+
+void load_manifest_block(MANIFESTREADER *reader)
+{
+	if ( reader->left > 0 || reader->done ) {
+		return;
+	} /* IF */
+	if ( reader->blocks_left <= 0 ) {
+		reader->done = 1;
+		return;
+	} /* IF */
+	read_run_path(&reader->index,0,get_varint(&reader->index));
+	reader->block.offset = get_varint(&reader->index);
+	reader->block.length = get_varint(&reader->index);
+	reader->block.count = get_varint(&reader->index);
+	reader->block.hash = get_varint(&reader->index);
+	if ( reader->block.count <= 0 || reader->block.offset < (long long)sizeof(MANIFESTHEADER) ||
+				reader->block.offset + reader->block.length > reader->records.end ) {
+		die(error_status,"The block index of \"%s\" is damaged\n",reader->records.name);
+	} /* IF */
+	seek_run_reader(&reader->records,reader->block.offset);
+	reader->left = reader->block.count;
+	reader->blocks_left -= 1;
+
+	return;
+} /* end of load_manifest_block */
+
+/*********************************************************************
+*
+* Function  : next_manifest_entry
+*
+* Purpose   : Read the next entry of a manifest.
+*
+* Inputs    : MANIFESTREADER *reader - reader for the manifest
+*
+* Output    : (none)
+*
+* Returns   : 1 if an entry was read , 0 at the end of the manifest
+*
+* Example   : next_manifest_entry(&old);
+*
+* Notes     : The entry is left in reader->records.
+*
+*********************************************************************/
+
+int next_manifest_entry(MANIFESTREADER *reader)
+{
+	load_manifest_block(reader);
+	if ( reader->done ) {
+		return(0);
+	} /* IF */
+	reader->records.done = 0;
+	read_run_record(&reader->records);
+	reader->left -= 1;
+	reader->has_entry = 1;
+
+	return(1);
+} /* end of next_manifest_entry */
+
+/*********************************************************************
+*
+* Function  : compare_manifest_entries
+*
+* Purpose   : Compare the current entries of two manifests by path.
+*
+* Inputs    : MANIFESTREADER *old - the old manifest
+*             MANIFESTREADER *new - the new manifest
+*
+* Output    : (none)
+*
+* Returns   : < 0 , 0 or > 0 as for strcmp() , in the order of the
+*             manifests
+*
+* Example   : result = compare_manifest_entries(&old,&new);
+*
+* Notes     : Uses the order of the name sort of sort_file_list().
+*
+*********************************************************************/
+
+int compare_manifest_entries(MANIFESTREADER *old, MANIFESTREADER *new)
+{
+	RUNREADER	*reader1 , *reader2;
+	size_t	length;
+	int		result;
+
+	reader1 = &old->records;
+	reader2 = &new->records;
+	if ( old->order & MANIFEST_LOCALE ) {
+		result = strcoll(reader1->path,reader2->path);
+	} /* IF */
+	else {
+		length = (reader1->path_length < reader2->path_length) ? reader1->path_length : reader2->path_length;
+		result = memcmp(reader1->path,reader2->path,length);
+		if ( result == 0 ) {
+			result = (reader1->path_length > reader2->path_length) - (reader1->path_length < reader2->path_length);
+		} /* IF */
+	} /* ELSE */
+
+	return( (old->order & MANIFEST_REVERSE) ? -result : result );
+} /* end of compare_manifest_entries */
+
+/*********************************************************************
+*
+* Function  : show_diff_row
+*
+* Purpose   : Display an entry which differs between two manifests.
+*
+* Inputs    : int marker - '+' for an added entry , '-' for a removed
+*                          one and '~' for a changed one
+*             RUNREADER *reader - reader holding the entry
+*
+* Output    : the row
+*
+* Returns   : (nothing)
+*
+* Example   : show_diff_row('-',&old.records);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void show_diff_row(int marker, RUNREADER *reader)
+{
+	char	*ptr;
+
+	ptr = output_space(2);
+	ptr[0] = marker;
+	ptr[1] = ' ';
+	Output.used += 2;
+	show_entry(reader->path,reader->path_length,&reader->info);
+
+	return;
+} /* end of show_diff_row */
+
+/*********************************************************************
+*
+* Function  : diff_manifests
+*
+* Purpose   : Show the entries added , removed and changed between two
+*             manifests for '--diff'.
+*
+* Inputs    : char *old_path - name of the old manifest
+*             char *new_path - name of the new manifest
+*
+* Output    : a row for each entry which differs
+*
+* Returns   : the number of rows
+*
+* Example   : num_rows = diff_manifests(opt_diff,argv[optind]);
+*
+* Notes     : Both manifests are read once , in step , as a merge by
+*             path , so the memory needed does not depend on their size.
+*             While both are at the start of a block , a block with the
+*             same first path , length , count and hash on both sides is
+*             skipped without being decoded. An entry has changed when
+*             its size , mtime , mode , number of links , owner or group
+*             differ , the new values are shown. The exit status is then
+*             0 if the manifests match , 1 if they differ and 2 (from
+*             error_status) if either can not be read , as for diff(1).
+*
+*********************************************************************/
+
+long long diff_manifests(char *old_path, char *new_path)
+{
+	MANIFESTREADER	old , new;
+	long long	num_compared , num_skipped , num_blocks_skipped;
+	long long	num_added , num_removed , num_changed;
+	int		result;
+
+	open_manifest_reader(old_path,&old);
+	open_manifest_reader(new_path,&new);
+	if ( (old.order & ~(MANIFEST_REVERSE | MANIFEST_LOCALE)) != MANIFEST_BY_NAME || old.order != new.order ) {
+		die(error_status,"'--diff' needs two manifests sorted the same way by name\n");
+	} /* IF */
+	if ( old.order & MANIFEST_LOCALE ) {
+		setlocale(LC_COLLATE,"");
+	} /* IF */
+
+	num_compared = num_skipped = num_blocks_skipped = 0;
+	num_added = num_removed = num_changed = 0;
+	for ( ; ; ) {
+		if ( old.has_entry == 0 && new.has_entry == 0 ) {
+			load_manifest_block(&old);
+			load_manifest_block(&new);
+			if ( old.done == 0 && new.done == 0 && old.left == old.block.count && new.left == new.block.count &&
+						old.block.count == new.block.count && old.block.length == new.block.length &&
+						old.block.hash == new.block.hash &&
+						old.index.path_length == new.index.path_length &&
+						memcmp(old.index.path,new.index.path,old.index.path_length) == 0 ) {
+				seek_run_reader(&old.records,old.block.offset + old.block.length);
+				seek_run_reader(&new.records,new.block.offset + new.block.length);
+				num_skipped += old.block.count;
+				num_blocks_skipped += 1;
+				old.left = 0;
+				new.left = 0;
+				continue;
+			} /* IF the same block on both sides */
+		} /* IF */
+		if ( old.has_entry == 0 ) {
+			next_manifest_entry(&old);
+		} /* IF */
+		if ( new.has_entry == 0 ) {
+			next_manifest_entry(&new);
+		} /* IF */
+		if ( old.has_entry == 0 && new.has_entry == 0 ) {
+			break;
+		} /* IF */
+
+		if ( old.has_entry == 0 ) {
+			result = 1;
+		} /* IF */
+		else if ( new.has_entry == 0 ) {
+			result = -1;
+		} /* ELSE IF */
+		else {
+			result = compare_manifest_entries(&old,&new);
+			num_compared += 1;
+		} /* ELSE */
+		if ( result < 0 ) {
+			show_diff_row('-',&old.records);
+			num_removed += 1;
+			old.has_entry = 0;
+		} /* IF */
+		else if ( result > 0 ) {
+			show_diff_row('+',&new.records);
+			num_added += 1;
+			new.has_entry = 0;
+		} /* ELSE IF */
+		else {
+			if ( old.records.info.size != new.records.info.size || old.records.info.mtime != new.records.info.mtime ||
+						old.records.info.mode != new.records.info.mode || old.records.info.nlink != new.records.info.nlink ||
+						old.records.info.uid != new.records.info.uid || old.records.info.gid != new.records.info.gid ) {
+				show_diff_row('~',&new.records);
+				num_changed += 1;
+			} /* IF */
+			old.has_entry = 0;
+			new.has_entry = 0;
+		} /* ELSE */
+	} /* FOR */
+	debug_print("diff_manifests() : %lld of %lld blocks skipped (%lld entries) , %lld entries compared , "
+			"%lld added , %lld removed , %lld changed\n",num_blocks_skipped,old.num_blocks,num_skipped,
+			num_compared,num_added,num_removed,num_changed);
+
+	close(old.records.fd);
+	close(new.records.fd);
+	free(old.records.buffer);
+	free(old.records.path);
+	free(old.index.buffer);
+	free(old.index.path);
+	free(new.records.buffer);
+	free(new.records.path);
+	free(new.index.buffer);
+	free(new.index.path);
+
+	return(num_added + num_removed + num_changed);
+} /* end of diff_manifests */
+
+/*********************************************************************
+*
+* Function  : compare_du_dirs
+*
+* Purpose   : Compare two directories of the '--du' summary.
+*
+* Inputs    : const void *ptr1 - ptr to index of first directory
+*             const void *ptr2 - ptr to index of second directory
+*
+* Output    : (none)
+*
+* Returns   : < 0 , 0 or > 0 as for strcmp()
+*
+* Example   : qsort(order,count,sizeof(int),compare_du_dirs);
+*
+* Notes     : Directories are compared by total size for 's' , else by
+*             path. Ties stay in the order the directories were found.
+*
+*********************************************************************/
+
+int compare_du_dirs(const void *ptr1, const void *ptr2)
+{
+	DIRINFO	*dir1 , *dir2;
+	int		index1 , index2 , result;
+
+	index1 = *(const int *)ptr1;
+	index2 = *(const int *)ptr2;
+	dir1 = du_dirs[index1];
+	dir2 = du_dirs[index2];
+	if ( opt_s ) {
+		result = (dir1->totals->bytes > dir2->totals->bytes) - (dir1->totals->bytes < dir2->totals->bytes);
+	} /* IF */
+	else {
+		result = strcmp(dir1->path,dir2->path);
+	} /* ELSE */
+	if ( result == 0 ) {
+		return( (index1 > index2) - (index1 < index2) );
+	} /* IF */
+
+	return( opt_r ? -result : result );
+} /* end of compare_du_dirs */
+
+/*********************************************************************
+*
+* Function  : show_du_summary
+*
+* Purpose   : Display the totals of the directories for '--du'.
+*
+* Inputs    : (none)
+*
+* Output    : the summary
+*
+* Returns   : (nothing)
+*
+* Example   : show_du_summary();
+*
+* Notes     : Each directory was found after its parent , so going
+*             through them backwards adds every subtree into its parent
+*             once it is complete. Directories below '--depth' are not
+*             shown but still count towards their parents. Directories
+*             which were not walked are not shown. Each line
+*             holds the bytes , the KiB allocated , the number of files
+*             and the path.
+*
+*********************************************************************/
+
+void show_du_summary()
+{
+	DIRINFO	*dir;
+	int		index , count , *order;
+	char	*ptr;
+
+	for ( index = num_du_dirs - 1 ; index >= 0 ; --index ) {
+		dir = du_dirs[index];
+		if ( dir->parent != NULL ) {
+			dir->parent->totals->bytes += dir->totals->bytes;
+			dir->parent->totals->blocks += dir->totals->blocks;
+			dir->parent->totals->files += dir->totals->files;
+		} /* IF */
+	} /* FOR */
+
+	order = (int *)malloc((num_du_dirs > 0 ? num_du_dirs : 1) * sizeof(int));
+	if ( order == NULL ) {
+		quit(1,"malloc failed for %d directories",num_du_dirs);
+	} /* IF */
+	count = 0;
+	for ( index = 0 ; index < num_du_dirs ; ++index ) {
+		if ( du_dirs[index]->skipped == 0 &&
+				(opt_du_depth < 0 || du_dirs[index]->depth <= opt_du_depth) ) {
+			order[count++] = index;
+		} /* IF */
+	} /* FOR */
+	if ( opt_n == 0 ) {
+		qsort(order,count,sizeof(int),compare_du_dirs);
+	} /* IF */
+	debug_print("show_du_summary() : %d of %d directories , %ld files seen again not counted\n",
+			count,num_du_dirs,atomic_load(&num_links_skipped));
+
+	for ( index = 0 ; index < count ; ++index ) {
+		dir = du_dirs[ order[opt_n && opt_r ? count - 1 - index : index] ];
+		ptr = output_space(LINE_OVERHEAD + dir->path_length);
+		ptr += format_int(ptr,dir->totals->bytes,14);
+		*ptr++ = ' ';
+		ptr += format_int(ptr,(dir->totals->blocks + 1) / 2,12);
+		*ptr++ = ' ';
+		ptr += format_int(ptr,dir->totals->files,9);
+		*ptr++ = ' ';
+		if ( dir->path_length == 0 ) {
+			*ptr++ = '.';
+		} /* IF current directory */
+		memcpy(ptr,dir->path,dir->path_length);
+		ptr += dir->path_length;
+		*ptr++ = '\n';
+		Output.used = ptr - Output.data;
+	} /* FOR */
+	free(order);
+
+	return;
+} /* end of show_du_summary */
+
+/*********************************************************************
+*
+* Function  : stream_files
+*
+* Purpose   : Display and then discard the entries of the current list.
+*
+* Inputs    : (none)
+*
+* Output    : the file info
+*
+* Returns   : (nothing)
+*
+* Example   : stream_files();
+*
+* Notes     : Used for 'U'. The output is also written out if it has
+*             been held for a while , so a slow traversal still shows
+*             its first entries right away.
+*
+*********************************************************************/
+
+void stream_files()
+{
+	static struct timespec	last_flush;
+	struct timespec	now;
+	int		index;
+	long	elapsed;
+
+	for ( index = 0 ; index < current_list->count ; ++index ) {
+		display_file_info(current_list,index);
+	} /* FOR */
+	num_streamed += current_list->count;
+	clear_list(current_list);
+
+	if ( Output.used > 0 ) {
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		elapsed = (now.tv_sec - last_flush.tv_sec) * 1000 + (now.tv_nsec - last_flush.tv_nsec) / 1000000;
+		if ( elapsed >= STREAM_FLUSH_MSECS ) {
+			flush_output();
+			last_flush = now;
+		} /* IF */
+	} /* IF */
+
+	return;
+} /* end of stream_files */
+
+#ifdef	__linux__
+/*********************************************************************
+*
+* Function  : hash_watch_key
+*
+* Purpose   : Hash a key of the watched directories.
+*
+* Inputs    : unsigned char *key - the key
+*             int length - number of bytes in the key
+*
+* Output    : (none)
+*
+* Returns   : the hash
+*
+* Example   : hash = hash_watch_key(key,length);
+*
+* Notes     : FNV-1a.
+*
+*********************************************************************/
+
+unsigned long long hash_watch_key(unsigned char *key, int length)
+{
+	unsigned long long	hash;
+	int		index;
+
+	hash = 0xcbf29ce484222325ULL;
+	for ( index = 0 ; index < length ; ++index ) {
+		hash = (hash ^ key[index]) * 0x100000001b3ULL;
+	} /* FOR */
+
+	return(hash);
+} /* end of hash_watch_key */
+
+/*********************************************************************
+*
+* Function  : add_watch_key
+*
+* Purpose   : Add a key for a watched directory to the lookup table.
+*
+* Inputs    : unsigned char *key - the key
+*             int length - number of bytes in the key
+*             int dir_index - index of the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_watch_key(key,length,index);
+*
+* Notes     : Keys are never deleted , the slot of a removed directory
+*             stays and is passed over by the lookups. The table is
+*             doubled whenever it gets half full.
+*
+*********************************************************************/
+
+void add_watch_key(unsigned char *key, int length, int dir_index)
+{
+	WATCHKEY	*old_table;
+	int		old_size , index , count , mask;
+	unsigned long long	hash;
+
+	if ( 2 * (Watch.table_used + 1) > Watch.table_size ) {
+		old_table = Watch.table;
+		old_size = Watch.table_size;
+		Watch.table_size = (old_size > 0) ? 2 * old_size : 1024;
+		Watch.table = (WATCHKEY *)malloc(Watch.table_size * sizeof(WATCHKEY));
+		if ( Watch.table == NULL ) {
+			quit(1,"malloc failed for %d watch keys",Watch.table_size);
+		} /* IF */
+		for ( index = 0 ; index < Watch.table_size ; ++index ) {
+			Watch.table[index].index = -1;
+		} /* FOR */
+		mask = Watch.table_size - 1;
+		for ( count = 0 ; count < old_size ; ++count ) {
+			if ( old_table[count].index >= 0 ) {
+				index = old_table[count].hash & mask;
+				while ( Watch.table[index].index >= 0 ) {
+					index = (index + 1) & mask;
+				} /* WHILE */
+				Watch.table[index] = old_table[count];
+			} /* IF */
+		} /* FOR */
+		free(old_table);
+	} /* IF table is half full */
+
+	hash = hash_watch_key(key,length);
+	mask = Watch.table_size - 1;
+	index = hash & mask;
+	while ( Watch.table[index].index >= 0 ) {
+		index = (index + 1) & mask;
+	} /* WHILE */
+	Watch.table[index].hash = hash;
+	Watch.table[index].index = dir_index;
+	Watch.table[index].length = length;
+	Watch.table[index].key = (unsigned char *)malloc(length);
+	if ( Watch.table[index].key == NULL ) {
+		quit(1,"malloc failed for watch key");
+	} /* IF */
+	memcpy(Watch.table[index].key,key,length);
+	Watch.table_used += 1;
+
+	return;
+} /* end of add_watch_key */
+
+/*********************************************************************
+*
+* Function  : find_watch_dirs
+*
+* Purpose   : Find the watched directories with a key.
+*
+* Inputs    : unsigned char *key - the key
+*             int length - number of bytes in the key
+*             int *found - to receive the indexes of the directories
+*             int max_found - room in found
+*
+* Output    : (none)
+*
+* Returns   : number of directories found
+*
+* Example   : count = find_watch_dirs(key,length,found,WATCH_MAX_PATHS);
+*
+* Notes     : One directory reached through several paths , such as
+*             through a symbolic link , has one inotify watch and one
+*             file handle but a watched directory per path.
+*
+*********************************************************************/
+
+int find_watch_dirs(unsigned char *key, int length, int *found, int max_found)
+{
+	WATCHKEY	*slot;
+	unsigned long long	hash;
+	int		index , mask , count;
+
+	if ( Watch.table_size == 0 ) {
+		return(0);
+	} /* IF */
+	hash = hash_watch_key(key,length);
+	mask = Watch.table_size - 1;
+	count = 0;
+	for ( index = hash & mask ; Watch.table[index].index >= 0 ; index = (index + 1) & mask ) {
+		slot = &Watch.table[index];
+		if ( slot->hash == hash && slot->length == length && memcmp(slot->key,key,length) == 0 &&
+					Watch.dirs[slot->index].removed == 0 && count < max_found ) {
+			found[count++] = slot->index;
+		} /* IF */
+	} /* FOR */
+
+	return(count);
+} /* end of find_watch_dirs */
+
+/*********************************************************************
+*
+* Function  : find_watch_path
+*
+* Purpose   : Find the watched directory with a path.
+*
+* Inputs    : char *path - path of the directory
+*             int path_length - length of the path
+*
+* Output    : (none)
+*
+* Returns   : index of the directory , -1 if it is not watched
+*
+* Example   : index = find_watch_path(path,strlen(path));
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int find_watch_path(char *path, int path_length)
+{
+	unsigned char	*key;
+	int		found;
+
+	key = (unsigned char *)malloc(path_length + 1);
+	if ( key == NULL ) {
+		quit(1,"malloc failed for watch key");
+	} /* IF */
+	key[0] = 'p';
+	memcpy(&key[1],path,path_length);
+	if ( find_watch_dirs(key,path_length + 1,&found,1) == 0 ) {
+		found = -1;
+	} /* IF */
+	free(key);
+
+	return(found);
+} /* end of find_watch_path */
+
+/*********************************************************************
+*
+* Function  : open_watch
+*
+* Purpose   : Set up the event queues for '--watch'.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : open_watch();
+*
+* Notes     : fanotify needs CAP_SYS_ADMIN to mark a whole file system.
+*             Where it is permitted one mark covers every directory of
+*             the file system , otherwise each directory gets its own
+*             inotify watch.
+*
+*********************************************************************/
+
+void open_watch()
+{
+	pthread_mutex_init(&Watch.lock,NULL);
+	Watch.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ( Watch.inotify_fd < 0 ) {
+		quit(1,"inotify_init1 failed");
+	} /* IF */
+#ifdef	FAN_REPORT_DFID_NAME
+	Watch.fanotify_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC,O_RDONLY);
+#else
+	Watch.fanotify_fd = -1;
+#endif
+	if ( Watch.fanotify_fd < 0 ) {
+		debug_print("open_watch() : fanotify is not available , using inotify\n");
+	} /* IF */
+
+	return;
+} /* end of open_watch */
+
+/*********************************************************************
+*
+* Function  : mark_file_system
+*
+* Purpose   : Mark the file system of a directory for fanotify events.
+*
+* Inputs    : int dir_fd - descriptor for the directory
+*             unsigned long long fsid - id of its file system
+*
+* Output    : (none)
+*
+* Returns   : 1 if fanotify covers the file system , 0 if not
+*
+* Example   : if ( mark_file_system(dir_fd,fsid) ) {
+*
+* Notes     : Each file system is only tried once. Called with the lock
+*             of Watch held.
+*
+*********************************************************************/
+
+int mark_file_system(int dir_fd, unsigned long long fsid)
+{
+	int		index;
+
+	for ( index = 0 ; index < Watch.num_fsids ; ++index ) {
+		if ( Watch.fsids[index] == fsid ) {
+			return(Watch.fsid_marked[index]);
+		} /* IF */
+	} /* FOR */
+	Watch.fsids = (unsigned long long *)realloc(Watch.fsids,(index + 1) * sizeof(unsigned long long));
+	Watch.fsid_marked = (char *)realloc(Watch.fsid_marked,index + 1);
+	if ( Watch.fsids == NULL || Watch.fsid_marked == NULL ) {
+		quit(1,"realloc failed for file system ids");
+	} /* IF */
+	Watch.fsids[index] = fsid;
+	Watch.fsid_marked[index] = 0;
+	Watch.num_fsids += 1;
+#ifdef	FAN_REPORT_DFID_NAME
+	if ( fanotify_mark(Watch.fanotify_fd,FAN_MARK_ADD | FAN_MARK_FILESYSTEM,WATCH_FANOTIFY_EVENTS,
+				dir_fd,NULL) == 0 ) {
+		Watch.fsid_marked[index] = 1;
+		debug_print("mark_file_system() : fanotify covers file system %llx\n",fsid);
+	} /* IF */
+	else {
+		debug_print("mark_file_system() : fanotify_mark failed (%s) , using inotify\n",strerror(errno));
+	} /* ELSE */
+#endif
+
+	return(Watch.fsid_marked[index]);
+} /* end of mark_file_system */
+
+/*********************************************************************
+*
+* Function  : add_watch_dir
+*
+* Purpose   : Subscribe to the events of a directory being listed.
+*
+* Inputs    : DIRINFO *dir - information for the directory
+*             int dir_fd - descriptor for the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_watch_dir(dir,reader->fd);
+*
+* Notes     : Called before the entries are read , so that a change
+*             made while the directory is listed is not lost. The
+*             directory is found from its inotify watch or its file
+*             handle in the events , and from its path when walking.
+*
+*********************************************************************/
+
+void add_watch_dir(DIRINFO *dir, int dir_fd)
+{
+	struct _stat	dirstats;
+	struct statfs	fsstats;
+	WATCHDIR	*watchdir;
+	unsigned char	key[WATCH_KEY_SIZE] , *path_key;
+	union {
+		struct file_handle	handle;
+		unsigned char	space[sizeof(struct file_handle) + 128];
+	} fh;
+	unsigned long long	fsid;
+	int		index , key_length , wd , mount_id , parent_length;
+	char	*slash;
+
+	if ( fstat(dir_fd,&dirstats) < 0 ) {
+		return;
+	} /* IF */
+	key_length = 0;
+	wd = -1;
+	pthread_mutex_lock(&Watch.lock);
+	if ( Watch.fanotify_fd >= 0 && fstatfs(dir_fd,&fsstats) == 0 ) {
+		memcpy(&fsid,&fsstats.f_fsid,sizeof(fsid));
+		fh.handle.handle_bytes = 128;
+		if ( mark_file_system(dir_fd,fsid) &&
+					name_to_handle_at(dir_fd,"",&fh.handle,&mount_id,AT_EMPTY_PATH) == 0 ) {
+			key[0] = 'f';
+			memcpy(&key[1],&fsid,8);
+			memcpy(&key[9],&fh.handle.handle_type,4);
+			memcpy(&key[13],fh.handle.f_handle,fh.handle.handle_bytes);
+			key_length = 13 + fh.handle.handle_bytes;
+		} /* IF */
+	} /* IF */
+	if ( key_length == 0 ) {
+		wd = inotify_add_watch(Watch.inotify_fd,dir->path_length > 0 ? dir->path : ".",WATCH_INOTIFY_EVENTS);
+		if ( wd < 0 ) {
+			pthread_mutex_unlock(&Watch.lock);
+			system_error("inotify_add_watch() failed for \"%s\"",dir->path_length > 0 ? dir->path : ".");
+			return;
+		} /* IF */
+		key[0] = 'i';
+		memcpy(&key[1],&wd,sizeof(int));
+		key_length = 1 + sizeof(int);
+	} /* IF */
+
+	if ( Watch.num_dirs >= Watch.dirs_size ) {
+		Watch.dirs_size = (Watch.dirs_size > 0) ? 2 * Watch.dirs_size : 1024;
+		Watch.dirs = (WATCHDIR *)realloc(Watch.dirs,Watch.dirs_size * sizeof(WATCHDIR));
+		if ( Watch.dirs == NULL ) {
+			quit(1,"realloc failed for %d watched directories",Watch.dirs_size);
+		} /* IF */
+	} /* IF */
+	index = Watch.num_dirs++;
+	watchdir = &Watch.dirs[index];
+	watchdir->path = (char *)malloc(dir->path_length + 1);
+	if ( watchdir->path == NULL ) {
+		quit(1,"malloc failed for watched directory");
+	} /* IF */
+	memcpy(watchdir->path,dir->path,dir->path_length);
+	watchdir->path[dir->path_length] = '\0';
+	watchdir->path_length = dir->path_length;
+	watchdir->depth = dir->depth;
+	watchdir->wd = wd;
+	watchdir->device = dirstats.st_dev;
+	watchdir->inode = dirstats.st_ino;
+	watchdir->removed = 0;
+	watchdir->refreshed = -1;
+	watchdir->first_child = -1;
+	watchdir->next_sibling = -1;
+	slash = strrchr(watchdir->path,'/');
+	parent_length = (slash != NULL) ? slash - watchdir->path : (dir->path_length > 0 ? 0 : -1);
+	watchdir->parent = (parent_length >= 0) ? find_watch_path(watchdir->path,parent_length) : -1;
+	if ( watchdir->parent >= 0 ) {
+		watchdir->next_sibling = Watch.dirs[watchdir->parent].first_child;
+		Watch.dirs[watchdir->parent].first_child = index;
+	} /* IF */
+	add_watch_key(key,key_length,index);
+	path_key = (unsigned char *)malloc(dir->path_length + 1);
+	if ( path_key == NULL ) {
+		quit(1,"malloc failed for watch key");
+	} /* IF */
+	path_key[0] = 'p';
+	memcpy(&path_key[1],dir->path,dir->path_length);
+	add_watch_key(path_key,dir->path_length + 1,index);
+	free(path_key);
+	pthread_mutex_unlock(&Watch.lock);
+
+	return;
+} /* end of add_watch_dir */
+
+/*********************************************************************
+*
+* Function  : remove_watch_dir
+*
+* Purpose   : Stop watching a directory and the directories under it.
+*
+* Inputs    : int dir_index - index of the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : remove_watch_dir(index);
+*
+* Notes     : An inotify watch is only dropped once no other path of
+*             the directory is still watched.
+*
+*********************************************************************/
+
+void remove_watch_dir(int dir_index)
+{
+	WATCHDIR	*watchdir;
+	unsigned char	key[1 + sizeof(int)];
+	int		child , other;
+
+	watchdir = &Watch.dirs[dir_index];
+	if ( watchdir->removed ) {
+		return;
+	} /* IF */
+	watchdir->removed = 1;
+	debug_print("remove_watch_dir(%s)\n",watchdir->path);
+	if ( watchdir->wd >= 0 ) {
+		key[0] = 'i';
+		memcpy(&key[1],&watchdir->wd,sizeof(int));
+		if ( find_watch_dirs(key,sizeof(key),&other,1) == 0 ) {
+			inotify_rm_watch(Watch.inotify_fd,watchdir->wd);
+		} /* IF */
+	} /* IF */
+	for ( child = watchdir->first_child ; child >= 0 ; child = Watch.dirs[child].next_sibling ) {
+		remove_watch_dir(child);
+	} /* FOR */
+
+	return;
+} /* end of remove_watch_dir */
+
+/*********************************************************************
+*
+* Function  : queue_watch_change
+*
+* Purpose   : Queue a path to be looked at when the batch is applied.
+*
+* Inputs    : int dir_index - watched directory holding the entry
+*             char *name - name of the entry , NULL for the directory
+*                          itself
+*             int kind - WATCH_ENTRY , WATCH_REFRESH or WATCH_SELF
+*
+* Output    : (none)
+*
+* Returns   : index of the change
+*
+* Example   : queue_watch_change(index,event->name,WATCH_ENTRY);
+*
+* Notes     : Only the path is kept , the entry is stat'ed once when
+*             the batch is applied however many events it had.
+*
+*********************************************************************/
+
+long queue_watch_change(int dir_index, char *name, int kind)
+{
+	WATCHCHANGE	*change;
+	WATCHDIR	*watchdir;
+	size_t	name_length;
+
+	if ( Watch.num_changes >= Watch.changes_size ) {
+		Watch.changes_size = (Watch.changes_size > 0) ? 2 * Watch.changes_size : 1024;
+		Watch.changes = (WATCHCHANGE *)realloc(Watch.changes,Watch.changes_size * sizeof(WATCHCHANGE));
+		if ( Watch.changes == NULL ) {
+			quit(1,"realloc failed for %ld watch changes",Watch.changes_size);
+		} /* IF */
+	} /* IF */
+	change = &Watch.changes[Watch.num_changes];
+	memset(change,0,sizeof(WATCHCHANGE));
+	change->seq = Watch.num_changes;
+	change->dir = dir_index;
+	change->kind = kind;
+	if ( dir_index >= 0 ) {
+		watchdir = &Watch.dirs[dir_index];
+		name_length = (name == NULL) ? 0 : strlen(name);
+		change->path = (char *)malloc(watchdir->path_length + 1 + name_length + 1);
+		if ( change->path == NULL ) {
+			quit(1,"malloc failed for watch change");
+		} /* IF */
+		memcpy(change->path,watchdir->path,watchdir->path_length + 1);
+		if ( name != NULL ) {
+			if ( watchdir->path_length > 0 ) {
+				change->path[watchdir->path_length] = '/';
+				memcpy(&change->path[watchdir->path_length + 1],name,name_length + 1);
+			} /* IF */
+			else {
+				memcpy(change->path,name,name_length + 1);
+			} /* ELSE */
+		} /* IF */
+	} /* IF */
+
+	return(Watch.num_changes++);
+} /* end of queue_watch_change */
+
+/*********************************************************************
+*
+* Function  : queue_key_event
+*
+* Purpose   : Queue the changes for an event on a watched directory.
+*
+* Inputs    : unsigned char *key - key of the directory in the event
+*             int length - number of bytes in the key
+*             char *name - name of the entry , NULL for the directory
+*                          itself
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : queue_key_event(key,length,name);
+*
+* Notes     : Events for directories which are not watched , as when a
+*             whole file system is marked , are dropped.
+*
+*********************************************************************/
+
+void queue_key_event(unsigned char *key, int length, char *name)
+{
+	int		found[WATCH_MAX_PATHS];
+	int		count , index;
+
+	Watch.num_events += 1;
+	count = find_watch_dirs(key,length,found,WATCH_MAX_PATHS);
+	for ( index = 0 ; index < count ; ++index ) {
+		queue_watch_change(found[index],name,name == NULL ? WATCH_SELF : WATCH_ENTRY);
+	} /* FOR */
+
+	return;
+} /* end of queue_key_event */
+
+/*********************************************************************
+*
+* Function  : queue_everything
+*
+* Purpose   : Queue every listed entry and every watched directory.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : queue_everything();
+*
+* Notes     : Used when the kernel dropped events because its queue
+*             overflowed. Each directory is read again to find the new
+*             entries , each listed entry is stat'ed again to find the
+*             changed and deleted ones.
+*
+*********************************************************************/
+
+void queue_everything()
+{
+	DIRREADER	reader;
+	char	*name , *slash;
+	unsigned char	type;
+	int		dir_index;
+	long	index;
+
+	debug_print("queue_everything() : events were lost , rescanning\n");
+	for ( dir_index = 0 ; dir_index < Watch.num_dirs ; ++dir_index ) {
+		if ( Watch.dirs[dir_index].removed ) {
+			continue;
+		} /* IF */
+		queue_watch_change(dir_index,NULL,WATCH_SELF);
+		if ( open_dir_reader(&reader,AT_FDCWD,Watch.dirs[dir_index].path_length > 0 ?
+					Watch.dirs[dir_index].path : ".") < 0 ) {
+			continue;
+		} /* IF */
+		for ( name = read_dir_entry(&reader,&type) ; name != NULL ; name = read_dir_entry(&reader,&type) ) {
+			queue_watch_change(dir_index,name,WATCH_ENTRY);
+		} /* FOR */
+		close_dir_reader(&reader);
+	} /* FOR */
+	for ( index = 0 ; index < Watch.num_items ; ++index ) {
+		slash = strrchr(Watch.items[index].path,'/');
+		dir_index = find_watch_path(Watch.items[index].path,
+					slash == NULL ? 0 : slash - Watch.items[index].path);
+		if ( dir_index >= 0 ) {
+			queue_watch_change(dir_index,slash == NULL ? Watch.items[index].path : slash + 1,WATCH_ENTRY);
+		} /* IF */
+	} /* FOR */
+
+	return;
+} /* end of queue_everything */
+
+/*********************************************************************
+*
+* Function  : read_inotify_events
+*
+* Purpose   : Queue the changes for the waiting inotify events.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : read_inotify_events();
+*
+* Notes     : The descriptor does not block , reading stops once the
+*             queue is empty.
+*
+*********************************************************************/
+
+void read_inotify_events()
+{
+	char	buffer[WATCH_EVENT_BUFFER] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event	*event;
+	unsigned char	key[1 + sizeof(int)];
+	ssize_t	length , offset;
+
+	for ( ; ; ) {
+		length = read(Watch.inotify_fd,buffer,sizeof(buffer));
+		if ( length <= 0 ) {
+			break;
+		} /* IF */
+		for ( offset = 0 ; offset < length ; offset += sizeof(struct inotify_event) + event->len ) {
+			event = (struct inotify_event *)&buffer[offset];
+			if ( event->mask & IN_Q_OVERFLOW ) {
+				queue_everything();
+				continue;
+			} /* IF */
+			if ( event->mask & IN_IGNORED ) {
+				continue;
+			} /* IF the watch is gone */
+			key[0] = 'i';
+			memcpy(&key[1],&event->wd,sizeof(int));
+			queue_key_event(key,sizeof(key),event->len > 0 ? event->name : NULL);
+		} /* FOR */
+	} /* FOR */
+
+	return;
+} /* end of read_inotify_events */
+
+#ifdef	FAN_REPORT_DFID_NAME
+/*********************************************************************
+*
+* Function  : read_fanotify_events
+*
+* Purpose   : Queue the changes for the waiting fanotify events.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : read_fanotify_events();
+*
+* Notes     : Each event names the file handle of a directory and an
+*             entry in it , "." or no name for the directory itself.
+*
+*********************************************************************/
+
+void read_fanotify_events()
+{
+	char	buffer[WATCH_EVENT_BUFFER] __attribute__ ((aligned(__alignof__(struct fanotify_event_metadata))));
+	struct fanotify_event_metadata	*event;
+	struct fanotify_event_info_fid	*fid;
+	struct file_handle	*handle;
+	unsigned char	key[WATCH_KEY_SIZE];
+	char	*name;
+	ssize_t	length;
+
+	for ( ; ; ) {
+		length = read(Watch.fanotify_fd,buffer,sizeof(buffer));
+		if ( length <= 0 ) {
+			break;
+		} /* IF */
+		for ( event = (struct fanotify_event_metadata *)buffer ; FAN_EVENT_OK(event,length) ;
+					event = FAN_EVENT_NEXT(event,length) ) {
+			if ( event->mask & FAN_Q_OVERFLOW ) {
+				queue_everything();
+				continue;
+			} /* IF */
+			fid = (struct fanotify_event_info_fid *)(event + 1);
+			if ( event->event_len < sizeof(*event) + sizeof(*fid) + sizeof(struct file_handle) ) {
+				continue;
+			} /* IF no file handle */
+			handle = (struct file_handle *)fid->handle;
+			if ( handle->handle_bytes > 128 ) {
+				continue;
+			} /* IF */
+			if ( fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME ) {
+				name = (char *)handle->f_handle + handle->handle_bytes;
+				if ( EQ(name,".") ) {
+					name = NULL;
+				} /* IF */
+			} /* IF */
+			else if ( fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID ||
+						fid->hdr.info_type == FAN_EVENT_INFO_TYPE_FID ) {
+				name = NULL;
+			} /* ELSE IF */
+			else {
+				continue;
+			} /* ELSE */
+			key[0] = 'f';
+			memcpy(&key[1],&fid->fsid,8);
+			memcpy(&key[9],&handle->handle_type,4);
+			memcpy(&key[13],handle->f_handle,handle->handle_bytes);
+			queue_key_event(key,13 + handle->handle_bytes,name);
+		} /* FOR */
+	} /* FOR */
+
+	return;
+} /* end of read_fanotify_events */
+#endif
+
+/*********************************************************************
+*
+* Function  : add_gone_path
+*
+* Purpose   : Note that nothing is left under a path.
+*
+* Inputs    : char *path - the path
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : add_gone_path(path);
+*
+* Notes     : The entries under the path are removed from the listing
+*             when the batch is applied. A watched directory at the
+*             path is dropped at once , so that a new directory which
+*             takes its place is walked.
+*
+*********************************************************************/
+
+void add_gone_path(char *path)
+{
+	int		dir_index;
+
+	dir_index = find_watch_path(path,strlen(path));
+	if ( dir_index < 0 ) {
+		return;
+	} /* IF nothing was listed under it */
+	remove_watch_dir(dir_index);
+	if ( Watch.num_gone >= Watch.gone_size ) {
+		Watch.gone_size = (Watch.gone_size > 0) ? 2 * Watch.gone_size : 64;
+		Watch.gone = (char **)realloc(Watch.gone,Watch.gone_size * sizeof(char *));
+		if ( Watch.gone == NULL ) {
+			quit(1,"realloc failed for %d paths",Watch.gone_size);
+		} /* IF */
+	} /* IF */
+	Watch.gone[Watch.num_gone] = _strdup(path);
+	if ( Watch.gone[Watch.num_gone] == NULL ) {
+		quit(1,"strdup failed for path");
+	} /* IF */
+	Watch.num_gone += 1;
+
+	return;
+} /* end of add_gone_path */
+
+/*********************************************************************
+*
+* Function  : scan_new_subtree
+*
+* Purpose   : List and watch a directory which appeared under 'R'.
+*
+* Inputs    : char *path - path of the directory
+*             int depth - depth of the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : scan_new_subtree(path,watchdir->depth + 1);
+*
+* Notes     : The tree is walked into a list of its own , whose entries
+*             are queued as already resolved changes.
+*
+*********************************************************************/
+
+void scan_new_subtree(char *path, int depth)
+{
+	LIST	fresh , *saved_list;
+	ARENAMARK	node_mark , string_mark;
+	WATCHCHANGE	*change;
+	int		index;
+
+	memset(&fresh,0,sizeof(fresh));
+	arena_mark(node_arena,&node_mark);
+	arena_mark(string_arena,&string_mark);
+	saved_list = current_list;
+	current_list = &fresh;
+	top_level_depth = depth;
+	traverse_tree(path,scan_directory,0);
+	top_level_depth = 0;
+	current_list = saved_list;
+
+	for ( index = 0 ; index < fresh.count ; ++index ) {
+		change = &Watch.changes[queue_watch_change(-1,NULL,WATCH_ENTRY)];
+		change->path = (char *)malloc(FILE_PATH_LENGTH(&fresh,index) + 1);
+		if ( change->path == NULL ) {
+			quit(1,"malloc failed for watch change");
+		} /* IF */
+		memcpy(change->path,FILE_PATH(&fresh,index),FILE_PATH_LENGTH(&fresh,index) + 1);
+		change->present = 1;
+		get_entry_info(&fresh,index,&change->info);
+	} /* FOR */
+	free_list(&fresh);
+	arena_rewind(node_arena,&node_mark);
+	arena_rewind(string_arena,&string_mark);
+
+	return;
+} /* end of scan_new_subtree */
+
+/*********************************************************************
+*
+* Function  : refresh_watch_dir
+*
+* Purpose   : Queue the entries which show a watched directory itself.
+*
+* Inputs    : int dir_index - index of the directory
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : refresh_watch_dir(index);
+*
+* Notes     : Its "." entry and its entry in its parent change whenever
+*             an entry is created , removed or renamed in it. Done once
+*             per directory and batch. The ".." entries of its
+*             subdirectories are not refreshed.
+*
+*********************************************************************/
+
+void refresh_watch_dir(int dir_index)
+{
+	WATCHDIR	*watchdir , *parent;
+
+	watchdir = &Watch.dirs[dir_index];
+	if ( opt_1 || watchdir->refreshed == Watch.batch ) {
+		return;
+	} /* IF */
+	watchdir->refreshed = Watch.batch;
+	queue_watch_change(dir_index,".",WATCH_REFRESH);
+	if ( watchdir->parent >= 0 ) {
+		parent = &Watch.dirs[watchdir->parent];
+		queue_watch_change(watchdir->parent,&watchdir->path[parent->path_length + (parent->path_length > 0)],
+					WATCH_REFRESH);
+	} /* IF */
+
+	return;
+} /* end of refresh_watch_dir */
+
+/*********************************************************************
+*
+* Function  : resolve_watch_change
+*
+* Purpose   : Stat a queued path to find what the change did.
+*
+* Inputs    : long change_index - index of the change
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : resolve_watch_change(index);
+*
+* Notes     : An entry is listed if it exists and passes '--min-depth'
+*             and the filter. A new directory under 'R' is walked. A
+*             path which is gone or no longer a directory loses the
+*             entries under it.
+*
+*********************************************************************/
+
+void resolve_watch_change(long change_index)
+{
+	struct _stat	filestats;
+	WATCHCHANGE	*change;
+	WATCHDIR	*watchdir;
+	DIRINFO	holder;
+	char	*path , *name;
+	int		dir_index , kind , existing , status;
+
+	change = &Watch.changes[change_index];
+	dir_index = change->dir;
+	kind = change->kind;
+	path = change->path;
+	change->dir = -1;
+	watchdir = &Watch.dirs[dir_index];
+	if ( watchdir->removed ) {
+		change->kind = WATCH_SELF;
+		return;
+	} /* IF the change came before its directory went */
+
+	status = _stat(path[0] != '\0' ? path : ".",&filestats);
+	if ( kind == WATCH_SELF ) {
+		if ( status < 0 || filestats.st_dev != watchdir->device || filestats.st_ino != watchdir->inode ) {
+			add_gone_path(path);
+		} /* IF */
+		else {
+			refresh_watch_dir(dir_index);
+		} /* ELSE */
+		return;
+	} /* IF the event was on the directory itself */
+
+	name = &path[watchdir->path_length + (watchdir->path_length > 0)];
+	if ( status < 0 ) {
+		change->present = 0;
+		add_gone_path(path);
+	} /* IF */
+	else {
+		change->present = (watchdir->depth + 1 >= opt_min_depth &&
+					eval_filter(Filter,name,IFTODT(filestats.st_mode),&filestats,0) == FILTER_TRUE);
+		stat_to_info(&filestats,&change->info);
+		if ( ! _S_ISDIR(filestats.st_mode & _S_IFMT) ) {
+			add_gone_path(path);
+		} /* IF */
+		else if ( opt_R && NE(name,".") && NE(name,"..") ) {
+			existing = find_watch_path(path,strlen(path));
+			if ( existing >= 0 && (Watch.dirs[existing].device != filestats.st_dev ||
+						Watch.dirs[existing].inode != filestats.st_ino) ) {
+				add_gone_path(path);
+				existing = -1;
+			} /* IF another directory took its place */
+			memset(&holder,0,sizeof(holder));
+			holder.path = watchdir->path;
+			holder.path_length = watchdir->path_length;
+			holder.depth = watchdir->depth;
+			if ( existing < 0 && (opt_x == 0 || filestats.st_dev == watchdir->device) &&
+						descend_into(&holder,name) ) {
+				scan_new_subtree(path,watchdir->depth + 1);
+			} /* IF */
+		} /* ELSE IF */
+	} /* ELSE */
+	if ( kind == WATCH_ENTRY ) {
+		refresh_watch_dir(dir_index);
+	} /* IF */
+
+	return;
+} /* end of resolve_watch_change */
+
+/*********************************************************************
+*
+* Function  : compare_watch_changes
+*
+* Purpose   : Compare 2 changes by path and then by when they came.
+*
+* Inputs    : const void *first - the first change
+*             const void *second - the second change
+*
+* Output    : (none)
+*
+* Returns   : <0 , 0 or >0 as for strcmp()
+*
+* Example   : qsort(changes,count,sizeof(WATCHCHANGE),compare_watch_changes);
+*
+* Notes     : The changes for a directory itself go first , they carry
+*             no entry and must not hide the last change of the entry.
+*
+*********************************************************************/
+
+int compare_watch_changes(const void *first, const void *second)
+{
+	const WATCHCHANGE	*change1 , *change2;
+	int		order;
+
+	change1 = (const WATCHCHANGE *)first;
+	change2 = (const WATCHCHANGE *)second;
+	order = strcmp(change1->path,change2->path);
+	if ( order == 0 ) {
+		order = (change2->kind == WATCH_SELF) - (change1->kind == WATCH_SELF);
+	} /* IF */
+	if ( order == 0 ) {
+		order = (change1->seq > change2->seq) - (change1->seq < change2->seq);
+	} /* IF */
+
+	return(order);
+} /* end of compare_watch_changes */
+
+/*********************************************************************
+*
+* Function  : compare_watch_items
+*
+* Purpose   : Compare 2 entries of the live listing by path.
+*
+* Inputs    : const void *first - the first entry
+*             const void *second - the second entry
+*
+* Output    : (none)
+*
+* Returns   : <0 , 0 or >0 as for strcmp()
+*
+* Example   : qsort(items,count,sizeof(WATCHITEM),compare_watch_items);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int compare_watch_items(const void *first, const void *second)
+{
+	return( strcmp(((const WATCHITEM *)first)->path,((const WATCHITEM *)second)->path) );
+} /* end of compare_watch_items */
+
+/*********************************************************************
+*
+* Function  : mark_gone_items
+*
+* Purpose   : Mark the entries under the paths which are gone.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : mark_gone_items();
+*
+* Notes     : The entries under a path are next to each other in the
+*             listing , they are found with a binary search.
+*
+*********************************************************************/
+
+void mark_gone_items()
+{
+	char	*prefix;
+	size_t	length;
+	long	low , high , middle;
+	int		index;
+
+	for ( index = 0 ; index < Watch.num_gone ; ++index ) {
+		length = strlen(Watch.gone[index]);
+		prefix = (char *)malloc(length + 2);
+		if ( prefix == NULL ) {
+			quit(1,"malloc failed for path");
+		} /* IF */
+		memcpy(prefix,Watch.gone[index],length);
+		prefix[length] = '/';
+		prefix[length+1] = '\0';
+		low = 0;
+		high = Watch.num_items;
+		while ( low < high ) {
+			middle = (low + high) / 2;
+			if ( strcmp(Watch.items[middle].path,prefix) < 0 ) {
+				low = middle + 1;
+			} /* IF */
+			else {
+				high = middle;
+			} /* ELSE */
+		} /* WHILE */
+		for ( ; low < Watch.num_items && strncmp(Watch.items[low].path,prefix,length + 1) == 0 ; ++low ) {
+			Watch.items[low].removed = 1;
+		} /* FOR */
+		free(prefix);
+		free(Watch.gone[index]);
+	} /* FOR */
+	Watch.num_gone = 0;
+
+	return;
+} /* end of mark_gone_items */
+
+/*********************************************************************
+*
+* Function  : show_watch_row
+*
+* Purpose   : Display a changed entry of the live listing.
+*
+* Inputs    : int marker - '+' for a new entry , '-' for a removed one
+*                          and '~' for a changed one
+*             char *path - path of the entry
+*             ENTRYINFO *info - the information for the entry , the
+*                               last one seen for a removed entry
+*
+* Output    : the row
+*
+* Returns   : (nothing)
+*
+* Example   : show_watch_row('+',item->path,&item->info);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+void show_watch_row(int marker, char *path, ENTRYINFO *info)
+{
+	char	*ptr;
+
+	ptr = output_space(2);
+	ptr[0] = marker;
+	ptr[1] = ' ';
+	Output.used += 2;
+	show_entry(path,strlen(path),info);
+	Watch.num_rows += 1;
+
+	return;
+} /* end of show_watch_row */
+
+/*********************************************************************
+*
+* Function  : apply_watch_changes
+*
+* Purpose   : Apply a batch of changes to the live listing.
+*
+* Inputs    : (none)
+*
+* Output    : the changed rows
+*
+* Returns   : (nothing)
+*
+* Example   : apply_watch_changes();
+*
+* Notes     : The changes are sorted by path and merged into the
+*             listing in one pass , only the last change of a path
+*             counts. The rows come out in path order.
+*
+*********************************************************************/
+
+void apply_watch_changes()
+{
+	WATCHITEM	*items , *item;
+	WATCHCHANGE	*change;
+	long	index , count , num_items , num_changes , num_rows;
+	int		order;
+
+	Watch.batch += 1;
+	num_rows = Watch.num_rows;
+	for ( index = 0 ; index < Watch.num_changes ; ++index ) {
+		if ( Watch.changes[index].dir >= 0 ) {
+			resolve_watch_change(index);
+		} /* IF */
+	} /* FOR new changes may be queued as it goes */
+	num_changes = Watch.num_changes;
+	qsort(Watch.changes,num_changes,sizeof(WATCHCHANGE),compare_watch_changes);
+	mark_gone_items();
+
+	items = (WATCHITEM *)malloc((Watch.num_items + num_changes + 1) * sizeof(WATCHITEM));
+	if ( items == NULL ) {
+		quit(1,"malloc failed for %ld watch entries",Watch.num_items + num_changes);
+	} /* IF */
+	num_items = 0;
+	count = 0;
+	index = 0;
+	while ( count < Watch.num_items || index < num_changes ) {
+		change = (index < num_changes) ? &Watch.changes[index] : NULL;
+		if ( change != NULL && (change->kind == WATCH_SELF ||
+					(index + 1 < num_changes && EQ(change->path,Watch.changes[index+1].path))) ) {
+			free(change->path);
+			index += 1;
+			continue;
+		} /* IF the change has no entry or a later one replaces it */
+		item = (count < Watch.num_items) ? &Watch.items[count] : NULL;
+		order = (item == NULL) ? 1 : ((change == NULL) ? -1 : strcmp(item->path,change->path));
+		if ( order < 0 ) {
+			if ( item->removed ) {
+				show_watch_row('-',item->path,&item->info);
+				free(item->path);
+			} /* IF */
+			else {
+				items[num_items++] = *item;
+			} /* ELSE */
+			count += 1;
+		} /* IF only in the listing */
+		else if ( order == 0 ) {
+			if ( change->present ) {
+				if ( opt_1 == 0 && ! SAME_ENTRY_INFO(&item->info,&change->info) ) {
+					show_watch_row('~',item->path,&change->info);
+				} /* IF */
+				items[num_items].path = item->path;
+				items[num_items].info = change->info;
+				items[num_items++].removed = 0;
+			} /* IF */
+			else {
+				show_watch_row('-',item->path,&item->info);
+				free(item->path);
+			} /* ELSE */
+			free(change->path);
+			count += 1;
+			index += 1;
+		} /* ELSE IF */
+		else {
+			if ( change->present ) {
+				show_watch_row('+',change->path,&change->info);
+				items[num_items].path = change->path;
+				items[num_items].info = change->info;
+				items[num_items++].removed = 0;
+			} /* IF */
+			else {
+				free(change->path);
+			} /* ELSE */
+			index += 1;
+		} /* ELSE only in the changes */
+	} /* WHILE */
+	free(Watch.items);
+	Watch.items = items;
+	Watch.num_items = num_items;
+	Watch.num_changes = 0;
+	debug_print("apply_watch_changes() : %ld events , %ld paths , %ld rows , %ld entries\n",
+			Watch.num_events,num_changes,Watch.num_rows - num_rows,num_items);
+	Watch.num_events = 0;
+	flush_output();
+
+	return;
+} /* end of apply_watch_changes */
+
+/*********************************************************************
+*
+* Function  : watch_listing
+*
+* Purpose   : Keep the listing live for '--watch'.
+*
+* Inputs    : (none)
+*
+* Output    : the rows which change
+*
+* Returns   : (nothing) , only ends when killed
+*
+* Example   : watch_listing();
+*
+* Notes     : The listed entries are kept in path order. The events of
+*             a burst are gathered for watch_delay milliseconds from the
+*             first one , then applied as one batch.
+*
+*********************************************************************/
+
+void watch_listing()
+{
+	struct pollfd	fds[2];
+	struct timespec	now;
+	long long	deadline , now_ms;
+	long	index;
+	int		num_fds , timeout;
+
+	Watch.items = (WATCHITEM *)malloc((Files.count + 1) * sizeof(WATCHITEM));
+	if ( Watch.items == NULL ) {
+		quit(1,"malloc failed for %d watch entries",Files.count);
+	} /* IF */
+	for ( index = 0 ; index < Files.count ; ++index ) {
+		Watch.items[index].path = (char *)malloc(FILE_PATH_LENGTH(&Files,index) + 1);
+		if ( Watch.items[index].path == NULL ) {
+			quit(1,"malloc failed for watch entry");
+		} /* IF */
+		memcpy(Watch.items[index].path,FILE_PATH(&Files,index),FILE_PATH_LENGTH(&Files,index) + 1);
+		get_entry_info(&Files,index,&Watch.items[index].info);
+		Watch.items[index].removed = 0;
+	} /* FOR */
+	Watch.num_items = Files.count;
+	qsort(Watch.items,Watch.num_items,sizeof(WATCHITEM),compare_watch_items);
+	opt_restat = 0;
+	debug_print("watch_listing() : %d directories watched , %ld entries\n",Watch.num_dirs,Watch.num_items);
+
+	fds[0].fd = Watch.inotify_fd;
+	fds[0].events = POLLIN;
+	num_fds = 1;
+	if ( Watch.fanotify_fd >= 0 ) {
+		fds[1].fd = Watch.fanotify_fd;
+		fds[1].events = POLLIN;
+		num_fds = 2;
+	} /* IF */
+	deadline = 0;
+	for ( ; ; ) {
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		now_ms = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+		if ( Watch.num_changes > 0 && now_ms >= deadline ) {
+			apply_watch_changes();
+			continue;
+		} /* IF the window is over */
+		timeout = (Watch.num_changes > 0) ? (int)(deadline - now_ms) : -1;
+		if ( poll(fds,num_fds,timeout) < 0 && errno != EINTR ) {
+			quit(1,"poll failed");
+		} /* IF */
+		index = Watch.num_changes;
+		read_inotify_events();
+#ifdef	FAN_REPORT_DFID_NAME
+		if ( Watch.fanotify_fd >= 0 ) {
+			read_fanotify_events();
+		} /* IF */
+#endif
+		if ( index == 0 && Watch.num_changes > 0 ) {
+			clock_gettime(CLOCK_MONOTONIC,&now);
+			deadline = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + watch_delay;
+		} /* IF first event of a batch */
+	} /* FOR */
+} /* end of watch_listing */
+#endif
+
+/*********************************************************************
+*
+* Function  : main
+*
+* Purpose   : program entry point
+*
+* Inputs    : argc - number of parameters
+*             argv - list of parameters
 *
 * Output    : (none)
 *
@@ -741,10 +10422,11 @@ int main(int argc, char *argv[])
 	char	*filename;
 	struct _stat	filestats;
 	unsigned short	filemode;
-	FILEDATA	*file_node;
+	int		index;
+	struct rusage	resources;
 
 	errflag = 0;
-	while ( (c = _getopt(argc,argv,":hgiDdtsnrR")) != -1 ) {
+	while ( (c = _getopt_long(argc,argv,":hgoiDdtsnrRxU1j:",long_options,NULL)) != -1 ) {
 		switch (c) {
 		case 'h':
 			opt_h = 1;
@@ -755,9 +10437,80 @@ int main(int argc, char *argv[])
 		case 'R':
 			opt_R = 1;
 			break;
+		case 'x':
+		case OPT_ONE_FS:
+			opt_x = 1;
+			break;
+		case OPT_LOCALE_SORT:
+			opt_locale_sort = 1;
+			break;
+		case OPT_CACHE:
+			opt_cache = optarg;
+			break;
+		case OPT_MANIFEST:
+			opt_manifest = optarg;
+			break;
+		case OPT_DIFF:
+			opt_diff = optarg;
+			break;
+		case OPT_HASH:
+			if ( strcmp(optarg,"xxh3") == 0 ) {
+				opt_hash = HASH_XXH3;
+				Hashes.digest_size = 8;
+			} /* IF */
+			else if ( strcmp(optarg,"sha256") == 0 ) {
+				opt_hash = HASH_SHA256;
+				Hashes.digest_size = 32;
+			} /* ELSE IF */
+			else {
+				printf("Invalid hash '%s'\n",optarg);
+				errflag += 1;
+			} /* ELSE */
+			break;
+		case OPT_HASH_CACHE:
+			opt_hash_cache = optarg;
+			break;
+		case OPT_FORMAT:
+			if ( strcmp(optarg,"nul") == 0 ) {
+				opt_format = FORMAT_NUL;
+			} /* IF */
+			else if ( strcmp(optarg,"jsonl") == 0 ) {
+				opt_format = FORMAT_JSONL;
+			} /* ELSE IF */
+			else if ( strcmp(optarg,"bin") == 0 ) {
+				opt_format = FORMAT_BIN;
+			} /* ELSE IF */
+			else {
+				printf("Invalid format '%s'\n",optarg);
+				errflag += 1;
+			} /* ELSE */
+			break;
+		case OPT_WATCH:
+			opt_watch = 1;
+			if ( optarg != NULL ) {
+				watch_delay = atoi(optarg);
+				if ( watch_delay < 0 || strspn(optarg,"0123456789") != strlen(optarg) ) {
+					printf("Invalid watch delay '%s'\n",optarg);
+					errflag += 1;
+				} /* IF */
+			} /* IF */
+			break;
+		case OPT_MAX_MEMORY:
+			opt_max_memory = parse_size(optarg);
+			if ( opt_max_memory <= 0 ) {
+				printf("Invalid memory size '%s'\n",optarg);
+				errflag += 1;
+			} /* IF */
+			break;
 		case 'd':
 			opt_d = 1;
 			break;
+		case 'o':
+			opt_o = 1;
+			break;
+		case 'g':
+			opt_g = 1;
+			break;
 		case 'D':
 			opt_D = 1;
 			break;
@@ -770,6 +10523,89 @@ int main(int argc, char *argv[])
 		case 'n':
 			opt_n = 1;
 			break;
+		case '1':
+			opt_1 = 1;
+			break;
+		case 'j':
+			opt_j = atoi(optarg);
+			if ( opt_j < 1 ) {
+				printf("Invalid number of threads '%s'\n",optarg);
+				errflag += 1;
+			} /* IF */
+			break;
+		case OPT_RESTAT:
+			opt_restat = 1;
+			break;
+		case OPT_ASYNC_STAT:
+			opt_async_stat = 1;
+			break;
+		case OPT_MAX_DEPTH:
+			opt_max_depth = atoi(optarg);
+			if ( opt_max_depth < 1 ) {
+				printf("Invalid maximum depth '%s'\n",optarg);
+				errflag += 1;
+			} /* IF */
+			break;
+		case OPT_MIN_DEPTH:
+			opt_min_depth = atoi(optarg);
+			if ( opt_min_depth < 0 ) {
+				printf("Invalid minimum depth '%s'\n",optarg);
+				errflag += 1;
+			} /* IF */
+			break;
+		case OPT_PRUNE:
+			prune_patterns = (char **)realloc(prune_patterns,(num_prunes + 1) * sizeof(char *));
+			if ( prune_patterns == NULL ) {
+				quit(1,"realloc failed for prune patterns");
+			} /* IF */
+			prune_patterns[num_prunes++] = optarg;
+			break;
+		case OPT_PIPELINE:
+			opt_pipeline = 1;
+			break;
+		case OPT_NAME:
+			errflag += add_filter_test(FILTER_NAME,optarg) != 0;
+			break;
+		case OPT_REGEX:
+			errflag += add_filter_test(FILTER_REGEX,optarg) != 0;
+			break;
+		case OPT_TYPE:
+			errflag += add_filter_test(FILTER_TYPE,optarg) != 0;
+			break;
+		case OPT_SIZE:
+			errflag += add_filter_test(FILTER_SIZE,optarg) != 0;
+			break;
+		case OPT_MTIME:
+			errflag += add_filter_test(FILTER_MTIME,optarg) != 0;
+			break;
+		case OPT_NOT:
+			add_filter_test(FILTER_NOT,NULL);
+			break;
+		case OPT_DU:
+			opt_du = 1;
+			opt_R = 1;
+			break;
+		case OPT_DEPTH:
+			opt_du_depth = atoi(optarg);
+			if ( opt_du_depth < 0 ) {
+				printf("Invalid depth '%s'\n",optarg);
+				errflag += 1;
+			} /* IF */
+			break;
+		case OPT_OR:
+			add_filter_test(FILTER_OR,NULL);
+			break;
+		case OPT_TOP:
+			opt_top = atoi(optarg);
+			if ( opt_top < 1 ) {
+				printf("Invalid number of entries '%s'\n",optarg);
+				errflag += 1;
+			} /* IF */
+			break;
+		case 'U':
+		case OPT_STREAM:
+			opt_U = 1;
+			break;
 		case '?':
 			printf("Unknown option '%c'\n",optopt);
 			errflag += 1;
@@ -782,21 +10618,118 @@ int main(int argc, char *argv[])
 			printf("Unexpected value from getopt() '%c'\n",c);
 		} /* SWITCH */
 	} /* WHILE */
+	if ( opt_diff != NULL ) {
+		error_status = 2;
+	} /* IF */
 	if ( errflag ) {
 		usage(argv[0]);
-		die(1,"\nAborted due to parameter errors\n");
+		die(error_status,"\nAborted due to parameter errors\n");
 	} /* IF */
 	if ( opt_t + opt_s + opt_n  > 1 ) {
-		die(1,"Only one of 't' , 's' and 'n' can be specified\n");
+		die(error_status,"Only one of 't' , 's' and 'n' can be specified\n");
+	} /* IF */
+	if ( opt_top && opt_t == 0 && opt_s == 0 ) {
+		die(error_status,"'--top' requires 't' or 's'\n");
+	} /* IF */
+	if ( opt_U && (opt_t || opt_s || opt_r) ) {
+		die(error_status,"'U' can not be combined with 't' , 's' or 'r'\n");
+	} /* IF */
+	if ( opt_du && (opt_U || opt_t || opt_top) ) {
+		die(error_status,"'--du' can not be combined with 'U' , 't' or '--top'\n");
+	} /* IF */
+	if ( opt_du_depth >= 0 && opt_du == 0 ) {
+		die(error_status,"'--depth' requires '--du'\n");
+	} /* IF */
+	if ( opt_watch && (opt_U || opt_du || opt_top || opt_max_memory > 0 || opt_pipeline) ) {
+		die(error_status,"'--watch' can not be combined with 'U' , '--du' , '--top' , '--max-memory' or '--pipeline'\n");
+	} /* IF */
+	if ( opt_manifest != NULL && (opt_1 || opt_U || opt_du || opt_watch || opt_diff != NULL) ) {
+		die(error_status,"'--manifest' can not be combined with '1' , 'U' , '--du' , '--watch' or '--diff'\n");
+	} /* IF */
+	if ( opt_format != FORMAT_LONG && (opt_du || opt_watch || opt_manifest != NULL || opt_diff != NULL) ) {
+		die(error_status,"'--format' can not be combined with '--du' , '--watch' , '--manifest' or '--diff'\n");
+	} /* IF */
+	if ( opt_format == FORMAT_BIN && opt_1 ) {
+		die(error_status,"'--format=bin' can not be combined with '1'\n");
+	} /* IF */
+	if ( opt_hash && (opt_1 || opt_U || opt_du || opt_max_memory > 0 || opt_pipeline || opt_restat || opt_watch ||
+				opt_manifest != NULL || opt_diff != NULL || opt_format != FORMAT_LONG) ) {
+		die(error_status,"'--hash' can not be combined with '1' , 'U' , '--du' , '--max-memory' , '--pipeline' , '--restat' ,\n"
+				"'--watch' , '--manifest' , '--diff' or '--format'\n");
+	} /* IF */
+	if ( opt_hash_cache != NULL && opt_hash == 0 ) {
+		die(error_status,"'--hash-cache' requires '--hash'\n");
+	} /* IF */
+	if ( opt_diff != NULL && optind != argc - 1 ) {
+		die(error_status,"'--diff' takes the manifests OLD and NEW\n");
+	} /* IF */
+#ifndef	__linux__
+	if ( opt_watch ) {
+		die(1,"'--watch' needs inotify\n");
+	} /* IF */
+#endif
+	if ( opt_U && opt_j > 1 ) {
+		debug_print("'U' lists in traversal order , 'j' is ignored\n");
+		opt_j = 1;
+	} /* IF */
+	if ( opt_max_memory > 0 && opt_j > 1 ) {
+		debug_print("'--max-memory' bounds the list of a single traversal thread , 'j' is ignored\n");
+		opt_j = 1;
+	} /* IF */
+	if ( opt_pipeline && opt_j > 1 ) {
+		debug_print("'--pipeline' has a single traversal thread , 'j' is ignored\n");
+		opt_j = 1;
 	} /* IF */
 	if ( opt_h ) {
 		usage(argv[0]);
 		exit(0);
 	} /* IF */
+	compile_filter();
+	Groups.is_group = 1;
+	pthread_mutex_init(&Owners.lock,NULL);
+	pthread_mutex_init(&Groups.lock,NULL);
+	if ( opt_cache != NULL && opt_pipeline ) {
+		debug_print("'--pipeline' does not use the snapshot cache , '--cache' is ignored\n");
+		opt_cache = NULL;
+	} /* IF */
+	if ( opt_cache != NULL ) {
+		open_cache(opt_cache);
+	} /* IF */
+#ifdef	__linux__
+	if ( opt_watch ) {
+		open_watch();
+	} /* IF */
+#endif
+	if ( opt_locale_sort ) {
+		setlocale(LC_COLLATE,"");
+	} /* IF */
 
+	build_mode_table();
+	if ( opt_diff != NULL ) {
+		index = diff_manifests(opt_diff,argv[optind]) > 0;
+		flush_output();
+		exit(index);
+	} /* IF */
+	if ( opt_manifest != NULL ) {
+		open_manifest(opt_manifest);
+	} /* IF */
+	if ( opt_format != FORMAT_LONG ) {
+		start_machine_output();
+	} /* IF */
+	if ( opt_pipeline ) {
+		start_pipeline();
+	} /* IF */
 	num_args = argc - optind;
 	if ( num_args <= 0 ) {
-		list_directory(".");
+		if ( opt_pipeline ) {
+			pipe_list_directory(".");
+		} /* IF */
+		else if ( opt_R && opt_j > 1 ) {
+			list_directory_parallel(".");
+		} /* ELSE IF */
+		else {
+			list_directory(".");
+		} /* ELSE */
 	} /* IF */
 	else {
 		filename = argv[optind];
@@ -807,27 +10740,93 @@ int main(int argc, char *argv[])
 			else {
 				filemode = filestats.st_mode & _S_IFMT;
 				if ( _S_ISDIR(filemode) && opt_d == 0 ) {
-					list_directory(filename);
+					if ( opt_pipeline ) {
+						pipe_list_directory(filename);
+					} /* IF */
+					else if ( opt_R && opt_j > 1 ) {
+						list_directory_parallel(filename);
+					} /* ELSE IF */
+					else {
+						list_directory(filename);
+					} /* ELSE */
 				} /* IF */
+				else if ( opt_pipeline ) {
+					pipe_add_file(filename,&filestats);
+				} /* ELSE IF */
 				else {
-					add_file_to_list(filename,&filestats);
+					add_scanned_entry(&NoDir,filename,DT_UNKNOWN,1,0,&filestats,NULL,FILTER_UNKNOWN);
 				} /* ELSE */
 			} /* ELSE */
+			if ( opt_U && opt_pipeline == 0 ) {
+				stream_files();
+			} /* IF */
 		} /* FOR */
 	} /* ELSE */
+	if ( opt_pipeline ) {
+		finish_pipeline();
+	} /* IF */
+	if ( opt_cache != NULL ) {
+		close_cache();
+	} /* IF */
 
-	debug_print("Check for reversal\n");
-	if ( opt_r ) {
-		file_node = Reverse(Files.first);
+	if ( num_prunes > 0 ) {
+		debug_print("%ld directories pruned\n",atomic_load(&num_pruned));
+	} /* IF */
+	if ( opt_R ) {
+		debug_print("%ld directories skipped as cycles , %ld already counted , %ld on other file systems\n",
+				atomic_load(&num_cycles_skipped),atomic_load(&num_revisits_skipped),
+				atomic_load(&num_mounts_skipped));
+	} /* IF */
+	if ( Filter != NULL ) {
+		debug_print("%ld entries rejected before stat , %ld after stat , %ld stat calls saved\n",
+				atomic_load(&num_rejected_early),atomic_load(&num_rejected_late),
+				atomic_load(&num_stats_saved));
+	} /* IF */
+	if ( opt_hash ) {
+		debug_print("\nHash the files\n");
+		hash_files(&Files);
+	} /* IF */
+	if ( opt_du ) {
+		show_du_summary();
+	} /* IF */
+	if ( opt_top ) {
+		finish_top_list();
 	} /* IF */
+	if ( Runs.count > 0 ) {
+		debug_print("\nMerge the sorted runs\n");
+		merge_runs();
+	} /* IF the list went to run files */
 	else {
-		file_node = Files.first;
+		debug_print("Sort the list\n");
+		sort_file_list();
+
+		debug_print("\nList info for files\n");
+		for ( index = 0 ; index < Files.count ; ++index ) {
+			display_file_info(&Files,Files.order[index]);
+		} /* FOR */
 	} /* ELSE */
+	stop_output_writer();
+	if ( opt_manifest != NULL ) {
+		finish_manifest();
+	} /* IF */
 
-	debug_print("\nList info for files\n");
-	for ( ; file_node != NULL ; file_node = file_node->next ) {
-		display_file_info(file_node->filename);
-	} /* FOR */
+	if ( opt_D ) {
+		getrusage(RUSAGE_SELF,&resources);
+		debug_print("%ld entries , max RSS %ld KiB\n",Files.count + num_streamed + num_merged,resources.ru_maxrss);
+		if ( opt_o || opt_g ) {
+			debug_print("%ld owner names looked up for %ld rows , %ld group names for %ld rows\n",
+					atomic_load(&Owners.num_lookups),atomic_load(&Owners.num_lookups) + atomic_load(&Owners.num_hits),
+					atomic_load(&Groups.num_lookups),atomic_load(&Groups.num_lookups) + atomic_load(&Groups.num_hits));
+		} /* IF */
+	} /* IF */
+	flush_output();
+#ifdef	__linux__
+	if ( opt_watch ) {
+		watch_listing();
+	} /* IF */
+#endif
+	release_arenas();
+	free_list(&Files);
 
 	exit(0);
 } /* end of main */